@@ -48,10 +48,17 @@
 #endif
 
 #include "vm_assert.h"
+#include "vm_basic_defs.h"
 #include "rpcout.h"
 #include "hgfs.h"     // for common HGFS definitions
 #include "hgfsBd.h"
 
+/*
+ * Bytes of a request saved by HgfsBd_DispatchInPlace, so that it can be
+ * restored after the host answers it with a (short) error message.
+ */
+#define HGFS_BD_REQUEST_SAVE_LEN 128
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -287,6 +294,89 @@ HgfsBd_Dispatch(RpcOut *out,            // IN: Channel to send on
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsBd_DispatchInPlace --
+ *
+ *    Send an hgfs request and receive the reply into the same buffer,
+ *    without going through the reception buffer of the channel. The
+ *    status the RPC reply starts with takes the place of the command
+ *    prefix, so the reply packet starts where the request did.
+ *
+ * Results:
+ *    On success, returns zero.
+ *    -1 if the request could not be sent, the packet is unchanged.
+ *    -2 if the request was sent but the reply could not be received, the
+ *    packet may hold part of the reply.
+ *    -3 if the host failed the request, the packet is unchanged. When the
+ *    error message is too long for the request to be restored, -2 instead.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+HgfsBd_DispatchInPlace(RpcOut *out,            // IN: Channel to send on
+                       char *packet,           // IN/OUT: Request, then reply
+                       size_t packetAlloc,     // IN: Size of packet buffer
+                       size_t *packetSize)     // IN/OUT: Size of packet in/out
+{
+   Bool success;
+   Bool rpcStatus;
+   char const *reply;
+   size_t replyLen;
+   char *bdPacket = packet - HGFS_SYNC_REQREP_CLIENT_CMD_LEN;
+   char saved[HGFS_BD_REQUEST_SAVE_LEN];
+   size_t savedLen;
+
+   ASSERT(out);
+   ASSERT(packet);
+   ASSERT(packetSize);
+   /* The reply status ("1 ") replaces the command prefix ("f "). */
+   ASSERT_ON_COMPILE(HGFS_SYNC_REQREP_CLIENT_CMD_LEN == 2);
+
+   memcpy(bdPacket, HGFS_SYNC_REQREP_CLIENT_CMD, HGFS_SYNC_REQREP_CLIENT_CMD_LEN);
+   savedLen = MIN(sizeof saved, *packetSize + HGFS_CLIENT_CMD_LEN);
+   memcpy(saved, bdPacket, savedLen);
+
+   success = RpcOut_sendBuffer(out, bdPacket, *packetSize + HGFS_CLIENT_CMD_LEN,
+                               bdPacket,
+                               packetAlloc + HGFS_SYNC_REQREP_CLIENT_CMD_LEN,
+                               &rpcStatus, &reply, &replyLen);
+   if (success && !rpcStatus) {
+      Debug("HgfsBd_DispatchInPlace: host failed the request\n");
+      /*
+       * The error message and its NUL overwrote the start of the request,
+       * put it back so that the request can be sent again.
+       */
+      if (HGFS_SYNC_REQREP_CLIENT_CMD_LEN + replyLen + 1 <= savedLen) {
+         memcpy(bdPacket, saved, savedLen);
+         return -3;
+      }
+      return -2;
+   }
+
+   if (!success) {
+      Debug("HgfsBd_DispatchInPlace: RpcOut_sendBuffer returned failure\n");
+      /*
+       * Receiving overwrites the command prefix first: if it is intact, the
+       * request can be sent again.
+       */
+      return memcmp(bdPacket, HGFS_SYNC_REQREP_CLIENT_CMD,
+                    HGFS_SYNC_REQREP_CLIENT_CMD_LEN) == 0 ? -1 : -2;
+   }
+
+   ASSERT(reply == packet);
+   ASSERT(replyLen <= HGFS_LARGE_PACKET_MAX);
+   *packetSize = replyLen;
+
+   return 0;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -133,6 +133,27 @@
  */
 #define CONFNAME_GUESTINFO_STATSINTERVAL "stats-interval"
 
+/**
+ * Define the interval (in milliseconds) at which the CPU run queue, the disk
+ * request queue and the memory pressure are sampled between two GuestStats
+ * polls. Each poll then reports their minimum, median, 95th percentile and
+ * maximum over the samples taken since the previous poll.
+ *
+ * @note Linux only.
+ *
+ * @param int   Sampling interval. Set to 0, the default, to disable.
+ */
+#define CONFNAME_GUESTINFO_HIGHRESINTERVAL "highres-stats-interval"
+
+/**
+ * Define the share of one CPU (in hundredths of a percent) that high
+ * resolution sampling may use. When it uses more, the sampling interval is
+ * doubled.
+ *
+ * @param int   CPU budget. Defaults to 50, i.e. 0.5%.
+ */
+#define CONFNAME_GUESTINFO_HIGHRESBUDGET "highres-stats-cpu-budget"
+
 /**
  * Indicates whether stat results should be written to the log.
  */
@@ -48,6 +48,15 @@
 
 #define GUEST_INFO_COMMAND "SetGuestInfo"
 #define GUEST_DISK_INFO_COMMAND "SetGuestDiskInfo"
+
+/*
+ * Sets several key/value pairs at once, for hosts that report the
+ * capability below. The message is the command followed by one
+ * " <key> <value length> <value>" triple per pair; an empty reply means
+ * all of them were set.
+ */
+#define GUEST_INFO_BATCH_COMMAND "SetGuestInfoBatch"
+#define GUEST_INFO_BATCH_CAPABILITY "vmx.capability.guestinfo_batch"
 #define MAX_VALUE_LEN 100
 
 #define MAX_NICS     16
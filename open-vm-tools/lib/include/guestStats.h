@@ -325,7 +325,20 @@ typedef enum {
    DEFINE_GUEST_STAT(GuestStatID_Windows_ProcessorQueue,          64, "guest.processor.queue") \
    DEFINE_GUEST_STAT(GuestStatID_Windows_DiskQueue,               65, "guest.disk.queue") \
    DEFINE_GUEST_STAT(GuestStatID_Windows_DiskQueueAvg,            66, "guest.disk.queueAvg") \
-   DEFINE_GUEST_STAT(GuestStatID_Max,                             67, "__MAX__")
+   /* Summaries of high resolution samples */ \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_CpuRunQueueMin,            67, "guest.cpu.runQueue.min") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_CpuRunQueueP50,            68, "guest.cpu.runQueue.p50") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_CpuRunQueueP95,            69, "guest.cpu.runQueue.p95") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_CpuRunQueueMax,            70, "guest.cpu.runQueue.max") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_DiskRequestQueueMin,       71, "guest.disk.requestQueue.min") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_DiskRequestQueueP50,       72, "guest.disk.requestQueue.p50") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_DiskRequestQueueP95,       73, "guest.disk.requestQueue.p95") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_DiskRequestQueueMax,       74, "guest.disk.requestQueue.max") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_MemPressureMin,            75, "guest.mem.pressure.min") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_MemPressureP50,            76, "guest.mem.pressure.p50") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_MemPressureP95,            77, "guest.mem.pressure.p95") \
+   DEFINE_GUEST_STAT(GuestStatID_Linux_MemPressureMax,            78, "guest.mem.pressure.max") \
+   DEFINE_GUEST_STAT(GuestStatID_Max,                             79, "__MAX__")
 
 /*
  * Define stats enumeration
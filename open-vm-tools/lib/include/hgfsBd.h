@@ -56,6 +56,11 @@ int HgfsBd_Dispatch(RpcOut *out,
                     size_t *packetSize,
                     char const **packetOut);
 
+int HgfsBd_DispatchInPlace(RpcOut *out,
+                           char *packet,
+                           size_t packetAlloc,
+                           size_t *packetSize);
+
 Bool HgfsBd_Enabled(RpcOut *out,
                     char *requestPacket);
 
@@ -71,6 +71,8 @@ Bool Message_Send(Message_Channel *chan, const unsigned char *buf,
                   size_t bufSize);
 Bool Message_Receive(Message_Channel *chan, unsigned char **buf,
                      size_t *bufSize);
+Bool Message_ReceiveBuffer(Message_Channel *chan, unsigned char *buf,
+                           size_t bufAlloc, size_t *bufSize);
 Bool Message_CloseAllocated(Message_Channel *chan);
 Bool Message_Close(Message_Channel *chan);
 
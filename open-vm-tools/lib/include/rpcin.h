@@ -37,6 +37,20 @@ typedef void RpcIn_ClearErrorFunc(void *clientData);
 
 typedef struct RpcIn RpcIn;
 
+/*
+ * Counters of the host=>guest direction. The backdoor is polled, so each
+ * poll is a wakeup and a command waits for up to the delay of the poll
+ * that picks it up; the vsock connection delivers commands as they come.
+ */
+typedef struct RpcInStats {
+   uint64 vsockCommands;      // Commands received on the vsock connection
+   uint64 backdoorCommands;   // Commands received by polling the backdoor
+   uint64 backdoorPolls;      // Backdoor polls
+   uint64 backdoorWaitMs;     // Sum of the poll delays preceding commands
+   uint64 heartbeats;         // Heartbeats sent on the vsock connection
+   uint64 vsockRetries;       // vsock probes made while polling the backdoor
+} RpcInStats;
+
 #if defined(VMTOOLS_USE_GLIB) /* { */
 
 #include "vmware/tools/guestrpc.h"
@@ -50,6 +64,10 @@ Bool RpcIn_start(RpcIn *in, unsigned int delay,
                  RpcIn_ClearErrorFunc *clearErrorFunc,
                  void *errorData);
 
+void RpcIn_DeferReply(RpcIn *in);
+Bool RpcIn_CompleteReply(RpcIn *in, Bool status,
+                         const char *result, size_t resultLen);
+
 #else /* } { */
 
 #include "dbllnklst.h"
@@ -91,6 +109,7 @@ unsigned int RpcIn_SetRetVals(char const **result, size_t *resultLen,
 
 void RpcIn_Destruct(RpcIn *in);
 void RpcIn_stop(RpcIn *in);
+void RpcIn_GetStats(RpcIn *in, RpcInStats *stats);
 
 #ifdef __cplusplus
 } // extern "C"
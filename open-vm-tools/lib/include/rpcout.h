@@ -52,6 +52,9 @@ void RpcOut_Destruct(RpcOut *out);
 Bool RpcOut_start(RpcOut *out);
 Bool RpcOut_send(RpcOut *out, char const *request, size_t reqLen,
                  Bool *rpcStatus, char const **reply, size_t *repLen);
+Bool RpcOut_sendBuffer(RpcOut *out, char const *request, size_t reqLen,
+                       char *replyBuf, size_t replyBufSize,
+                       Bool *rpcStatus, char const **reply, size_t *repLen);
 Bool RpcOut_stop(RpcOut *out);
 
 
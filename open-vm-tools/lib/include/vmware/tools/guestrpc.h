@@ -112,8 +112,33 @@ typedef struct RpcChannelCallback {
     * for deserializing the input data.
     */
    size_t            xdrInSize;
+   /** RPCCHANNEL_FLAG_* values. */
+   guint             flags;
 } RpcChannelCallback;
 
+/**
+ * The callback may run on a worker thread, see RpcChannel_SetOffloadFunc. It
+ * must not touch state owned by the main loop, and should not hold the
+ * channel for long, since the host waits for its reply before sending the
+ * next command.
+ */
+#define RPCCHANNEL_FLAG_OFFLOAD  (1 << 0)
+
+/**
+ * Work item passed to an RpcChannelOffloadFunc. @a run is FALSE if the work
+ * cannot be run after all, which fails the RPC.
+ */
+typedef void (*RpcChannelWorkFunc)(gpointer workData, gboolean run);
+
+/**
+ * Runs @a work with @a workData on some other thread. Returns whether the
+ * work was taken; if not, the RPC is handled on the main loop. Work that was
+ * taken must be called exactly once, even if it cannot be run.
+ */
+typedef gboolean (*RpcChannelOffloadFunc)(RpcChannelWorkFunc work,
+                                          gpointer workData,
+                                          gpointer data);
+
 /**
  * Signature for the callback function called after a channel reset.
  *
@@ -154,6 +179,54 @@ void
 RpcChannel_Free(void *ptr);
 
 #if !defined(USE_RPCI_ONLY)
+/** Send counters of a channel, see RpcChannel_GetStats. */
+typedef struct RpcChannelStats {
+   /** Messages sent on the channel itself. */
+   guint64 sends;
+   /** Sends that found the channel busy and waited for it. */
+   guint64 contendedSends;
+   /** Total time spent waiting for the channel, in microseconds. */
+   guint64 lockWaitUs;
+   /** Sends that found the channel busy and used a helper connection. */
+   guint64 concurrentSends;
+   /** Host commands received on the vsock connection. */
+   guint64 inVSockCommands;
+   /** Host commands received by polling the backdoor. */
+   guint64 inBackdoorCommands;
+   /** Backdoor polls, each of them a wakeup of the guest. */
+   guint64 inBackdoorPolls;
+   /** Total delay of the polls that picked up commands, in milliseconds. */
+   guint64 inBackdoorWaitMs;
+} RpcChannelStats;
+
+void
+RpcChannel_GetStats(RpcChannel *chan,
+                    RpcChannelStats *stats);
+
+/** Counters of an RPC handler, see RpcChannel_GetHandlerStats. */
+typedef struct RpcChannelHandlerStats {
+   /** Commands handled. */
+   guint64 calls;
+   /** Commands handled on a worker thread. */
+   guint64 offloaded;
+   /** Total time from dispatch to reply, in microseconds. */
+   guint64 totalUs;
+   /** Longest time from dispatch to reply, in microseconds. */
+   guint64 maxUs;
+   /** Total time offloaded commands waited for a worker, in microseconds. */
+   guint64 queueUs;
+} RpcChannelHandlerStats;
+
+gboolean
+RpcChannel_GetHandlerStats(RpcChannel *chan,
+                           const char *name,
+                           RpcChannelHandlerStats *stats);
+
+void
+RpcChannel_SetOffloadFunc(RpcChannel *chan,
+                          RpcChannelOffloadFunc func,
+                          gpointer data);
+
 gboolean
 RpcChannel_BuildXdrCommand(const char *cmd,
                            void *xdrProc,
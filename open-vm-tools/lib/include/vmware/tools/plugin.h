@@ -46,15 +46,18 @@
  * @param[in]  ctx      The application context.
  * @param[in]  err      Error code. Must not be 0.
  */
-#define VMTOOLSAPP_ERROR(ctx, err) do {   \
-   ASSERT((err) != 0);                    \
-   (ctx)->errorCode = (err);              \
-   g_main_loop_quit((ctx)->mainLoop);     \
+#define VMTOOLSAPP_ERROR(ctx, err) do {                       \
+   ASSERT((err) != 0);                                        \
+   g_atomic_pointer_set(&(ctx)->errorThread, g_thread_self()); \
+   g_atomic_int_set(&(ctx)->errorCode, (err));                \
+   g_main_loop_quit((ctx)->mainLoop);                         \
 } while (0)
 
 
 /**
- * Attaches the given event source to the app context's main loop.
+ * Attaches the given event source to the app context's main loop. The
+ * callback's dispatches are reported to the service's dispatch monitor
+ * under the callback's name.
  *
  * @param[in]  ctx      The application context.
  * @param[in]  src      Source to attach.
@@ -64,7 +67,8 @@
  */
 #define VMTOOLSAPP_ATTACH_SOURCE(ctx, src, cb, data, destroy) do {      \
    GSource *__src = (src);                                              \
-   g_source_set_callback(__src, (GSourceFunc) (cb), (data), (destroy)); \
+   VMTools_SetSourceCallback(__src, (GSourceFunc) (cb), (data),         \
+                             (destroy), #cb);                           \
    g_source_attach(__src, g_main_loop_get_context((ctx)->mainLoop));    \
 } while (0)
 
@@ -135,6 +139,21 @@ ToolsCore_LogState(guint level,
  */
 #define TOOLS_CORE_SIG_CONF_RELOAD "tcs_conf_reload"
 
+/**
+ * Signal sent when the config file is reloaded, once for each group whose
+ * keys changed, before TOOLS_CORE_SIG_CONF_RELOAD. The group name is the
+ * signal's detail, so plugins can connect to "tcs_conf_changed::group" to
+ * only hear about the groups they read.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      ToolsAppCtx *: The application context.
+ * @param[in]  keys     const gchar * const *: NULL-terminated, sorted list of
+ *                      the keys of the group that were added, removed or
+ *                      modified.
+ * @param[in]  data     Client data.
+ */
+#define TOOLS_CORE_SIG_CONF_CHANGED "tcs_conf_changed"
+
 /**
  * Signal sent when the service receives a request to dump its internal
  * state to the log. This is for debugging purposes, and plugins can
@@ -280,6 +299,8 @@ typedef struct ToolsAppCtx {
     * register and emit their own signals using this object.
     */
    gpointer          serviceObj;
+   /** The thread that last reported an error, see VMTOOLSAPP_ERROR. */
+   gpointer          errorThread;
 } ToolsAppCtx;
 
 #if defined(G_PLATFORM_WIN32)
@@ -54,6 +54,16 @@
 typedef void (*ToolsCorePoolCb)(ToolsAppCtx *ctx,
                                 gpointer data);
 
+/**
+ * Priority classes of pool tasks. Queued latency-critical tasks are always
+ * picked before background ones; within a class, tasks are not reordered.
+ */
+typedef enum ToolsCorePoolPriority {
+   TOOLS_CORE_POOL_PRIO_LATENCY,
+   TOOLS_CORE_POOL_PRIO_BACKGROUND,
+   TOOLS_CORE_POOL_PRIO_MAX
+} ToolsCorePoolPriority;
+
 /**
  * @brief Public interface of the shared thread pool.
  *
@@ -75,6 +85,11 @@ typedef struct ToolsCorePool {
                      ToolsCorePoolCb interrupt,
                      gpointer data,
                      GDestroyNotify dtor);
+   guint (*submitPrio)(ToolsAppCtx *ctx,
+                       ToolsCorePoolPriority prio,
+                       ToolsCorePoolCb cb,
+                       gpointer data,
+                       GDestroyNotify dtor);
 } ToolsCorePool;
 
 
@@ -137,6 +152,45 @@ ToolsCorePool_SubmitTask(ToolsAppCtx *ctx,
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePool_SubmitTaskPrio --                                        */ /**
+ *
+ * @brief Submits a task for execution in the thread pool with the given
+ * priority class.
+ *
+ * Same as ToolsCorePool_SubmitTask(), which submits background tasks, except
+ * that latency-critical tasks are run ahead of any queued background task.
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] prio   Priority class of the task.
+ * @param[in] cb     Function to execute the task.
+ * @param[in] data   Opaque data for the task.
+ * @param[in] dtor   Destructor for the task data.
+ *
+ * @return An identifier for the task, or 0 on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC guint
+ToolsCorePool_SubmitTaskPrio(ToolsAppCtx *ctx,
+                             ToolsCorePoolPriority prio,
+                             ToolsCorePoolCb cb,
+                             gpointer data,
+                             GDestroyNotify dtor)
+{
+   ToolsCorePool *pool = ToolsCorePool_GetPool(ctx);
+   if (pool != NULL) {
+      if (pool->submitPrio != NULL) {
+         return pool->submitPrio(ctx, prio, cb, data, dtor);
+      }
+      return pool->submit(ctx, cb, data, dtor);
+   }
+   return 0;
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePool_CancelTask --                                            */ /**
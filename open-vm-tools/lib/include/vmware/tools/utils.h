@@ -102,6 +102,30 @@
 /** Convenience macro around VMTools_WrapArray. */
 #define VMTOOLS_WRAP_ARRAY(a) VMTools_WrapArray((a), sizeof *(a), G_N_ELEMENTS(a))
 
+/**
+ * Receives the callbacks dispatched by the main loop, see
+ * VMTools_SetDispatchMonitor(). "begin" returns a token for the matching
+ * "end" call, or NULL to not be told when the callback returns.
+ */
+typedef struct VMToolsDispatchMonitor {
+   gpointer (*begin)(const gchar *name, gpointer data);
+   void     (*end)(gpointer token, gpointer data);
+   gpointer   data;
+} VMToolsDispatchMonitor;
+
+/** Slack of a coalesced timer that uses the timer wheel's default. */
+#define VMTOOLS_TIMER_DEFAULT_SLACK ((guint) -1)
+
+/** Counters of the timer wheel, see VMTools_GetTimerWheelStats(). */
+typedef struct VMToolsTimerWheelStats {
+   /** Coalesced timers that exist. */
+   guint    timers;
+   /** Times a coalesced timer fired. */
+   guint64  fires;
+   /** Main loop iterations that fired at least one coalesced timer. */
+   guint64  wakeups;
+} VMToolsTimerWheelStats;
+
 
 G_BEGIN_DECLS
 
@@ -119,6 +143,10 @@ VMTools_WriteConfig(const gchar *path,
                     GKeyFile *config,
                     GError **err);
 
+GHashTable *
+VMTools_ConfigDiff(GKeyFile *oldConfig,
+                   GKeyFile *newConfig);
+
 gboolean
 VMTools_ChangeLogFilePath(const gchar *delimiter,
                           const gchar *appendString,
@@ -167,6 +195,33 @@ VMTools_GetLibdir(void);
 GSource *
 VMTools_CreateTimer(gint timeout);
 
+GSource *
+VMTools_CreateCoalescedTimer(guint interval,
+                             guint slack);
+
+void
+VMTools_ConfigureTimerWheel(guint tick,
+                            guint slackPct);
+
+void
+VMTools_GetTimerWheelStats(VMToolsTimerWheelStats *stats);
+
+void
+VMTools_SetDispatchMonitor(VMToolsDispatchMonitor *monitor);
+
+gpointer
+VMTools_DispatchBegin(const gchar *name);
+
+void
+VMTools_DispatchEnd(gpointer token);
+
+void
+VMTools_SetSourceCallback(GSource *src,
+                          GSourceFunc func,
+                          gpointer data,
+                          GDestroyNotify destroy,
+                          const gchar *name);
+
 void
 VMTools_SetGuestSDKMode(void);
 
@@ -322,9 +322,11 @@ retry:
 /*
  *-----------------------------------------------------------------------------
  *
- * Message_Receive --
+ * MessageReceiveInt --
  *
- *    If vmware has posted a message for this channel, retrieve it
+ *    If vmware has posted a message for this channel, retrieve it into
+ *    userBuf if one is given, or else into the reception buffer of the
+ *    channel.
  *
  * Result:
  *    TRUE on success (bufSize is 0 if there is no message)
@@ -336,10 +338,12 @@ retry:
  *-----------------------------------------------------------------------------
  */
 
-Bool
-Message_Receive(Message_Channel *chan, // IN/OUT
-                unsigned char **buf,   // OUT
-                size_t *bufSize)       // OUT
+static Bool
+MessageReceiveInt(Message_Channel *chan,  // IN/OUT
+                  unsigned char *userBuf, // IN/OUT: optional
+                  size_t userBufAlloc,    // IN
+                  unsigned char **buf,    // OUT
+                  size_t *bufSize)        // OUT
 {
    Backdoor_proto bp;
    size_t myBufSize;
@@ -392,7 +396,13 @@ retry:
     * deal with this message may not know about binary strings, and may expect
     * a C string instead. --hpreg
     */
-   if (myBufSize + 1 > chan->inAlloc) {
+   if (userBuf != NULL) {
+      if (myBufSize + 1 > userBufAlloc) {
+         MESSAGE_LOG("Message: Buffer too small to receive a message over "
+                     "the communication channel %u\n", chan->id);
+         goto error_quit;
+      }
+   } else if (myBufSize + 1 > chan->inAlloc) {
       if (chan->inPreallocated) {
          MESSAGE_LOG("Message: Buffer too small to receive a message over "
                      "the communication channel %u\n", chan->id);
@@ -409,7 +419,7 @@ retry:
       }
    }
    *bufSize = myBufSize;
-   myBuf = *buf = chan->in;
+   myBuf = *buf = userBuf != NULL ? userBuf : chan->in;
 
    if (bp.in.cx.halfs.high & MESSAGE_STATUS_HB) {
       /*
@@ -514,7 +524,7 @@ retry:
    }
 
    /* Write a trailing NUL just after the message. --hpreg */
-   chan->in[*bufSize] = '\0';
+   (*buf)[*bufSize] = '\0';
 
    /* IN: Type */
    bp.in.cx.halfs.high = MESSAGE_TYPE_RECVSTATUS;
@@ -570,6 +580,67 @@ error_quit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Message_Receive --
+ *
+ *    If vmware has posted a message for this channel, retrieve it
+ *
+ * Result:
+ *    TRUE on success (bufSize is 0 if there is no message)
+ *    FALSE on failure
+ *
+ * Side-effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+Message_Receive(Message_Channel *chan, // IN/OUT
+                unsigned char **buf,   // OUT
+                size_t *bufSize)       // OUT
+{
+   return MessageReceiveInt(chan, NULL, 0, buf, bufSize);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Message_ReceiveBuffer --
+ *
+ *    If vmware has posted a message for this channel, retrieve it directly
+ *    into the caller's buffer instead of the reception buffer of the
+ *    channel. The buffer must have room for the message and a trailing NUL,
+ *    or the message is refused.
+ *
+ * Result:
+ *    TRUE on success (bufSize is 0 if there is no message)
+ *    FALSE on failure, the contents of buf are then undefined
+ *
+ * Side-effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+Message_ReceiveBuffer(Message_Channel *chan, // IN/OUT
+                      unsigned char *buf,    // OUT
+                      size_t bufAlloc,       // IN
+                      size_t *bufSize)       // OUT
+{
+   unsigned char *myBuf;
+
+   ASSERT(buf != NULL);
+   ASSERT(bufAlloc > 0);
+
+   return MessageReceiveInt(chan, buf, bufAlloc, &myBuf, bufSize);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
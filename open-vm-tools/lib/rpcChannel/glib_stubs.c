@@ -27,6 +27,7 @@
 #include <string.h>
 #include <glib.h>
 
+#include "hostinfo.h"
 #include "util.h"
 
 #if !defined(USE_RPCI_ONLY)
@@ -41,3 +42,5 @@ void g_mutex_init(GMutex *mutex) { }
 void g_mutex_clear(GMutex *mutex) { }
 void g_mutex_lock(GMutex *mutex) { }
 void g_mutex_unlock(GMutex *mutex) { }
+
+gint64 g_get_monotonic_time(void) { return Hostinfo_SystemTimerUS(); }
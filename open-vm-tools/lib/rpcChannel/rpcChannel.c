@@ -24,6 +24,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
 #include "debug.h"
 #include "rpcChannelInt.h"
 
@@ -32,6 +35,7 @@
 #include "vmxrpc.h"
 #include "xdrutil.h"
 #include "rpcin.h"
+#include "vmware/tools/utils.h"
 #endif
 
 #include "str.h"
@@ -39,6 +43,18 @@
 #include "util.h"
 #include "vm_assert.h"
 
+#if defined(NEED_RPCIN) && \
+    ((defined(__linux__) && !defined(USERWORLD)) || defined(_WIN32))
+/*
+ * The vsock RPCI protocol carries no request IDs, so a connection can only
+ * have one RPC in flight. A sender that finds a vsock channel busy sends on
+ * a helper connection instead of queuing behind the RPC in progress. The
+ * backdoor is left serialized.
+ */
+#define RPCCHANNEL_CONCURRENT_SEND
+#define RPCCHANNEL_MAX_HELPERS 2
+#endif
+
 /** Internal state of a channel. */
 typedef struct RpcChannelInt {
    RpcChannel              impl;
@@ -64,9 +80,47 @@ typedef struct RpcChannelInt {
    guint                   rpcMaxFailures;
    gboolean                rpcInInitialized;
    GSource                *restartTimer; /* Channel restart timer */
+   /* Send counters, protected by impl.outLock. */
+   guint64                 sends;
+   guint64                 contendedSends;
+   guint64                 lockWaitUs;
+   gint                    concurrentSends; /* atomic */
+   /* Handlers run on other threads, see RpcChannel_SetOffloadFunc. */
+   RpcChannelOffloadFunc   offloadFunc;
+   gpointer                offloadData;
+   GSList                 *offloaded;      /* RpcChannelOffloadOp in flight */
+   gboolean                inDispatch;     /* dispatching for RpcIn */
+   gboolean                replyDeferred;  /* current reply is offloaded */
+   guint                   dispatchDepth;
+   GHashTable             *handlerStats;   /* RpcChannelHandlerStats by name */
+#endif
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+   gint                    outType;         /* RpcChannelType, atomic */
+   GMutex                  helperLock;
+   GCond                   helperCond;      /* signaled when numHelpers drops */
+   /* Protected by helperLock. */
+   RpcChannel             *idleHelpers[RPCCHANNEL_MAX_HELPERS];
+   guint                   numIdleHelpers;
+   guint                   numHelpers;      /* idle and in use */
+   guint                   helperGen;       /* bumped when the channel stops */
 #endif
 } RpcChannelInt;
 
+#if defined(NEED_RPCIN)
+/** An RPC handler running on another thread. */
+typedef struct RpcChannelOffloadOp {
+   RpcChannelInt       *chan;       /* NULL once the channel stopped */
+   RpcChannelCallback   rpc;
+   RpcInData            data;
+   gchar               *name;
+   gchar               *args;
+   gboolean             status;
+   GMainContext        *mainCtx;
+   gint64               dispatchUs;
+   gint64               startUs;
+} RpcChannelOffloadOp;
+#endif
+
 #define LGPFX "RpcChannel: "
 
 static gboolean gUseBackdoorOnly = FALSE;
@@ -78,7 +132,48 @@ static gboolean gUseBackdoorOnly = FALSE;
  */
 static gboolean gVSocketFailed = FALSE;
 
+/*
+ * Started channels kept for reuse by the RpcChannel_SendOne* functions,
+ * so processes that send many one-shot RPCs do not open and close a
+ * channel for each of them. Privileged vsock channels are pooled apart
+ * from the regular ones, which may be backdoor channels. The pools are
+ * small because the host limits the number of open channels per VM.
+ * Channels idle for RPCCHANNEL_POOL_IDLE_TIMEOUT are closed by a reaper
+ * thread, which runs only while the pools hold channels. Builds with the
+ * glib stubs have no threads, and close them on the next use instead.
+ */
+#define RPCCHANNEL_POOL_MAX            2
+#define RPCCHANNEL_POOL_IDLE_TIMEOUT   (30 * G_USEC_PER_SEC)
+
+typedef struct RpcChannelPool {
+   /* Oldest first: the last channel is the most recently used. */
+   RpcChannel  *chans[RPCCHANNEL_POOL_MAX];
+   gint64       lastUse[RPCCHANNEL_POOL_MAX];   /* Monotonic time, in us */
+   guint        count;
+} RpcChannelPool;
+
+/** Pools of regular and privileged channels, protected by gPoolLock. */
+static RpcChannelPool gPools[2];
+static GMutex gPoolLock;
+static gboolean gPoolAtExit = FALSE;
+/** Set once the pools have been drained at exit, no channel is pooled after. */
+static gboolean gPoolDrained = FALSE;
+#if !defined(USE_RPCI_ONLY)
+/** Wakes up the reaper when the pools are drained. */
+static GCond gPoolCond;
+static gboolean gPoolReaperRunning = FALSE;
+/** Reaper thread to join, running or not. */
+static GThread *gPoolReaper = NULL;
+#endif
+#if !defined(_WIN32)
+/** Process that opened the pooled channels. */
+static pid_t gPoolPid;
+#endif
+
 static void RpcChannelStopNoLock(RpcChannel *chan);
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+static void RpcChannelHelpersStop(RpcChannelInt *chan);
+#endif
 
 
 #if defined(NEED_RPCIN)
@@ -317,6 +412,201 @@ exit:
 }
 
 
+/**
+ * Adds a handled RPC to the counters of its handler.
+ *
+ * @param[in]  chan     The RPC channel.
+ * @param[in]  name     Name of the RPC.
+ * @param[in]  totalUs  Time from dispatch to reply.
+ * @param[in]  queueUs  Time the RPC waited for a worker thread, or -1 if it
+ *                      was handled on the main loop.
+ */
+
+static void
+RpcChannelUpdateStats(RpcChannelInt *chan,
+                      const char *name,
+                      gint64 totalUs,
+                      gint64 queueUs)
+{
+   RpcChannelHandlerStats *stats;
+
+   if (chan->handlerStats == NULL) {
+      chan->handlerStats = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+   }
+
+   stats = g_hash_table_lookup(chan->handlerStats, name);
+   if (stats == NULL) {
+      stats = g_new0(RpcChannelHandlerStats, 1);
+      g_hash_table_insert(chan->handlerStats, g_strdup(name), stats);
+   }
+
+   stats->calls++;
+   stats->totalUs += totalUs;
+   stats->maxUs = MAX(stats->maxUs, (guint64) totalUs);
+   if (queueUs >= 0) {
+      stats->offloaded++;
+      stats->queueUs += queueUs;
+   }
+}
+
+
+/**
+ * Frees an offloaded RPC.
+ *
+ * @param[in]  op       The offloaded RPC.
+ */
+
+static void
+RpcChannelOffloadFree(RpcChannelOffloadOp *op)
+{
+   if (op->data.freeResult) {
+      free(op->data.result);
+   }
+   g_main_context_unref(op->mainCtx);
+   g_free(op->args);
+   g_free(op->name);
+   g_free(op);
+}
+
+
+/**
+ * Sends the reply of an offloaded RPC. Runs on the channel's main context
+ * once the handler has returned.
+ *
+ * @param[in]  _op      The offloaded RPC.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+RpcChannelOffloadDone(gpointer _op)
+{
+   RpcChannelOffloadOp *op = _op;
+   RpcChannelInt *chan = op->chan;
+
+   if (chan != NULL) {
+      ASSERT(op->data.result != NULL);
+      chan->offloaded = g_slist_remove(chan->offloaded, op);
+      RpcChannelUpdateStats(chan, op->name,
+                            g_get_monotonic_time() - op->dispatchUs,
+                            op->startUs - op->dispatchUs);
+      RpcIn_CompleteReply(chan->impl.in, op->status, op->data.result,
+                          op->data.resultLen);
+   } else {
+      Debug(LGPFX "Dropping the reply to '%s', the channel was stopped.\n",
+            op->name);
+   }
+
+   RpcChannelOffloadFree(op);
+   return FALSE;
+}
+
+
+/**
+ * Runs the handler of an offloaded RPC, on a worker thread.
+ *
+ * @param[in]  _op      The offloaded RPC.
+ * @param[in]  run      Whether to run the handler, or fail the RPC.
+ */
+
+static void
+RpcChannelOffloadRun(gpointer _op,
+                     gboolean run)
+{
+   RpcChannelOffloadOp *op = _op;
+   GSource *src;
+
+   op->startUs = g_get_monotonic_time();
+   if (!run) {
+      op->status = FALSE;
+      op->data.result = "Unable to run the RPC handler";
+      op->data.resultLen = strlen(op->data.result);
+      op->data.freeResult = FALSE;
+   } else if (op->rpc.xdrIn != NULL || op->rpc.xdrOut != NULL) {
+      op->status = RpcChannelXdrWrapper(&op->data, &op->rpc);
+   } else {
+      op->status = op->rpc.callback(&op->data);
+   }
+
+   src = g_idle_source_new();
+   g_source_set_callback(src, RpcChannelOffloadDone, op, NULL);
+   g_source_attach(src, op->mainCtx);
+   g_source_unref(src);
+}
+
+
+/**
+ * Hands an RPC to the channel's offload function, deferring its reply.
+ *
+ * @param[in]  chan     The RPC channel.
+ * @param[in]  rpc      The RPC's registration.
+ * @param[in]  data     The RPC data, with the arguments already adjusted.
+ *
+ * @return Whether the RPC was offloaded; if not, it should be handled
+ *         right away.
+ */
+
+static gboolean
+RpcChannelOffload(RpcChannelInt *chan,
+                  RpcChannelCallback *rpc,
+                  RpcInData *data)
+{
+   RpcChannelOffloadOp *op;
+
+   if (chan->offloadFunc == NULL || !chan->inDispatch || chan->replyDeferred) {
+      return FALSE;
+   }
+
+   op = g_new0(RpcChannelOffloadOp, 1);
+   op->chan = chan;
+   op->rpc = *rpc;
+   op->name = g_strdup(data->name);
+   /* Arguments are NUL terminated for handlers that parse them as strings. */
+   op->args = g_malloc(data->argsSize + 1);
+   memcpy(op->args, data->args, data->argsSize);
+   op->args[data->argsSize] = '\0';
+   op->data.name = op->name;
+   op->data.args = op->args;
+   op->data.argsSize = data->argsSize;
+   op->data.appCtx = data->appCtx;
+   op->data.clientData = data->clientData;
+   op->mainCtx = g_main_context_ref(chan->mainCtx);
+   op->dispatchUs = g_get_monotonic_time();
+
+   if (!chan->offloadFunc(RpcChannelOffloadRun, op, chan->offloadData)) {
+      RpcChannelOffloadFree(op);
+      return FALSE;
+   }
+
+   chan->offloaded = g_slist_prepend(chan->offloaded, op);
+   RpcIn_DeferReply(chan->impl.in);
+   chan->replyDeferred = TRUE;
+   return TRUE;
+}
+
+
+/**
+ * Detaches the offloaded RPCs from a channel that is stopping, so their
+ * replies are dropped.
+ *
+ * @param[in]  chan     The RPC channel.
+ */
+
+static void
+RpcChannelOrphanOffloaded(RpcChannelInt *chan)
+{
+   GSList *l;
+
+   for (l = chan->offloaded; l != NULL; l = l->next) {
+      RpcChannelOffloadOp *op = l->data;
+      op->chan = NULL;
+   }
+   g_slist_free(chan->offloaded);
+   chan->offloaded = NULL;
+}
+
+
 /**
  * Builds an "rpcout" command to send a XDR struct.
  *
@@ -384,9 +674,12 @@ RpcChannel_Dispatch(RpcInData *data)
    unsigned int index = 0;
    size_t nameLen;
    Bool status;
+   gpointer token;
+   gint64 start;
    RpcChannelCallback *rpc = NULL;
    RpcChannelInt *chan = data->clientData;
 
+   chan->dispatchDepth++;
    name = StrUtil_GetNextToken(&index, data->args, " ");
    if (name == NULL) {
       Debug(LGPFX "Bad command (null) received.\n");
@@ -412,21 +705,60 @@ RpcChannel_Dispatch(RpcInData *data)
    data->appCtx = chan->appCtx;
    data->clientData = rpc->clientData;
 
+   if ((rpc->flags & RPCCHANNEL_FLAG_OFFLOAD) != 0 &&
+       RpcChannelOffload(chan, rpc, data)) {
+      status = TRUE;
+      goto exit;
+   }
+
+   start = g_get_monotonic_time();
+   token = VMTools_DispatchBegin(name);
    if (rpc->xdrIn != NULL || rpc->xdrOut != NULL) {
       status = RpcChannelXdrWrapper(data, rpc);
    } else {
       status = rpc->callback(data);
    }
+   VMTools_DispatchEnd(token);
 
-   ASSERT(data->result != NULL);
+   ASSERT(data->result != NULL || chan->replyDeferred);
+
+   /* Stubs dispatching again to the real handler are counted once. */
+   if (chan->dispatchDepth == 1 && !chan->replyDeferred) {
+      RpcChannelUpdateStats(chan, name, g_get_monotonic_time() - start,
+                            -1);
+   }
 
 exit:
+   chan->dispatchDepth--;
    data->name = NULL;
    free(name);
    return status;
 }
 
 
+/**
+ * Dispatches an RPC received by the channel's RpcIn. Only those RPCs can
+ * have their reply deferred.
+ *
+ * @param[in,out]    data     The RPC data.
+ *
+ * @return Whether the RPC was handled successfully.
+ */
+
+static gboolean
+RpcChannelInDispatch(RpcInData *data)
+{
+   gboolean status;
+   RpcChannelInt *chan = data->clientData;
+
+   chan->inDispatch = TRUE;
+   chan->replyDeferred = FALSE;
+   status = RpcChannel_Dispatch(data);
+   chan->inDispatch = FALSE;
+   return status;
+}
+
+
 /**
  * Initializes the RPC channel for inbound operations.
  *
@@ -482,7 +814,7 @@ RpcChannel_Setup(RpcChannel *chan,
       chan->funcs->setup(chan, mainCtx, appName, appCtx);
    } else {
       chan->mainCtx = g_main_context_ref(mainCtx);
-      chan->in = RpcIn_Construct(mainCtx, RpcChannel_Dispatch, chan);
+      chan->in = RpcIn_Construct(mainCtx, RpcChannelInDispatch, chan);
       ASSERT(chan->in != NULL);
    }
 
@@ -528,6 +860,14 @@ RpcChannelTeardown(RpcChannel *chan)
       cdata->rpcs = NULL;
    }
 
+   RpcChannelOrphanOffloaded(cdata);
+   if (cdata->handlerStats != NULL) {
+      g_hash_table_destroy(cdata->handlerStats);
+      cdata->handlerStats = NULL;
+   }
+   cdata->offloadFunc = NULL;
+   cdata->offloadData = NULL;
+
    cdata->resetCb = NULL;
    cdata->resetData = NULL;
    cdata->appCtx = NULL;
@@ -679,6 +1019,10 @@ RpcChannel *
 RpcChannel_Create(void)
 {
    RpcChannelInt *chan = g_new0(RpcChannelInt, 1);
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+   g_mutex_init(&chan->helperLock);
+   g_cond_init(&chan->helperCond);
+#endif
    return &chan->impl;
 }
 
@@ -713,9 +1057,27 @@ RpcChannel_Destroy(RpcChannel *chan)
 #if defined(NEED_RPCIN)
    RpcChannelTeardown(chan);
 #endif
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+   /* The channel may not have been stopped if it has no stop function. */
+   RpcChannelHelpersStop((RpcChannelInt *)chan);
+#endif
 
    g_mutex_unlock(&chan->outLock);
 
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+   {
+      RpcChannelInt *cint = (RpcChannelInt *)chan;
+
+      /* Helpers in use are closed by their senders when they are done. */
+      g_mutex_lock(&cint->helperLock);
+      while (cint->numHelpers > 0) {
+         g_cond_wait(&cint->helperCond, &cint->helperLock);
+      }
+      g_mutex_unlock(&cint->helperLock);
+      g_cond_clear(&cint->helperCond);
+      g_mutex_clear(&cint->helperLock);
+   }
+#endif
    g_mutex_clear(&chan->outLock);
 
    g_free(chan);
@@ -878,9 +1240,14 @@ RpcChannelStopNoLock(RpcChannel *chan)
       return;
    }
 
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+   RpcChannelHelpersStop((RpcChannelInt *)chan);
+#endif
    chan->funcs->stop(chan);
 
 #if defined(NEED_RPCIN)
+   /* The reply to an offloaded RPC must not answer a later request. */
+   RpcChannelOrphanOffloaded((RpcChannelInt *)chan);
    if (chan->in != NULL) {
       if (chan->inStarted) {
          RpcIn_stop(chan->in);
@@ -939,30 +1306,207 @@ RpcChannel_Free(void *ptr)
 }
 
 
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+
+/**
+ * Closes the idle helper connections of a channel that is being stopped.
+ * Helpers in use are closed when they are returned. The outLock must be
+ * acquired by the caller.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ */
+
+static void
+RpcChannelHelpersStop(RpcChannelInt *chan)
+{
+   RpcChannel *idle[RPCCHANNEL_MAX_HELPERS];
+   guint numIdle;
+   guint i;
+
+   g_atomic_int_set(&chan->outType, RPCCHANNEL_TYPE_INACTIVE);
+
+   g_mutex_lock(&chan->helperLock);
+   numIdle = chan->numIdleHelpers;
+   memcpy(idle, chan->idleHelpers, numIdle * sizeof idle[0]);
+   chan->numIdleHelpers = 0;
+   chan->numHelpers -= numIdle;
+   chan->helperGen++;
+   g_cond_broadcast(&chan->helperCond);
+   g_mutex_unlock(&chan->helperLock);
+
+   for (i = 0; i < numIdle; i++) {
+      RpcChannel_Stop(idle[i]);
+      RpcChannel_Destroy(idle[i]);
+   }
+}
+
+
+/**
+ * Returns a helper connection taken with RpcChannelHelperGet. It is kept
+ * for the next concurrent sender if it still works and the channel has
+ * not been stopped in the meantime, and closed otherwise.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  helper      The helper channel.
+ * @param[in]  gen         Helper generation returned by RpcChannelHelperGet.
+ * @param[in]  keep        Whether the helper may be reused.
+ */
+
+static void
+RpcChannelHelperPut(RpcChannelInt *chan,
+                    RpcChannel *helper,
+                    guint gen,
+                    gboolean keep)
+{
+   keep = keep &&
+          helper->outStarted &&
+          helper->funcs->getType(helper) == g_atomic_int_get(&chan->outType);
+
+   g_mutex_lock(&chan->helperLock);
+   if (keep && gen == chan->helperGen) {
+      chan->idleHelpers[chan->numIdleHelpers++] = helper;
+      helper = NULL;
+   } else {
+      chan->numHelpers--;
+      g_cond_broadcast(&chan->helperCond);
+   }
+   g_mutex_unlock(&chan->helperLock);
+
+   if (helper != NULL) {
+      RpcChannel_Stop(helper);
+      RpcChannel_Destroy(helper);
+   }
+}
+
+
+/**
+ * Gets a connection for sending while the channel itself is busy. An idle
+ * helper is reused, or a new one opened if the channel has fewer than
+ * RPCCHANNEL_MAX_HELPERS. Helpers are only used with vsock channels, and
+ * must have the same privilege as the channel.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[out] gen         Helper generation, to pass to RpcChannelHelperPut.
+ *
+ * @return A started helper channel, NULL if none is available.
+ */
+
+static RpcChannel *
+RpcChannelHelperGet(RpcChannelInt *chan,
+                    guint *gen)
+{
+   RpcChannelType type = g_atomic_int_get(&chan->outType);
+   RpcChannel *helper = NULL;
+   gboolean create = FALSE;
+
+   if (type != RPCCHANNEL_TYPE_PRIV_VSOCK &&
+       type != RPCCHANNEL_TYPE_UNPRIV_VSOCK) {
+      return NULL;
+   }
+
+   g_mutex_lock(&chan->helperLock);
+   *gen = chan->helperGen;
+   if (chan->numIdleHelpers > 0) {
+      helper = chan->idleHelpers[--chan->numIdleHelpers];
+   } else if (chan->numHelpers < RPCCHANNEL_MAX_HELPERS) {
+      chan->numHelpers++;
+      create = TRUE;
+   }
+   g_mutex_unlock(&chan->helperLock);
+
+   if (create) {
+      helper = VSockChannel_New();
+      /* Not RpcChannel_Start: a helper must not fall back to the backdoor. */
+      if (!helper->funcs->start(helper) ||
+          helper->funcs->getType(helper) != type) {
+         Debug(LGPFX "Unable to open a helper connection.\n");
+         RpcChannelHelperPut(chan, helper, *gen, FALSE);
+         return NULL;
+      }
+   }
+   return helper;
+}
+
+
+/**
+ * Sends a message on a helper connection. Unlike RpcChannelSendInt, a
+ * failure is not retried by restarting the connection, since restarting
+ * may fall back to the backdoor and disable vsock for the whole process;
+ * the caller resends on the channel itself instead.
+ *
+ * @param[in]  helper      The helper channel.
+ * @param[in]  data        Data to send.
+ * @param[in]  dataLen     Number of bytes to send.
+ * @param[out] rpcStatus   Status from the remote end.
+ * @param[out] result      Response from other side.
+ * @param[out] resultLen   Number of bytes in response.
+ *
+ * @return TRUE if the message was delivered and a reply received.
+ */
+
+static gboolean
+RpcChannelHelperSend(RpcChannel *helper,
+                     char const *data,
+                     size_t dataLen,
+                     Bool *rpcStatus,
+                     char **result,
+                     size_t *resultLen)
+{
+   char *res = NULL;
+   size_t resLen = 0;
+   gboolean ok;
+
+   *rpcStatus = FALSE;
+
+   g_mutex_lock(&helper->outLock);
+   ok = helper->funcs->send(helper, data, dataLen, rpcStatus, &res, &resLen);
+   g_mutex_unlock(&helper->outLock);
+
+   if (!ok) {
+      free(res);
+      return FALSE;
+   }
+
+   if (result != NULL) {
+      *result = res;
+   } else {
+      free(res);
+   }
+   if (resultLen != NULL) {
+      *resultLen = resLen;
+   }
+   return TRUE;
+}
+
+#endif
+
+
 /**
  * Send function of an RPC channel struct. Retry once if it fails for
  * non-backdoor Channels. Backdoor channel already tries inside. A second try
- * may create a different type of channel.
+ * may create a different type of channel. Unlike RpcChannel_Send, tells a
+ * failure to talk to the other side apart from a failed RPC.
  *
  * @param[in]  chan        The RPC channel instance.
  * @param[in]  data        Data to send.
  * @param[in]  dataLen     Number of bytes to send.
+ * @param[out] rpcStatus   Status from the remote end.
  * @param[out] result      Response from other side (should be freed by
  *                         calling RpcChannel_Free).
  * @param[out] resultLen   Number of bytes in response.
  *
- * @return The status from the remote end (TRUE if call was successful).
+ * @return TRUE if the message was delivered and a reply received.
  */
 
-gboolean
-RpcChannel_Send(RpcChannel *chan,
-                char const *data,
-                size_t dataLen,
-                char **result,
-                size_t *resultLen)
+static gboolean
+RpcChannelSendInt(RpcChannel *chan,
+                  char const *data,
+                  size_t dataLen,
+                  Bool *rpcStatus,
+                  char **result,
+                  size_t *resultLen)
 {
    gboolean ok;
-   Bool rpcStatus;
    char *res = NULL;
    size_t resLen = 0;
    const RpcChannelFuncs *funcs;
@@ -971,7 +1515,38 @@ RpcChannel_Send(RpcChannel *chan,
 
    ASSERT(chan && chan->funcs);
 
+#if defined(NEED_RPCIN)
+   if (!g_mutex_trylock(&chan->outLock)) {
+      RpcChannelInt *cint = (RpcChannelInt *)chan;
+      gint64 waitStart;
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+      RpcChannel *helper;
+      guint gen;
+
+      helper = RpcChannelHelperGet(cint, &gen);
+      if (helper != NULL) {
+         ok = RpcChannelHelperSend(helper, data, dataLen, rpcStatus,
+                                   result, resultLen);
+         if (ok) {
+            g_atomic_int_inc(&cint->concurrentSends);
+         }
+         RpcChannelHelperPut(cint, helper, gen, ok);
+         if (ok) {
+            return TRUE;
+         }
+         Debug(LGPFX "Helper connection failed, sending on the channel.\n");
+      }
+#endif
+
+      waitStart = g_get_monotonic_time();
+      g_mutex_lock(&chan->outLock);
+      cint->contendedSends++;
+      cint->lockWaitUs += g_get_monotonic_time() - waitStart;
+   }
+   ((RpcChannelInt *)chan)->sends++;
+#else
    g_mutex_lock(&chan->outLock);
+#endif
 
    funcs = chan->funcs;
    ASSERT(funcs->send);
@@ -982,8 +1557,9 @@ RpcChannel_Send(RpcChannel *chan,
    if (resultLen != NULL) {
       *resultLen = 0;
    }
+   *rpcStatus = FALSE;
 
-   ok = funcs->send(chan, data, dataLen, &rpcStatus, &res, &resLen);
+   ok = funcs->send(chan, data, dataLen, rpcStatus, &res, &resLen);
 
    if (!ok && (funcs->getType(chan) != RPCCHANNEL_TYPE_BKDOOR) &&
        (funcs->stopRpcOut != NULL)) {
@@ -999,7 +1575,7 @@ RpcChannel_Send(RpcChannel *chan,
          /* The channel may get switched from vsocket to backdoor */
          funcs = chan->funcs;
          ASSERT(funcs->send);
-         ok = funcs->send(chan, data, dataLen, &rpcStatus, &res, &resLen);
+         ok = funcs->send(chan, data, dataLen, rpcStatus, &res, &resLen);
          goto done;
       }
 
@@ -1022,14 +1598,443 @@ done:
    }
 
 exit:
+#if defined(RPCCHANNEL_CONCURRENT_SEND)
+   g_atomic_int_set(&((RpcChannelInt *)chan)->outType,
+                    chan->outStarted ? chan->funcs->getType(chan) :
+                                       RPCCHANNEL_TYPE_INACTIVE);
+#endif
    g_mutex_unlock(&chan->outLock);
+   return ok;
+}
+
+
+/**
+ * Send function of an RPC channel struct. Retry once if it fails for
+ * non-backdoor Channels. Backdoor channel already tries inside. A second try
+ * may create a different type of channel.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  data        Data to send.
+ * @param[in]  dataLen     Number of bytes to send.
+ * @param[out] result      Response from other side (should be freed by
+ *                         calling RpcChannel_Free).
+ * @param[out] resultLen   Number of bytes in response.
+ *
+ * @return The status from the remote end (TRUE if call was successful).
+ */
+
+gboolean
+RpcChannel_Send(RpcChannel *chan,
+                char const *data,
+                size_t dataLen,
+                char **result,
+                size_t *resultLen)
+{
+   Bool rpcStatus;
+   gboolean ok;
+
+   ok = RpcChannelSendInt(chan, data, dataLen, &rpcStatus, result, resultLen);
    return ok && rpcStatus;
 }
 
 
+#if defined(NEED_RPCIN)
+
 /**
- * Open/close RpcChannel each time for sending a Rpc message, this is a wrapper
- * for RpcChannel APIs.
+ * Gets the counters of a channel, to tell how often senders had to wait
+ * for each other and how host commands reached the guest. Must be called
+ * from the thread running the channel.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[out] stats       The counters.
+ */
+
+void
+RpcChannel_GetStats(RpcChannel *chan,
+                    RpcChannelStats *stats)
+{
+   RpcChannelInt *cint = (RpcChannelInt *)chan;
+   RpcInStats inStats = { 0 };
+
+   if (chan->in != NULL) {
+      RpcIn_GetStats(chan->in, &inStats);
+   }
+   stats->inVSockCommands = inStats.vsockCommands;
+   stats->inBackdoorCommands = inStats.backdoorCommands;
+   stats->inBackdoorPolls = inStats.backdoorPolls;
+   stats->inBackdoorWaitMs = inStats.backdoorWaitMs;
+
+   g_mutex_lock(&chan->outLock);
+   stats->sends = cint->sends;
+   stats->contendedSends = cint->contendedSends;
+   stats->lockWaitUs = cint->lockWaitUs;
+   g_mutex_unlock(&chan->outLock);
+   stats->concurrentSends = g_atomic_int_get(&cint->concurrentSends);
+}
+
+
+/**
+ * Gets the counters of an RPC handler of a channel. Must be called from the
+ * thread running the channel.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  name        Name of the RPC.
+ * @param[out] stats       The counters.
+ *
+ * @return Whether the RPC was handled at least once.
+ */
+
+gboolean
+RpcChannel_GetHandlerStats(RpcChannel *chan,
+                           const char *name,
+                           RpcChannelHandlerStats *stats)
+{
+   RpcChannelInt *cint = (RpcChannelInt *)chan;
+   RpcChannelHandlerStats *found = NULL;
+
+   if (cint->handlerStats != NULL) {
+      found = g_hash_table_lookup(cint->handlerStats, name);
+   }
+   if (found == NULL) {
+      memset(stats, 0, sizeof *stats);
+      return FALSE;
+   }
+   *stats = *found;
+   return TRUE;
+}
+
+
+/**
+ * Sets the function used to run the handlers registered with
+ * RPCCHANNEL_FLAG_OFFLOAD on other threads. The reply to such an RPC is sent
+ * from the channel's main context once its handler returns. Without an
+ * offload function, all handlers run on the main context.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  func        The offload function, or NULL.
+ * @param[in]  data        Data for the offload function.
+ */
+
+void
+RpcChannel_SetOffloadFunc(RpcChannel *chan,
+                          RpcChannelOffloadFunc func,
+                          gpointer data)
+{
+   RpcChannelInt *cint = (RpcChannelInt *)chan;
+
+   cint->offloadFunc = func;
+   cint->offloadData = data;
+}
+
+#endif
+
+
+/**
+ * Stops and destroys a channel used for one-shot RPCs.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ */
+
+static void
+RpcChannelCloseOne(RpcChannel *chan)
+{
+   RpcChannel_Stop(chan);
+   RpcChannel_Destroy(chan);
+}
+
+
+static void RpcChannelPoolCheckFork(void);
+
+
+/**
+ * Closes all pooled channels. Registered with atexit() so the host side
+ * of the channels is released when the process exits. The reaper closes
+ * channels with gPoolLock dropped, so it is stopped and joined first.
+ */
+
+static void
+RpcChannelPoolDrain(void)
+{
+#if !defined(USE_RPCI_ONLY)
+   GThread *reaper;
+#endif
+   guint i;
+
+   g_mutex_lock(&gPoolLock);
+   RpcChannelPoolCheckFork();
+   gPoolDrained = TRUE;
+#if !defined(USE_RPCI_ONLY)
+   reaper = gPoolReaper;
+   gPoolReaper = NULL;
+   g_cond_signal(&gPoolCond);
+   g_mutex_unlock(&gPoolLock);
+
+   if (reaper != NULL) {
+      g_thread_join(reaper);
+   }
+   g_mutex_lock(&gPoolLock);
+#endif
+
+   for (i = 0; i < ARRAYSIZE(gPools); i++) {
+      while (gPools[i].count > 0) {
+         RpcChannelCloseOne(gPools[i].chans[--gPools[i].count]);
+      }
+   }
+   g_mutex_unlock(&gPoolLock);
+}
+
+
+/**
+ * Forgets the pooled channels if they were inherited from the parent
+ * process across a fork. They are still in use by the parent, so they
+ * must not be closed or used here. The caller must hold gPoolLock.
+ */
+
+static void
+RpcChannelPoolCheckFork(void)
+{
+#if !defined(_WIN32)
+   pid_t pid = getpid();
+
+   if (gPoolPid != pid) {
+      memset(gPools, 0, sizeof gPools);
+      gPoolPid = pid;
+#if !defined(USE_RPCI_ONLY)
+      /* Threads do not survive a fork. */
+      gPoolReaperRunning = FALSE;
+      gPoolReaper = NULL;
+#endif
+   }
+#endif
+}
+
+
+#if !defined(USE_RPCI_ONLY)
+/**
+ * Reaper thread: closes the pooled channels as they reach the idle
+ * timeout, so a process that goes quiet does not keep host channels open.
+ * Exits once the pools are empty or have been drained.
+ *
+ * @param[in]  data        Unused.
+ *
+ * @return NULL.
+ */
+
+static gpointer
+RpcChannelPoolReaper(gpointer data)
+{
+   g_mutex_lock(&gPoolLock);
+   for (;;) {
+      RpcChannel *expired[ARRAYSIZE(gPools) * RPCCHANNEL_POOL_MAX];
+      gint64 now = g_get_monotonic_time();
+      gint64 deadline = G_MAXINT64;
+      guint numExpired = 0;
+      guint remaining = 0;
+      guint i;
+
+      for (i = 0; i < ARRAYSIZE(gPools); i++) {
+         RpcChannelPool *pool = &gPools[i];
+         guint n = 0;
+
+         while (n < pool->count &&
+                now - pool->lastUse[n] >= RPCCHANNEL_POOL_IDLE_TIMEOUT) {
+            expired[numExpired++] = pool->chans[n++];
+         }
+         if (n > 0) {
+            pool->count -= n;
+            memmove(pool->chans, pool->chans + n,
+                    pool->count * sizeof pool->chans[0]);
+            memmove(pool->lastUse, pool->lastUse + n,
+                    pool->count * sizeof pool->lastUse[0]);
+         }
+         if (pool->count > 0) {
+            deadline = MIN(deadline,
+                           pool->lastUse[0] + RPCCHANNEL_POOL_IDLE_TIMEOUT);
+         }
+         remaining += pool->count;
+      }
+
+      if (numExpired > 0) {
+         g_mutex_unlock(&gPoolLock);
+         for (i = 0; i < numExpired; i++) {
+            Debug(LGPFX "Closing idle channel.\n");
+            RpcChannelCloseOne(expired[i]);
+         }
+         g_mutex_lock(&gPoolLock);
+         continue;
+      }
+      if (remaining == 0 || gPoolDrained) {
+         break;
+      }
+      g_cond_wait_until(&gPoolCond, &gPoolLock, deadline);
+   }
+   gPoolReaperRunning = FALSE;
+   g_mutex_unlock(&gPoolLock);
+
+   return NULL;
+}
+#endif
+
+
+/**
+ * Takes an idle channel from the pool. Channels that have been idle for
+ * longer than RPCCHANNEL_POOL_IDLE_TIMEOUT, or whose connection the host
+ * has closed, are closed instead of reused.
+ *
+ * @param[in]  priv        TRUE to get a privileged vsock channel.
+ *
+ * @return A started channel, NULL if the pool has none.
+ */
+
+static RpcChannel *
+RpcChannelPoolGet(gboolean priv)
+{
+   RpcChannelPool *pool = &gPools[priv ? 1 : 0];
+   RpcChannel *expired[RPCCHANNEL_POOL_MAX];
+   RpcChannel *chan = NULL;
+   guint numExpired = 0;
+   guint i;
+
+   g_mutex_lock(&gPoolLock);
+   RpcChannelPoolCheckFork();
+   if (pool->count > 0) {
+      /* The channels below the top one have been idle for longer. */
+      if (g_get_monotonic_time() - pool->lastUse[pool->count - 1] >
+          RPCCHANNEL_POOL_IDLE_TIMEOUT) {
+         while (pool->count > 0) {
+            expired[numExpired++] = pool->chans[--pool->count];
+         }
+      } else {
+         chan = pool->chans[--pool->count];
+      }
+   }
+   g_mutex_unlock(&gPoolLock);
+
+   for (i = 0; i < numExpired; i++) {
+      Debug(LGPFX "Closing idle channel.\n");
+      RpcChannelCloseOne(expired[i]);
+   }
+   if (chan != NULL && chan->funcs->isAlive != NULL &&
+       !chan->funcs->isAlive(chan)) {
+      Debug(LGPFX "Pooled channel closed by the host.\n");
+      RpcChannelCloseOne(chan);
+      chan = NULL;
+   }
+   return chan;
+}
+
+
+/**
+ * Returns a channel to the pool after a successful RPC.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  priv        TRUE if this is a privileged vsock channel.
+ *
+ * @return TRUE if the channel was pooled, FALSE if the caller should
+ *         close it.
+ */
+
+static gboolean
+RpcChannelPoolPut(RpcChannel *chan,
+                  gboolean priv)
+{
+   RpcChannelPool *pool = &gPools[priv ? 1 : 0];
+   gboolean pooled = FALSE;
+
+   /* A send may have moved the channel over to the backdoor. */
+   if (priv && RpcChannel_GetType(chan) != RPCCHANNEL_TYPE_PRIV_VSOCK) {
+      return FALSE;
+   }
+
+   g_mutex_lock(&gPoolLock);
+   RpcChannelPoolCheckFork();
+   if (!gPoolDrained && pool->count < RPCCHANNEL_POOL_MAX) {
+      if (!gPoolAtExit) {
+         atexit(RpcChannelPoolDrain);
+         gPoolAtExit = TRUE;
+      }
+      pool->lastUse[pool->count] = g_get_monotonic_time();
+      pool->chans[pool->count++] = chan;
+      pooled = TRUE;
+#if !defined(USE_RPCI_ONLY)
+      if (!gPoolReaperRunning) {
+         /* The previous reaper has released the lock for the last time. */
+         if (gPoolReaper != NULL) {
+            g_thread_join(gPoolReaper);
+         }
+         gPoolReaper = g_thread_try_new("rpcchannel-pool",
+                                        RpcChannelPoolReaper, NULL, NULL);
+
+         /* Without a reaper, idle channels are closed on the next use. */
+         if (gPoolReaper != NULL) {
+            gPoolReaperRunning = TRUE;
+         }
+      }
+#endif
+   }
+   g_mutex_unlock(&gPoolLock);
+
+   return pooled;
+}
+
+
+/**
+ * Creates and starts a channel for one-shot RPCs.
+ *
+ * @param[in]  priv        TRUE : create VSock channel for privileged guest RPC.
+                           FALSE: follow regular RPC channel creation process.
+ * @param[out] result      Error description on failure, should be freed by
+ *                         calling RpcChannel_Free.
+ * @param[out] resultLen   Error description length.
+ *
+ * @returns    The started channel, NULL on failure.
+ */
+
+static RpcChannel *
+RpcChannelOpenOne(gboolean priv,
+                  char **result,
+                  size_t *resultLen)
+{
+   RpcChannel *chan;
+   const char *err;
+
+#if (defined(__linux__) && !defined(USERWORLD)) || defined(_WIN32)
+   chan = priv ? VSockChannel_New() : RpcChannel_New();
+#else
+   chan = RpcChannel_New();
+#endif
+
+   if (chan == NULL) {
+      err = "RpcChannel: Unable to create the RpcChannel object";
+   } else if (!RpcChannel_Start(chan)) {
+      err = "RpcChannel: Unable to open the communication channel";
+   } else if (priv && RpcChannel_GetType(chan) != RPCCHANNEL_TYPE_PRIV_VSOCK) {
+      err = "Permission denied";
+   } else {
+      return chan;
+   }
+
+   if (result != NULL) {
+      *result = Util_SafeStrdup(err);
+      if (resultLen != NULL) {
+         *resultLen = strlen(*result);
+      }
+   }
+   if (chan != NULL) {
+      RpcChannelCloseOne(chan);
+   }
+   return NULL;
+}
+
+
+/**
+ * Sends a one-shot Rpc message, this is a wrapper for RpcChannel APIs.
+ * A channel left open by an earlier call is reused when available, and
+ * the channel is kept open for the next call when the message gets
+ * through. A reused channel is checked before the message is sent on it,
+ * and replaced with a new one if the host has closed it. The message is
+ * not sent again on a new channel after a failure, since it may already
+ * have reached the host.
  *
  * @param[in]  data        request data
  * @param[in]  dataLen     data length
@@ -1049,56 +2054,30 @@ RpcChannelSendOneRaw(const char *data,
                      gboolean priv)
 {
    RpcChannel *chan;
-   gboolean status = FALSE;
-
-#if (defined(__linux__) && !defined(USERWORLD)) || defined(_WIN32)
-   chan = priv ? VSockChannel_New() : RpcChannel_New();
-#else
-   chan = RpcChannel_New();
-#endif
+   Bool rpcStatus = FALSE;
+   gboolean ok = FALSE;
 
+   chan = RpcChannelPoolGet(priv);
    if (chan == NULL) {
-      if (result != NULL) {
-         *result = Util_SafeStrdup("RpcChannel: Unable to create "
-                                   "the RpcChannel object");
-         if (resultLen != NULL) {
-            *resultLen = strlen(*result);
-         }
+      chan = RpcChannelOpenOne(priv, result, resultLen);
+      if (chan == NULL) {
+         goto sent;
       }
-      goto sent;
-   } else if (!RpcChannel_Start(chan)) {
-      if (result != NULL) {
-         *result = Util_SafeStrdup("RpcChannel: Unable to open the "
-                                   "communication channel");
-         if (resultLen != NULL) {
-            *resultLen = strlen(*result);
-         }
-      }
-      goto sent;
-   } else if (priv && RpcChannel_GetType(chan) != RPCCHANNEL_TYPE_PRIV_VSOCK) {
-      if (result != NULL) {
-         *result = Util_SafeStrdup("Permission denied");
-         if (resultLen != NULL) {
-            *resultLen = strlen(*result);
-         }
-      }
-      goto sent;
-   } else if (!RpcChannel_Send(chan, data, dataLen, result, resultLen)) {
-      /* We already have the description of the error */
-      goto sent;
    }
 
-   status = TRUE;
+   ok = RpcChannelSendInt(chan, data, dataLen, &rpcStatus,
+                          result, resultLen);
+
+   if (!ok || !RpcChannelPoolPut(chan, priv)) {
+      RpcChannelCloseOne(chan);
+   }
 
 sent:
    Debug(LGPFX "Request %s: reqlen=%"FMTSZ"u, replyLen=%"FMTSZ"u\n",
-         status ? "OK" : "FAILED", dataLen, resultLen ? *resultLen : 0);
-   if (chan) {
-      RpcChannel_Stop(chan);
-      RpcChannel_Destroy(chan);
-   }
+         ok && rpcStatus ? "OK" : "FAILED", dataLen,
+         resultLen ? *resultLen : 0);
 
-   return status;
+   return ok && rpcStatus;
 }
 
 
@@ -53,6 +53,8 @@ typedef struct _RpcChannelFuncs{
    RpcChannelType (*getType)(RpcChannel *chan);
    void (*onStartErr)(RpcChannel *);
    gboolean (*stopRpcOut)(RpcChannel *);
+   /* Optional: FALSE if the connection is known to be closed. */
+   gboolean (*isAlive)(RpcChannel *);
 } RpcChannelFuncs;
 
 /**
@@ -27,6 +27,9 @@
 #if defined(__linux__)
 #include <arpa/inet.h>
 #endif
+#if !defined(_WIN32)
+#include <sys/poll.h>
+#endif
 
 #include "simpleSocket.h"
 #include "vmci_defs.h"
@@ -246,6 +249,53 @@ Socket_Send(SOCKET fd,      // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Socket_IsIdle --
+ *
+ *      Check, without blocking, that a connected socket has nothing to
+ *      read. Between requests the peer sends nothing, so a readable
+ *      socket has been closed or reset by the peer.
+ *
+ * Results:
+ *      TRUE if the socket is idle, FALSE if it is readable or on error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+gboolean
+Socket_IsIdle(SOCKET fd)      // IN
+{
+   int rv;
+#if defined(_WIN32)
+   fd_set readFds;
+   struct timeval timeout = { 0, 0 };
+
+   FD_ZERO(&readFds);
+   FD_SET(fd, &readFds);
+   rv = select(0, &readFds, NULL, NULL, &timeout);
+#else
+   struct pollfd pfd;
+
+   pfd.fd = fd;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+   do {
+      rv = poll(&pfd, 1, 0);
+   } while (rv == SOCKET_ERROR && SocketGetLastError() == SYSERR_EINTR);
+#endif
+
+   if (rv != 0) {
+      Debug(LGPFX "Socket %d is not idle: %d\n", fd, rv);
+   }
+   return rv == 0;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -90,5 +90,6 @@ gboolean Socket_RecvPacket(SOCKET sock,
 gboolean Socket_SendPacket(SOCKET sock,
                            const char *payload,
                            int payloadLen);
+gboolean Socket_IsIdle(SOCKET fd);
 
 #endif /* _SIMPLESOCKET_H_ */
@@ -540,6 +540,33 @@ VSockChannelStopRpcOut(RpcChannel *chan)
 
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelIsAlive --
+ *
+ *      Check that the host has not closed the RpcOut connection, without
+ *      sending anything on it.
+ *
+ * Result:
+ *      FALSE if the connection is closed or not started.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockChannelIsAlive(RpcChannel *chan)
+{
+   VSockChannel *vsock = chan->_private;
+
+   return chan->outStarted &&
+          vsock->out->fd != INVALID_SOCKET &&
+          Socket_IsIdle(vsock->out->fd);
+}
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -572,7 +599,8 @@ VSockChannel_New(void)
       VSockChannelShutdown,
       VSockChannelGetType,
       VSockChannelOnStartErr,
-      VSockChannelStopRpcOut
+      VSockChannelStopRpcOut,
+      VSockChannelIsAlive
    };
 
    chan = RpcChannel_Create();
@@ -104,6 +104,13 @@ typedef struct RpcInCallbackList {
 #if defined(VMTOOLS_USE_VSOCKET)
 
 #define RPCIN_HEARTBEAT_INTERVAL              1000             /* 1 second */
+/*
+ * Bounds of the interval between probes of the vsock connection while
+ * polling the backdoor, in System_GetTimeMonotonic() units (10ms). The
+ * interval doubles after each failed probe.
+ */
+#define RPCIN_VSOCK_RETRY_MIN_INTERVAL        (60 * 100)       /* 1 minute */
+#define RPCIN_VSOCK_RETRY_MAX_INTERVAL        (32 * 60 * 100)  /* 32 minutes */
 #define RPCIN_MIN_SEND_BUF_SIZE               (64 * 1024)
 #define RPCIN_MIN_RECV_BUF_SIZE               (64 * 1024)
 
@@ -146,8 +153,17 @@ struct RpcIn {
 #if defined(VMTOOLS_USE_VSOCKET)
    ConnInfo *conn;
    GSource *heartbeatSrc;
+   /* vsock connection being probed while polling the backdoor. */
+   ConnInfo *probe;
+   /* When to probe vsock again while polling the backdoor, 0 for never. */
+   uint64 nextVSockRetry;
+   uint64 vsockRetryInterval;
+   /* Whether a vsock connection has ever succeeded. */
+   Bool vsockWorked;
 #endif
 
+   RpcInStats stats;
+
    Message_Channel *channel;
    unsigned int delay;   /* The delay of the previous iteration of RpcInLoop */
    unsigned int maxDelay;  /* The maximum delay to schedule in RpcInLoop */
@@ -167,6 +183,14 @@ struct RpcIn {
    /* The size of the result */
    size_t last_resultLen;
 
+#if defined(VMTOOLS_USE_GLIB)
+   /*
+    * The dispatcher will provide the result later with RpcIn_CompleteReply.
+    * Until then nothing is received from the host.
+    */
+   Bool replyDeferred;
+#endif
+
    /*
     * It's possible for a callback dispatched by RpcInLoop to call RpcIn_stop.
     * When this happens, we corrupt the state of the RpcIn struct, resulting in
@@ -778,12 +802,17 @@ RpcInHeartbeatCallback(void *clientData)      // IN
 {
    RpcIn *in = (RpcIn *)clientData;
    ASSERT(in);
+   if (in->replyDeferred) {
+      /* The host is waiting for a reply; ping once it is sent. */
+      return TRUE;
+   }
    if (in->conn) {
       ASSERT(!in->mustSend);
       ASSERT(in->last_result == NULL);
       ASSERT(in->last_resultLen == 0);
 
       in->mustSend = TRUE;
+      in->stats.heartbeats++;
       if (RpcInSend(in, RPCIN_TCLO_PING)) {
          return TRUE;
       } else {
@@ -942,8 +971,14 @@ RpcInConnRecvedCb(void *buf,            // IN
 
       Debug("RpcIn: Got msg from conn %d: [%s]\n",
             AsyncSocket_GetFd(conn->asock), payload);
+      conn->in->stats.vsockCommands++;
 
       if (RpcInExecRpc(conn->in, payload, payloadLen, &errmsg)) {
+         if (conn->in->replyDeferred) {
+            /* RpcIn_CompleteReply sends the reply and receives again. */
+            free(payload);
+            return;
+         }
          conn->in->mustSend = TRUE;
          if (RpcInSend(conn->in, 0)) {
             if (conn->in->heartbeatSrc == NULL) {
@@ -1122,6 +1157,8 @@ RpcInConnectDone(AsyncSocket *asock,   // IN
    }
 
    conn->connected = TRUE;
+   in->vsockWorked = TRUE;
+   in->vsockRetryInterval = RPCIN_VSOCK_RETRY_MIN_INTERVAL;
    RpcInConnRecvHeader(conn);
    return;
 
@@ -1131,6 +1168,204 @@ exit:
    RpcInOpenChannel(in, TRUE);  /* fall back on backdoor */
 }
 
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInProbeFailed --
+ *
+ *      Drop the vsock connection being probed, if any, and schedule the
+ *      next probe after twice the previous interval.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInProbeFailed(RpcIn *in)   // IN
+{
+   if (in->probe != NULL) {
+      ConnInfo *conn = in->probe;
+
+      in->probe = NULL;
+      conn->in = NULL;
+      RpcInCloseConn(conn);
+   }
+
+   in->vsockRetryInterval = MIN(in->vsockRetryInterval * 2,
+                                RPCIN_VSOCK_RETRY_MAX_INTERVAL);
+   in->nextVSockRetry = System_GetTimeMonotonic() + in->vsockRetryInterval;
+   Debug("RpcIn: vsocket probe failed, next one in %u seconds.\n",
+         (unsigned int)(in->vsockRetryInterval / 100));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInProbeErrorHandler --
+ *
+ *      Error handler of the vsock connection being probed. The backdoor
+ *      channel is still open, so only the probe is dropped.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInProbeErrorHandler(int err,             // IN
+                       AsyncSocket *asock,  // IN
+                       void *clientData)    // IN
+{
+   ConnInfo *conn = (ConnInfo *)clientData;
+
+   Debug("RpcIn: Error in vsocket probe %d: %s.\n",
+         AsyncSocket_GetFd(asock), AsyncSocket_Err2String(err));
+   ASSERT(conn->in->probe == conn);
+   RpcInProbeFailed(conn->in);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInProbeDone --
+ *
+ *      Callback function for the AsyncSocket connect of a vsock probe. On
+ *      success the backdoor channel is closed and the probe becomes the
+ *      TCLO connection.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInProbeDone(AsyncSocket *asock,   // IN
+               void *clientData)     // IN
+{
+   ConnInfo *conn = (ConnInfo *)clientData;
+   RpcIn *in = conn->in;
+
+   ASSERT(in->probe == conn);
+
+   if (AsyncSocket_GetState(asock) != AsyncSocketConnected ||
+       !AsyncSocket_EstablishMinBufferSizes(asock, RPCIN_MIN_SEND_BUF_SIZE,
+                                            RPCIN_MIN_RECV_BUF_SIZE) ||
+       AsyncSocket_SetErrorFn(asock, RpcInConnErrorHandler,
+                              conn) != ASOCKERR_SUCCESS) {
+      RpcInProbeFailed(in);
+      return;
+   }
+
+   if (in->inLoop || in->replyDeferred) {
+      /* A command is in flight on the backdoor, probe again when idle. */
+      in->probe = NULL;
+      conn->in = NULL;
+      RpcInCloseConn(conn);
+      in->nextVSockRetry = System_GetTimeMonotonic();
+      return;
+   }
+
+   Debug("RpcIn: moving from the backdoor to vsocket connection %d.\n",
+         AsyncSocket_GetFd(asock));
+
+   if (in->nextEvent != NULL) {
+      g_source_destroy(in->nextEvent);
+      g_source_unref(in->nextEvent);
+      in->nextEvent = NULL;
+   }
+
+   ASSERT(in->channel);
+   if (in->mustSend) {
+      RpcInSend(in, 0);
+   }
+   if (Message_Close(in->channel) == FALSE) {
+      Debug("RpcIn: couldn't close channel\n");
+   }
+   in->channel = NULL;
+
+   in->probe = NULL;
+   in->nextVSockRetry = 0;
+   in->vsockRetryInterval = RPCIN_VSOCK_RETRY_MIN_INTERVAL;
+   in->conn = conn;
+   conn->connected = TRUE;
+   RpcInConnRecvHeader(conn);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInProbeVSock --
+ *
+ *      Start connecting to the vsock TCLO port while the backdoor channel
+ *      stays in use. RpcInProbeDone switches over once connected.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInProbeVSock(RpcIn *in)   // IN
+{
+   AsyncSocket *asock;
+   int res;
+
+   ASSERT(in->probe == NULL);
+
+   in->stats.vsockRetries++;
+   in->nextVSockRetry = 0;
+
+   in->probe = calloc(1, sizeof *(in->probe));
+   if (in->probe == NULL) {
+      RpcInProbeFailed(in);
+      return;
+   }
+   in->probe->in = in;
+
+   asock = AsyncSocket_ConnectVMCI(VMCI_HYPERVISOR_CONTEXT_ID,
+                                   GUESTRPC_TCLO_VSOCK_LISTEN_PORT,
+                                   RpcInProbeDone,
+                                   in->probe, 0, NULL, &res);
+   if (asock == NULL) {
+      Debug("RpcIn: Error in creating vsocket probe: %s\n",
+            AsyncSocket_Err2String(res));
+      free(in->probe);
+      in->probe = NULL;
+      RpcInProbeFailed(in);
+      return;
+   }
+
+   in->probe->asock = asock;
+   res = AsyncSocket_SetErrorFn(asock, RpcInProbeErrorHandler, in->probe);
+   if (res != ASOCKERR_SUCCESS) {
+      RpcInProbeFailed(in);
+      return;
+   }
+
+   Debug("RpcIn: probing vsocket connection %d.\n", AsyncSocket_GetFd(asock));
+}
+
 #endif  /* VMTOOLS_USE_VSOCKET */
 
 
@@ -1211,6 +1446,10 @@ static void
 RpcInStop(RpcIn *in) // IN
 {
    ASSERT(in);
+#if defined(VMTOOLS_USE_GLIB)
+   /* A pending reply is dropped, the host resets the channel anyway. */
+   in->replyDeferred = FALSE;
+#endif
    if (in->nextEvent) {
       /* The loop is started. Stop it */
 #if defined(VMTOOLS_USE_GLIB)
@@ -1250,6 +1489,15 @@ RpcInStop(RpcIn *in) // IN
       RpcInCloseConn(in->conn);
    }
 
+   if (in->probe != NULL) {
+      ConnInfo *probe = in->probe;
+
+      in->probe = NULL;
+      probe->in = NULL;
+      RpcInCloseConn(probe);
+   }
+   in->nextVSockRetry = 0;
+
    if (in->heartbeatSrc != NULL) {
       g_source_destroy(in->heartbeatSrc);
       g_source_unref(in->heartbeatSrc);
@@ -1286,6 +1534,71 @@ RpcIn_stop(RpcIn *in) // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcIn_GetStats --
+ *
+ *      Get the counters of the RPC channel. Must be called from the thread
+ *      that runs the channel.
+ *
+ * Results:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RpcIn_GetStats(RpcIn *in,            // IN
+               RpcInStats *stats)    // OUT
+{
+   ASSERT(in);
+   *stats = in->stats;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInSetResult --
+ *
+ *      Build the reply to the last TCLO request from the status and result
+ *      of its handler.
+ *
+ * Result:
+ *      TRUE on success, FALSE if out of memory.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+RpcInSetResult(RpcIn *in,            // IN
+               Bool status,          // IN
+               const char *result,   // IN
+               size_t resultLen)     // IN
+{
+   const char *statusStr = status ? "OK " : "ERROR ";
+   unsigned int statusLen = strlen(statusStr);
+
+   ASSERT(in->last_result == NULL);
+   in->last_result = (char *)malloc(statusLen + resultLen);
+   if (in->last_result == NULL) {
+      return FALSE;
+   }
+   memcpy(in->last_result, statusStr, statusLen);
+   memcpy(in->last_result + statusLen, result, resultLen);
+   in->last_resultLen = statusLen + resultLen;
+
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1309,8 +1622,6 @@ RpcInExecRpc(RpcIn *in,            // IN
              const char **errmsg)  // OUT
 {
    unsigned int status;
-   const char *statusStr;
-   unsigned int statusLen;
    char *result;
    size_t resultLen;
    Bool freeResult = FALSE;
@@ -1355,17 +1666,18 @@ RpcInExecRpc(RpcIn *in,            // IN
    }
 #endif
 
-   statusStr = status ? "OK " : "ERROR ";
-   statusLen = strlen(statusStr);
+#if defined(VMTOOLS_USE_GLIB)
+   if (in->replyDeferred) {
+      ASSERT(!freeResult);
+      in->delay = 0;
+      return TRUE;
+   }
+#endif
 
-   in->last_result = (char *)malloc(statusLen + resultLen);
-   if (in->last_result == NULL) {
+   if (!RpcInSetResult(in, status, result, resultLen)) {
       *errmsg = "RpcIn: Not enough memory";
       return FALSE;
    }
-   memcpy(in->last_result, statusStr, statusLen);
-   memcpy(in->last_result + statusLen, result, resultLen);
-   in->last_resultLen = statusLen + resultLen;
 
    if (freeResult) {
       free(result);
@@ -1549,6 +1861,7 @@ RpcInLoop(void *clientData) // IN
    char const *reply;
    size_t repLen;
    Bool resched = FALSE;
+   unsigned int pollDelay;
 
 #if defined(VMTOOLS_USE_GLIB)
    unsigned int current;
@@ -1571,6 +1884,8 @@ RpcInLoop(void *clientData) // IN
 #endif
 
    in->inLoop = TRUE;
+   pollDelay = in->delay;
+   in->stats.backdoorPolls++;
 
    /*
     * Workaround for bug 780404. Remove if we ever figure out the root cause.
@@ -1604,9 +1919,24 @@ RpcInLoop(void *clientData) // IN
          RpcInClearErrorStatus(in);
       }
 
+      in->stats.backdoorCommands++;
+      in->stats.backdoorWaitMs += pollDelay * 10;
       if (!RpcInExecRpc(in, reply, repLen, &errmsg)) {
          goto error;
       }
+
+#if defined(VMTOOLS_USE_GLIB)
+      if (in->replyDeferred) {
+         /*
+          * Stop polling until the reply is ready; RpcIn_CompleteReply
+          * schedules the loop again.
+          */
+         g_source_unref(in->nextEvent);
+         in->nextEvent = NULL;
+         resched = TRUE;
+         goto exit;
+      }
+#endif
    } else {
       static uint64 lastPrintMilli = 0;
       uint64 now = System_GetTimeMonotonic() * 10;
@@ -1633,6 +1963,17 @@ RpcInLoop(void *clientData) // IN
       ASSERT(in->last_resultLen == 0);
 
       RpcInUpdateDelayTime(in);
+
+#if defined(VMTOOLS_USE_VSOCKET)
+      /*
+       * Nothing is pending on the backdoor, see whether the event driven
+       * vsock connection is back. The backdoor stays open meanwhile.
+       */
+      if (in->nextVSockRetry != 0 && in->probe == NULL &&
+          System_GetTimeMonotonic() >= in->nextVSockRetry) {
+         RpcInProbeVSock(in);
+      }
+#endif
    }
 
    ASSERT(in->mustSend == FALSE);
@@ -1790,6 +2131,13 @@ RpcInOpenChannel(RpcIn *in,                 // IN
       in->conn = NULL;
    }
 
+   /*
+    * Polling the backdoor is the fallback. Probe vsock again later, unless
+    * it never worked in this guest.
+    */
+   in->nextVSockRetry = in->vsockWorked ?
+                        System_GetTimeMonotonic() + in->vsockRetryInterval :
+                        0;
 #endif
 
    ASSERT(in->channel == NULL);
@@ -1876,6 +2224,103 @@ RpcIn_start(RpcIn *in,                                // IN
 }
 
 
+#if defined(VMTOOLS_USE_GLIB)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcIn_DeferReply --
+ *
+ *      Called by the dispatch callback to send the reply to the current
+ *      request later, with RpcIn_CompleteReply. The result set by the
+ *      callback is ignored, and no request is received from the host until
+ *      the reply is sent.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RpcIn_DeferReply(RpcIn *in) // IN
+{
+   ASSERT(in);
+   ASSERT(!in->replyDeferred);
+   in->replyDeferred = TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcIn_CompleteReply --
+ *
+ *      Send the reply deferred with RpcIn_DeferReply, and resume receiving
+ *      requests from the host. Must be called from the thread running the
+ *      channel's main context.
+ *
+ * Results:
+ *      TRUE if the reply was sent or queued, FALSE if the channel was
+ *      stopped meanwhile or failed.
+ *
+ * Side effects:
+ *      Closes the channel on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+RpcIn_CompleteReply(RpcIn *in,            // IN
+                    Bool status,          // IN
+                    const char *result,   // IN
+                    size_t resultLen)     // IN
+{
+   const char *errmsg;
+
+   ASSERT(in);
+   if (!in->replyDeferred) {
+      return FALSE;
+   }
+   in->replyDeferred = FALSE;
+
+   if (!RpcInSetResult(in, status, result, resultLen)) {
+      errmsg = "RpcIn: Not enough memory";
+      goto error;
+   }
+   in->mustSend = TRUE;
+
+#if defined(VMTOOLS_USE_VSOCKET)
+   if (in->conn != NULL) {
+      if (!RpcInSend(in, 0)) {
+         RpcInCloseChannel(in, "RpcIn: Unable to send");
+         return FALSE;
+      }
+      if (in->heartbeatSrc == NULL) {
+         RpcInRegisterHeartbeatCallback(in);
+      }
+      RpcInConnRecvHeader(in->conn);
+      return TRUE;
+   }
+#endif
+
+   /* The next iteration of RpcInLoop sends the reply. */
+   in->delay = 0;
+   if (RpcInScheduleRecvEvent(in)) {
+      return TRUE;
+   }
+   errmsg = "RpcIn: Unable to run the loop";
+
+error:
+   (*in->errorFunc)(in->errorData, errmsg);
+   RpcInStop(in);
+   return FALSE;
+}
+#endif
+
+
 #if !defined(VMTOOLS_USE_GLIB)
 /*
  *-----------------------------------------------------------------------------
@@ -208,21 +208,14 @@ RpcOut_start(RpcOut *out) // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * RpcOut_send --
- *
- *    Make VMware synchroneously execute a TCLO command
+ * RpcOutSendInt --
  *
- *    Unlike the other send varieties, RpcOut_send requires that the
- *    caller pass non-NULL reply and repLen arguments.
+ *    Make VMware synchroneously execute a TCLO command, receiving the
+ *    result into replyBuf if one is given, or else into the reception
+ *    buffer of the channel.
  *
  * Result
- *    TRUE if RPC was sent successfully. 'reply' contains the result of the rpc.
- *    rpcStatus tells if the RPC command was processed successfully.
- *
- *    FALSE if RPC could not be sent successfully. 'reply' will contain a
- *    description of the error.
- *
- *    In both cases, the caller should not free the reply.
+ *    See RpcOut_send.
  *
  * Side-effects
  *    None
@@ -230,17 +223,20 @@ RpcOut_start(RpcOut *out) // IN
  *-----------------------------------------------------------------------------
  */
 
-Bool
-RpcOut_send(RpcOut *out,         // IN
-            char const *request, // IN
-            size_t reqLen,       // IN
-            Bool *rpcStatus,     // OUT
-            char const **reply,  // OUT
-            size_t *repLen)      // OUT
+static Bool
+RpcOutSendInt(RpcOut *out,         // IN
+              char const *request, // IN
+              size_t reqLen,       // IN
+              char *replyBuf,      // IN/OUT: optional
+              size_t replyBufSize, // IN
+              Bool *rpcStatus,     // OUT
+              char const **reply,  // OUT
+              size_t *repLen)      // OUT
 {
    unsigned char *myReply;
    size_t myRepLen;
    Bool success;
+   Bool received;
 
    ASSERT(out != NULL);
    ASSERT(out->started);
@@ -252,7 +248,14 @@ RpcOut_send(RpcOut *out,         // IN
       return FALSE;
    }
 
-   if (Message_Receive(&out->channel, &myReply, &myRepLen) == FALSE) {
+   if (replyBuf != NULL) {
+      myReply = (unsigned char *)replyBuf;
+      received = Message_ReceiveBuffer(&out->channel, myReply, replyBufSize,
+                                       &myRepLen);
+   } else {
+      received = Message_Receive(&out->channel, &myReply, &myRepLen);
+   }
+   if (received == FALSE) {
       *reply = "RpcOut: Unable to receive the result of the RPCI command";
       *repLen = strlen(*reply);
 
@@ -276,6 +279,82 @@ RpcOut_send(RpcOut *out,         // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcOut_send --
+ *
+ *    Make VMware synchroneously execute a TCLO command
+ *
+ *    Unlike the other send varieties, RpcOut_send requires that the
+ *    caller pass non-NULL reply and repLen arguments.
+ *
+ * Result
+ *    TRUE if RPC was sent successfully. 'reply' contains the result of the rpc.
+ *    rpcStatus tells if the RPC command was processed successfully.
+ *
+ *    FALSE if RPC could not be sent successfully. 'reply' will contain a
+ *    description of the error.
+ *
+ *    In both cases, the caller should not free the reply.
+ *
+ * Side-effects
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+RpcOut_send(RpcOut *out,         // IN
+            char const *request, // IN
+            size_t reqLen,       // IN
+            Bool *rpcStatus,     // OUT
+            char const **reply,  // OUT
+            size_t *repLen)      // OUT
+{
+   return RpcOutSendInt(out, request, reqLen, NULL, 0,
+                        rpcStatus, reply, repLen);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcOut_sendBuffer --
+ *
+ *    Make VMware synchroneously execute a TCLO command, receiving the
+ *    result directly into the caller's buffer. The buffer must have room
+ *    for the 2 bytes of status, the result and a trailing NUL. It may be
+ *    the buffer holding the request.
+ *
+ * Result
+ *    As RpcOut_send. On success 'reply' points into replyBuf, 2 bytes
+ *    past its start. On failure, the contents of replyBuf are undefined
+ *    if the request was sent.
+ *
+ * Side-effects
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+RpcOut_sendBuffer(RpcOut *out,         // IN
+                  char const *request, // IN
+                  size_t reqLen,       // IN
+                  char *replyBuf,      // OUT
+                  size_t replyBufSize, // IN
+                  Bool *rpcStatus,     // OUT
+                  char const **reply,  // OUT
+                  size_t *repLen)      // OUT
+{
+   ASSERT(replyBuf != NULL);
+
+   return RpcOutSendInt(out, request, reqLen, replyBuf, replyBufSize,
+                        rpcStatus, reply, repLen);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
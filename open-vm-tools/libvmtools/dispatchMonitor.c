@@ -0,0 +1,244 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file dispatchMonitor.c
+ *
+ * Reports the callbacks dispatched by a main loop to a monitor installed by
+ * the application, so it can tell which of them keep the loop busy. Sources
+ * whose callback is set with VMTools_SetSourceCallback() are reported, as is
+ * code bracketed with VMTools_DispatchBegin() and VMTools_DispatchEnd().
+ */
+
+#include "vmware.h"
+#include "vmware/tools/utils.h"
+
+/** Callback data of a monitored source. */
+typedef struct MonitoredCallback {
+   gint           refCount;
+   GSourceFunc    func;
+   gpointer       data;
+   GDestroyNotify destroy;
+   const gchar   *name;
+   gboolean       armed;
+   gpointer       token;
+} MonitoredCallback;
+
+static VMToolsDispatchMonitor *gMonitor = NULL;
+
+
+/*
+ *******************************************************************************
+ * MonitoredCallbackRef --                                                */ /**
+ *
+ * Adds a reference to the callback data. GLib does this right before getting
+ * the callback to dispatch it, so this also arms the callback for timing.
+ *
+ * @param[in]  cbData  The callback data.
+ *
+ *******************************************************************************
+ */
+
+static void
+MonitoredCallbackRef(gpointer cbData)
+{
+   MonitoredCallback *cb = cbData;
+
+   g_atomic_int_inc(&cb->refCount);
+   cb->armed = TRUE;
+}
+
+
+/*
+ *******************************************************************************
+ * MonitoredCallbackUnref --                                              */ /**
+ *
+ * Drops a reference to the callback data. GLib does this right after the
+ * callback returns, which ends the dispatch reported to the monitor.
+ *
+ * @param[in]  cbData  The callback data.
+ *
+ *******************************************************************************
+ */
+
+static void
+MonitoredCallbackUnref(gpointer cbData)
+{
+   MonitoredCallback *cb = cbData;
+
+   if (cb->token != NULL) {
+      VMTools_DispatchEnd(cb->token);
+      cb->token = NULL;
+   }
+   cb->armed = FALSE;
+
+   if (g_atomic_int_dec_and_test(&cb->refCount)) {
+      if (cb->destroy != NULL) {
+         cb->destroy(cb->data);
+      }
+      g_free(cb);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * MonitoredCallbackGet --                                                */ /**
+ *
+ * Returns the source's callback. When called to dispatch the source, starts
+ * the dispatch reported to the monitor.
+ *
+ * @param[in]  cbData  The callback data.
+ * @param[in]  src     The source.
+ * @param[out] func    Where to store the callback.
+ * @param[out] data    Where to store the callback's data.
+ *
+ *******************************************************************************
+ */
+
+static void
+MonitoredCallbackGet(gpointer cbData,
+                     GSource *src,
+                     GSourceFunc *func,
+                     gpointer *data)
+{
+   MonitoredCallback *cb = cbData;
+
+   /* GLib also gets the callback when looking up sources by data. */
+   if (cb->armed) {
+      cb->armed = FALSE;
+      cb->token = VMTools_DispatchBegin(cb->name);
+   }
+
+   *func = cb->func;
+   *data = cb->data;
+}
+
+
+/**
+ *
+ * @addtogroup vmtools_utils
+ * @{
+ */
+
+/*
+ *******************************************************************************
+ * VMTools_SetDispatchMonitor --                                          */ /**
+ *
+ * @brief Installs the monitor that callback dispatches are reported to.
+ *
+ * Should be called before the main loop runs. Passing NULL removes the
+ * current monitor.
+ *
+ * @param[in] monitor   The monitor, or NULL.
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_SetDispatchMonitor(VMToolsDispatchMonitor *monitor)
+{
+   g_atomic_pointer_set(&gMonitor, monitor);
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_DispatchBegin --                                               */ /**
+ *
+ * @brief Reports to the monitor that a callback starts running.
+ *
+ * @param[in] name   Name of the callback.
+ *
+ * @return Token to pass to VMTools_DispatchEnd(), may be NULL.
+ *
+ *******************************************************************************
+ */
+
+gpointer
+VMTools_DispatchBegin(const gchar *name)
+{
+   VMToolsDispatchMonitor *monitor = g_atomic_pointer_get(&gMonitor);
+
+   return monitor != NULL ? monitor->begin(name, monitor->data) : NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_DispatchEnd --                                                 */ /**
+ *
+ * @brief Reports to the monitor that a callback has returned.
+ *
+ * @param[in] token  Token returned by VMTools_DispatchBegin().
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_DispatchEnd(gpointer token)
+{
+   VMToolsDispatchMonitor *monitor = g_atomic_pointer_get(&gMonitor);
+
+   if (token != NULL && monitor != NULL) {
+      monitor->end(token, monitor->data);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_SetSourceCallback --                                           */ /**
+ *
+ * @brief Sets the callback of a source, reporting its dispatches to the
+ * monitor.
+ *
+ * Works like g_source_set_callback(), for any kind of source.
+ *
+ * @param[in] src       The source.
+ * @param[in] func      The callback.
+ * @param[in] data      Data for the callback.
+ * @param[in] destroy   Called to free the data when the source is freed.
+ * @param[in] name      Name of the callback; must outlive the source.
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_SetSourceCallback(GSource *src,
+                          GSourceFunc func,
+                          gpointer data,
+                          GDestroyNotify destroy,
+                          const gchar *name)
+{
+   static GSourceCallbackFuncs cbFuncs = {
+      MonitoredCallbackRef,
+      MonitoredCallbackUnref,
+      MonitoredCallbackGet
+   };
+   MonitoredCallback *cb = g_malloc0(sizeof *cb);
+
+   cb->refCount = 1;
+   cb->func = func;
+   cb->data = data;
+   cb->destroy = destroy;
+   cb->name = name;
+   g_source_set_callback_indirect(src, cb, &cbFuncs);
+}
+
+/** @}  */
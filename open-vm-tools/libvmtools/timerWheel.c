@@ -0,0 +1,414 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file timerWheel.c
+ *
+ * Periodic timers that fire on the ticks of a process-wide wheel, so timers
+ * which can tolerate some delay wake the process up together instead of
+ * each on its own.
+ *
+ * A timer that becomes due is moved to the first tick within its slack that
+ * another timer already waits for. If there is none, it takes the tick in
+ * its slack that is a multiple of the largest power of two, which is where
+ * timers scheduled later are most likely to land too. Ticks are counted on
+ * the monotonic clock, so separate processes line up on the same ticks. A
+ * timer whose slack holds no tick fires at the end of its slack, and drifts
+ * that way every period until it reaches a tick.
+ */
+
+#include <limits.h>
+#include "vmware.h"
+#include "vmware/tools/utils.h"
+
+#define WHEEL_DEFAULT_TICK          1000
+#define WHEEL_DEFAULT_SLACK_PCT     10
+/** Ticks searched for a timer to join. */
+#define WHEEL_MAX_SCAN              256
+
+typedef struct WheelTimer {
+   GSource     src;
+   guint       interval;   /* ms */
+   guint       slack;      /* ms, or VMTOOLS_TIMER_DEFAULT_SLACK */
+   gint64      fireTime;   /* monotonic, us */
+   gint64      tick;       /* wheel tick the timer waits for, or -1 */
+} WheelTimer;
+
+/** State of the wheel, protected by gWheelLock. */
+static GMutex gWheelLock;
+static guint gTick = WHEEL_DEFAULT_TICK;
+static guint gSlackPct = WHEEL_DEFAULT_SLACK_PCT;
+static GHashTable *gTicks = NULL;   /* tick -> number of timers */
+static VMToolsTimerWheelStats gStats;
+static gint64 gLastDispatch = 0;
+
+
+/*
+ *******************************************************************************
+ * WheelUnlink --                                                         */ /**
+ *
+ * Removes a timer from the tick it waits for. Must be called with the wheel
+ * lock held.
+ *
+ * @param[in]  timer    The timer.
+ *
+ *******************************************************************************
+ */
+
+static void
+WheelUnlink(WheelTimer *timer)
+{
+   guint count;
+
+   if (timer->tick < 0) {
+      return;
+   }
+
+   count = GPOINTER_TO_UINT(g_hash_table_lookup(gTicks, &timer->tick));
+   ASSERT(count > 0);
+   if (count > 1) {
+      gint64 *key = g_new(gint64, 1);
+
+      *key = timer->tick;
+      g_hash_table_replace(gTicks, key, GUINT_TO_POINTER(count - 1));
+   } else {
+      g_hash_table_remove(gTicks, &timer->tick);
+   }
+   timer->tick = -1;
+}
+
+
+/*
+ *******************************************************************************
+ * WheelPickTick --                                                       */ /**
+ *
+ * Picks the tick a timer should wait for among the given ones. Must be called
+ * with the wheel lock held.
+ *
+ * @param[in]  lo    First acceptable tick.
+ * @param[in]  hi    Last acceptable tick.
+ *
+ * @return The tick.
+ *
+ *******************************************************************************
+ */
+
+static gint64
+WheelPickTick(gint64 lo,
+              gint64 hi)
+{
+   gint64 t;
+   guint shift = 63;
+
+   for (t = lo; t <= hi && t - lo < WHEEL_MAX_SCAN; t++) {
+      if (g_hash_table_lookup(gTicks, &t) != NULL) {
+         return t;
+      }
+   }
+
+   while (--shift > 0) {
+      t = (hi >> shift) << shift;
+      if (t >= lo) {
+         return t;
+      }
+   }
+   return hi;
+}
+
+
+/*
+ *******************************************************************************
+ * WheelSchedule --                                                       */ /**
+ *
+ * Schedules the next firing of a timer.
+ *
+ * @param[in]  timer       The timer.
+ * @param[in]  deadline    Earliest time the timer may fire, monotonic, in us.
+ *
+ *******************************************************************************
+ */
+
+static void
+WheelSchedule(WheelTimer *timer,
+              gint64 deadline)
+{
+   gint64 slackUs;
+
+   g_mutex_lock(&gWheelLock);
+
+   if (timer->slack == VMTOOLS_TIMER_DEFAULT_SLACK) {
+      slackUs = (gint64) timer->interval * gSlackPct * 10;
+   } else {
+      slackUs = (gint64) timer->slack * 1000;
+   }
+
+   WheelUnlink(timer);
+   timer->fireTime = deadline;
+
+   if (gTick > 0 && slackUs > 0) {
+      gint64 tickUs = (gint64) gTick * 1000;
+      gint64 lo = (deadline + tickUs - 1) / tickUs;
+      gint64 hi = (deadline + slackUs) / tickUs;
+
+      if (lo <= hi) {
+         gint64 *key = g_new(gint64, 1);
+         guint count;
+
+         timer->tick = WheelPickTick(lo, hi);
+         timer->fireTime = timer->tick * tickUs;
+         count = GPOINTER_TO_UINT(g_hash_table_lookup(gTicks, &timer->tick));
+         *key = timer->tick;
+         g_hash_table_replace(gTicks, key, GUINT_TO_POINTER(count + 1));
+      } else {
+         timer->fireTime = deadline + slackUs;
+      }
+   }
+
+   g_mutex_unlock(&gWheelLock);
+}
+
+
+/*
+ *******************************************************************************
+ * WheelTimerPrepare --                                                   */ /**
+ *
+ * Callback for the "prepare()" event source function. Sets the timeout to
+ * the number of milliseconds until the timer's tick.
+ *
+ * @param[in]  src         The source.
+ * @param[out] timeout     Where to store the timeout.
+ *
+ * @return TRUE if the timer is due.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+WheelTimerPrepare(GSource *src,
+                  gint *timeout)
+{
+   WheelTimer *timer = (WheelTimer *) src;
+   gint64 now = g_source_get_time(src);
+
+   if (now >= timer->fireTime) {
+      *timeout = 0;
+      return TRUE;
+   }
+
+   /* Round up, so the poll does not return right before the tick. */
+   *timeout = (gint) MIN(INT_MAX, (timer->fireTime - now + 999) / 1000);
+   return FALSE;
+}
+
+
+/*
+ *******************************************************************************
+ * WheelTimerCheck --                                                     */ /**
+ *
+ * Checks whether the timer is due.
+ *
+ * @param[in]  src     The source.
+ *
+ * @return Whether the timer is due.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+WheelTimerCheck(GSource *src)
+{
+   WheelTimer *timer = (WheelTimer *) src;
+
+   return g_source_get_time(src) >= timer->fireTime;
+}
+
+
+/*
+ *******************************************************************************
+ * WheelTimerDispatch --                                                  */ /**
+ *
+ * Calls the callback associated with the timer, if any, and schedules the
+ * next firing if the timer is kept.
+ *
+ * @param[in]  src         The source.
+ * @param[in]  callback    The callback to be called.
+ * @param[in]  data        User-supplied data.
+ *
+ * @return The return value of the callback, or FALSE if the callback is NULL.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+WheelTimerDispatch(GSource *src,
+                   GSourceFunc callback,
+                   gpointer data)
+{
+   WheelTimer *timer = (WheelTimer *) src;
+   gint64 now = g_source_get_time(src);
+   gboolean ret;
+
+   g_mutex_lock(&gWheelLock);
+   gStats.fires++;
+   /* The time is cached per main loop iteration. */
+   if (now != gLastDispatch) {
+      gStats.wakeups++;
+      gLastDispatch = now;
+   }
+   g_mutex_unlock(&gWheelLock);
+
+   ret = (callback != NULL) ? callback(data) : FALSE;
+   if (ret) {
+      /* Periodic from the tick, so the timer stays on the wheel's ticks. */
+      WheelSchedule(timer, MAX(timer->fireTime + (gint64) timer->interval * 1000,
+                               now));
+   }
+   return ret;
+}
+
+
+/*
+ *******************************************************************************
+ * WheelTimerFinalize --                                                  */ /**
+ *
+ * Removes the timer from the wheel.
+ *
+ * @param[in]  src     The source.
+ *
+ *******************************************************************************
+ */
+
+static void
+WheelTimerFinalize(GSource *src)
+{
+   WheelTimer *timer = (WheelTimer *) src;
+
+   g_mutex_lock(&gWheelLock);
+   WheelUnlink(timer);
+   gStats.timers--;
+   g_mutex_unlock(&gWheelLock);
+}
+
+
+/**
+ *
+ * @addtogroup vmtools_utils
+ * @{
+ */
+
+/*
+ *******************************************************************************
+ * VMTools_CreateCoalescedTimer --                                        */ /**
+ *
+ * @brief Creates a periodic timer that may fire late, so it can share
+ * wakeups with other timers.
+ *
+ * The timer fires at most @a slack milliseconds after each period, on a tick
+ * of the wheel that other timers fire on if possible. Like the timer from
+ * VMTools_CreateTimer(), it uses a monotonic clock. The next period starts
+ * when the timer fires, not when its callback returns.
+ *
+ * @param[in] interval  Period of the timer, in milliseconds.
+ * @param[in] slack     How late the timer may fire, in milliseconds, or
+ *                      VMTOOLS_TIMER_DEFAULT_SLACK for the wheel's default,
+ *                      which is a share of the period.
+ *
+ * @return The new source.
+ *
+ *******************************************************************************
+ */
+
+GSource *
+VMTools_CreateCoalescedTimer(guint interval,
+                             guint slack)
+{
+   static GSourceFuncs srcFuncs = {
+      WheelTimerPrepare,
+      WheelTimerCheck,
+      WheelTimerDispatch,
+      WheelTimerFinalize,
+      NULL,
+      NULL
+   };
+   WheelTimer *timer;
+
+   timer = (WheelTimer *) g_source_new(&srcFuncs, sizeof *timer);
+   timer->interval = interval;
+   timer->slack = slack;
+   timer->tick = -1;
+
+   g_mutex_lock(&gWheelLock);
+   if (gTicks == NULL) {
+      gTicks = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+   }
+   gStats.timers++;
+   g_mutex_unlock(&gWheelLock);
+
+   WheelSchedule(timer, g_get_monotonic_time() + (gint64) interval * 1000);
+   return &timer->src;
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_ConfigureTimerWheel --                                         */ /**
+ *
+ * @brief Configures the wheel of the timers created with
+ * VMTools_CreateCoalescedTimer().
+ *
+ * Timers already scheduled keep their current tick until they fire next.
+ *
+ * @param[in] tick      Interval between the wheel's ticks, in milliseconds.
+ *                      0 disables coalescing: timers fire when due.
+ * @param[in] slackPct  Default slack of the timers, in percent of their
+ *                      period.
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_ConfigureTimerWheel(guint tick,
+                            guint slackPct)
+{
+   g_mutex_lock(&gWheelLock);
+   gTick = tick;
+   gSlackPct = MIN(slackPct, 100);
+   g_mutex_unlock(&gWheelLock);
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_GetTimerWheelStats --                                          */ /**
+ *
+ * @brief Gets the counters of the timer wheel.
+ *
+ * @param[out] stats    The counters.
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_GetTimerWheelStats(VMToolsTimerWheelStats *stats)
+{
+   g_mutex_lock(&gWheelLock);
+   *stats = gStats;
+   g_mutex_unlock(&gWheelLock);
+}
+
+/** @}  */
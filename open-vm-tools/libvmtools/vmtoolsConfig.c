@@ -249,6 +249,130 @@ exit:
 }
 
 
+/**
+ * Adds the keys of a config group whose value differs in the other config
+ * dictionary, or is missing from it, to a set.
+ *
+ * @param[in]  config   Config dictionary to read the keys from.
+ * @param[in]  other    Config dictionary to compare with, may be NULL.
+ * @param[in]  group    The group.
+ * @param[in]  changed  Set of changed keys.
+ */
+
+static void
+VMToolsConfigDiffGroup(GKeyFile *config,
+                       GKeyFile *other,
+                       const gchar *group,
+                       GHashTable *changed)
+{
+   gchar **keys = g_key_file_get_keys(config, group, NULL, NULL);
+   guint i;
+
+   for (i = 0; keys != NULL && keys[i] != NULL; i++) {
+      gchar *value;
+      gchar *otherValue = NULL;
+
+      if (g_hash_table_contains(changed, keys[i])) {
+         continue;
+      }
+
+      value = g_key_file_get_value(config, group, keys[i], NULL);
+      if (other != NULL) {
+         otherValue = g_key_file_get_value(other, group, keys[i], NULL);
+      }
+      if (g_strcmp0(value, otherValue) != 0) {
+         g_hash_table_add(changed, g_strdup(keys[i]));
+      }
+      g_free(otherValue);
+      g_free(value);
+   }
+   g_strfreev(keys);
+}
+
+
+/**
+ * Compares two config dictionaries, so that a reload only needs to act on
+ * what changed.
+ *
+ * @param[in]  oldConfig   The previous config dictionary, may be NULL.
+ * @param[in]  newConfig   The new config dictionary.
+ *
+ * @return NULL if the dictionaries hold the same values, otherwise a table
+ *         mapping each group with changes to a sorted, NULL-terminated array
+ *         of the keys that were added, removed or modified. Free with
+ *         g_hash_table_destroy().
+ */
+
+GHashTable *
+VMTools_ConfigDiff(GKeyFile *oldConfig,
+                   GKeyFile *newConfig)
+{
+   GHashTable *diff = NULL;
+   GHashTable *groups;
+   GHashTableIter iter;
+   gpointer group;
+   gchar **names;
+   guint i;
+
+   ASSERT(newConfig != NULL);
+
+   /* Union of the groups of both dictionaries. */
+   groups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+   names = g_key_file_get_groups(newConfig, NULL);
+   for (i = 0; names[i] != NULL; i++) {
+      g_hash_table_insert(groups, names[i], names[i]);
+   }
+   g_free(names);
+   if (oldConfig != NULL) {
+      names = g_key_file_get_groups(oldConfig, NULL);
+      for (i = 0; names[i] != NULL; i++) {
+         if (g_hash_table_lookup(groups, names[i]) == NULL) {
+            g_hash_table_insert(groups, names[i], names[i]);
+         } else {
+            g_free(names[i]);
+         }
+      }
+      g_free(names);
+   }
+
+   g_hash_table_iter_init(&iter, groups);
+   while (g_hash_table_iter_next(&iter, &group, NULL)) {
+      GHashTable *changed;
+      GList *keys;
+      GList *l;
+      gchar **sorted;
+
+      /* A set of key names, each a copy owned by the table. */
+      changed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+      VMToolsConfigDiffGroup(newConfig, oldConfig, group, changed);
+      if (oldConfig != NULL) {
+         VMToolsConfigDiffGroup(oldConfig, newConfig, group, changed);
+      }
+
+      if (g_hash_table_size(changed) > 0) {
+         keys = g_list_sort(g_hash_table_get_keys(changed),
+                            (GCompareFunc) strcmp);
+         sorted = g_new(gchar *, g_hash_table_size(changed) + 1);
+         for (i = 0, l = keys; l != NULL; l = l->next, i++) {
+            sorted[i] = g_strdup(l->data);
+         }
+         sorted[i] = NULL;
+         g_list_free(keys);
+
+         if (diff == NULL) {
+            diff = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) g_strfreev);
+         }
+         g_hash_table_insert(diff, g_strdup(group), sorted);
+      }
+      g_hash_table_destroy(changed);
+   }
+
+   g_hash_table_destroy(groups);
+   return diff;
+}
+
+
 /**
  * Loads boolean value for a key from the specified config section.
  *
@@ -52,6 +52,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       NULL
    };
 
+   /* Keep libdeployPkgPlugin.manifest in sync with these registrations. */
    RpcChannelCallback rpcs[] = {
       { "deployPkg.begin", DeployPkg_TcloBegin, NULL, NULL, NULL, 0 },
       { "deployPkg.deploy", DeployPkg_TcloDeploy, NULL, NULL, NULL, 0 }
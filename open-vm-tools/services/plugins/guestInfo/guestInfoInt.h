@@ -88,6 +88,10 @@ GuestInfo_GetDiskInfo(const ToolsAppCtx *ctx);
 void
 GuestInfo_FreeDiskInfo(GuestDiskInfoInt *di);
 
+void
+GuestInfo_StatProviderConfigure(ToolsAppCtx *ctx,
+                                gint statsInterval);
+
 void
 GuestInfo_StatProviderShutdown(void);
 
@@ -123,6 +123,26 @@ typedef struct _GuestInfoCache {
    Bool                         diskInfoUseJson;
 } GuestInfoCache;
 
+/*
+ * Whether the host takes batched key/value updates. Probed once per
+ * channel reset.
+ */
+typedef enum GuestInfoBatchSupport {
+   GUESTINFO_BATCH_UNKNOWN,
+   GUESTINFO_BATCH_SUPPORTED,
+   GUESTINFO_BATCH_UNSUPPORTED
+} GuestInfoBatchSupport;
+
+/*
+ * Key/value updates collected during a gather and sent together by
+ * GuestInfoFlushBatch.
+ */
+typedef struct _GuestInfoBatch {
+   Bool   active;
+   /* New values of the keys that changed, NULL for the others. */
+   char  *value[INFO_MAX];
+} GuestInfoBatch;
+
 
 /**
  * Defines the current poll interval (in milliseconds).
@@ -162,6 +182,11 @@ static GSource *gatherStatsTimeoutSource = NULL;
 /* Local cache of the guest information that was last sent to vmx. */
 static GuestInfoCache gInfoCache;
 
+/* Key/value updates of the current gather, if batching. */
+static GuestInfoBatch gInfoBatch;
+
+static GuestInfoBatchSupport gBatchSupport = GUESTINFO_BATCH_UNKNOWN;
+
 /*
  * A boolean flag that specifies whether the state of the VM was
  * changed since the last time guest info was sent to the VMX.
@@ -184,6 +209,8 @@ static Bool SetGuestInfo(ToolsAppCtx *ctx,
                          GuestInfoType key,
                          const char *value);
 static void SendUptime(ToolsAppCtx *ctx);
+static void GuestInfoBeginBatch(ToolsAppCtx *ctx);
+static void GuestInfoFlushBatch(ToolsAppCtx *ctx);
 static Bool DiskInfoChanged(const GuestDiskInfoInt *diskInfo);
 static void GuestInfoClearCache(void);
 static GuestNicList *NicInfoV3ToV2(const NicInfoV3 *infoV3);
@@ -548,6 +575,9 @@ GuestInfoGather(gpointer data)
 
    GuestInfoCheckIfRunningSlow(ctx);
 
+   /* Collect the key/value updates below into a single RPC. */
+   GuestInfoBeginBatch(ctx);
+
    /* Send tools version. */
    if (!GuestInfoUpdateVMX(ctx, INFO_BUILD_NUMBER, BUILD_NUMBER, 0)) {
       /*
@@ -789,6 +819,8 @@ GuestInfoGather(gpointer data)
    /* Send the uptime to the VMX so that it can detect soft resets. */
    SendUptime(ctx);
 
+   GuestInfoFlushBatch(ctx);
+
    return TRUE;
 }
 
@@ -1561,6 +1593,13 @@ GuestInfoUpdateVMX(ToolsAppCtx *ctx,        // IN: Application context
          break;
       }
 
+      if (gInfoBatch.active) {
+         /* Sent, and cached, by GuestInfoFlushBatch. */
+         free(gInfoBatch.value[infoType]);
+         gInfoBatch.value[infoType] = Util_SafeStrdup((char *) info);
+         break;
+      }
+
       if (!SetGuestInfo(ctx, infoType, (char *)info)) {
          g_warning("Failed to update key/value pair for type %d.\n", infoType);
          return FALSE;
@@ -1712,6 +1751,147 @@ SetGuestInfo(ToolsAppCtx *ctx,   // IN:
 }
 
 
+/*
+ ******************************************************************************
+ * GuestInfoBatchSupported --
+ *
+ * Checks whether the VMX takes batched key/value updates. The answer is
+ * cached until the next channel reset.
+ *
+ * @param[in] ctx       Application context.
+ *
+ * @retval TRUE  The VMX understands GUEST_INFO_BATCH_COMMAND.
+ * @retval FALSE Key/value pairs must be sent one by one.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoBatchSupported(ToolsAppCtx *ctx)  // IN:
+{
+   if (gBatchSupport == GUESTINFO_BATCH_UNKNOWN) {
+      char *reply = NULL;
+      size_t replyLen;
+
+      if (RpcChannel_Send(ctx->rpc, GUEST_INFO_BATCH_CAPABILITY,
+                          strlen(GUEST_INFO_BATCH_CAPABILITY) + 1,
+                          &reply, &replyLen) &&
+          reply != NULL && atoi(reply) >= 1) {
+         gBatchSupport = GUESTINFO_BATCH_SUPPORTED;
+      } else {
+         gBatchSupport = GUESTINFO_BATCH_UNSUPPORTED;
+      }
+      vm_free(reply);
+
+      g_debug("Batched guest info updates %ssupported.\n",
+              gBatchSupport == GUESTINFO_BATCH_SUPPORTED ? "" : "not ");
+   }
+
+   return gBatchSupport == GUESTINFO_BATCH_SUPPORTED;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoBeginBatch --
+ *
+ * Starts collecting key/value updates instead of sending them, if the VMX
+ * takes them batched. GuestInfoFlushBatch sends what was collected.
+ *
+ * @param[in] ctx       Application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoBeginBatch(ToolsAppCtx *ctx)  // IN:
+{
+   ASSERT(!gInfoBatch.active);
+   gInfoBatch.active = GuestInfoBatchSupported(ctx);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoFlushBatch --
+ *
+ * Sends the key/value updates collected since GuestInfoBeginBatch, in a
+ * single RPC when there are several of them. If the VMX rejects the batch,
+ * batching is turned off until the next reset and the pairs are sent one
+ * by one.
+ *
+ * @param[in] ctx       Application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoFlushBatch(ToolsAppCtx *ctx)  // IN:
+{
+   GuestInfoType key;
+   guint count = 0;
+   Bool sent = FALSE;
+
+   if (!gInfoBatch.active) {
+      return;
+   }
+   gInfoBatch.active = FALSE;
+
+   for (key = 0; key < INFO_MAX; key++) {
+      if (gInfoBatch.value[key] != NULL) {
+         count++;
+      }
+   }
+
+   if (count > 1) {
+      GString *msg = g_string_new(GUEST_INFO_BATCH_COMMAND);
+      char *reply = NULL;
+      size_t replyLen;
+
+      for (key = 0; key < INFO_MAX; key++) {
+         const char *value = gInfoBatch.value[key];
+
+         if (value != NULL) {
+            g_string_append_printf(msg, " %d %"FMTSZ"u %s",
+                                   key, strlen(value), value);
+         }
+      }
+
+      sent = RpcChannel_Send(ctx->rpc, msg->str, msg->len + 1,
+                             &reply, &replyLen) &&
+             reply != NULL && *reply == '\0';
+      if (sent) {
+         g_debug("Sent %u guest info updates in one message.\n", count);
+      } else {
+         g_warning("Batched guest info update failed: %s, sending the "
+                   "updates one by one.\n", reply ? reply : "NULL");
+         gBatchSupport = GUESTINFO_BATCH_UNSUPPORTED;
+      }
+      vm_free(reply);
+      g_string_free(msg, TRUE);
+   }
+
+   for (key = 0; key < INFO_MAX; key++) {
+      char *value = gInfoBatch.value[key];
+
+      if (value == NULL) {
+         continue;
+      }
+      gInfoBatch.value[key] = NULL;
+
+      if (!sent && !SetGuestInfo(ctx, key, value)) {
+         g_warning("Failed to update key/value pair for type %d.\n", key);
+         free(value);
+         continue;
+      }
+
+      /* Update the value in the cache as well. */
+      free(gInfoCache.value[key]);
+      gInfoCache.value[key] = value;
+   }
+}
+
+
 /*
  ******************************************************************************
  * GuestInfoFindMacAddress --
@@ -1992,7 +2172,8 @@ TweakGatherLoop(ToolsAppCtx *ctx,
    if (*currInterval) {
       g_info("New value for %s is %us.\n", cfgKey, *currInterval / 1000);
 
-      *timeoutSource = g_timeout_source_new(*currInterval);
+      *timeoutSource = VMTools_CreateCoalescedTimer(*currInterval,
+                                                    VMTOOLS_TIMER_DEFAULT_SLACK);
       VMTOOLSAPP_ATTACH_SOURCE(ctx, *timeoutSource, callback, ctx, NULL);
       g_source_unref(*timeoutSource);
    } else {
@@ -2041,6 +2222,9 @@ TweakGatherLoops(ToolsAppCtx *ctx,
                       GuestInfo_StatProviderPoll,
                       &guestInfoStatsInterval,
                       &gatherStatsTimeoutSource);
+#if defined(__linux__)
+      GuestInfo_StatProviderConfigure(ctx, guestInfoStatsInterval);
+#endif
    } else {
       /*
        * Destroy the existing timeout source, if it exists.
@@ -2051,6 +2235,9 @@ TweakGatherLoops(ToolsAppCtx *ctx,
 
          g_info("PerfMon gather loop disabled.\n");
       }
+#if defined(__linux__)
+      GuestInfo_StatProviderConfigure(ctx, 0);
+#endif
    }
 #endif
 
@@ -2101,21 +2288,24 @@ GuestInfo_ServerReportStats(ToolsAppCtx *ctx,  // IN
 
 /*
  ******************************************************************************
- * GuestInfoServerConfReload --
+ * GuestInfoServerConfChanged --
  *
- * @brief Reconfigures the poll loop interval upon config file reload.
+ * @brief Reconfigures the poll loop interval when the guestinfo config group
+ * changes on config file reload.
  *
  * @param[in]  src     The source object.
  * @param[in]  ctx     The application context.
+ * @param[in]  keys    Keys of the group that changed.
  * @param[in]  data    Unused.
  *
  ******************************************************************************
  */
 
 static void
-GuestInfoServerConfReload(gpointer src,
-                          ToolsAppCtx *ctx,
-                          gpointer data)
+GuestInfoServerConfChanged(gpointer src,
+                           ToolsAppCtx *ctx,
+                           const gchar * const *keys,
+                           gpointer data)
 {
    TweakGatherLoops(ctx, TRUE);
 }
@@ -2214,6 +2404,9 @@ GuestInfoServerReset(gpointer src,
 
    /* Reset detailed guest OS data sending */
    gSendDetailedGosData = TRUE;
+
+   /* The host may have changed, probe batching again. */
+   gBatchSupport = GUESTINFO_BATCH_UNKNOWN;
 }
 
 
@@ -2334,7 +2527,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, GuestInfoServerSendCaps, NULL },
-         { TOOLS_CORE_SIG_CONF_RELOAD, GuestInfoServerConfReload, NULL },
+         { TOOLS_CORE_SIG_CONF_CHANGED "::" CONFGROUPNAME_GUESTINFO,
+           GuestInfoServerConfChanged, NULL },
          { TOOLS_CORE_SIG_IO_FREEZE, GuestInfoServerIOFreeze, NULL },
          { TOOLS_CORE_SIG_RESET, GuestInfoServerReset, NULL },
          { TOOLS_CORE_SIG_SET_OPTION, GuestInfoServerSetOption, NULL },
@@ -18,15 +18,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <string.h>
+#include <time.h>
 
 #include "vm_basic_defs.h"
 #include "vmware.h"
 #include "str.h"
-#include "strutil.h"
 #include "debug.h"
 #include "guestInfoInt.h"
 #include "guestStats.h"
@@ -36,17 +38,34 @@
 
 #define GUEST_INFO_PREALLOC_SIZE 4096
 #define INT_AS_HASHKEY(x) ((const void *)(uintptr_t)(x))
-#define KEY_FORMAT  "%s|%s"
 
-#define STAT_FILE        "/proc/stat"
-#define VMSTAT_FILE      "/proc/vmstat"
-#define UPTIME_FILE      "/proc/uptime"
-#define MEMINFO_FILE     "/proc/meminfo"
-#define ZONEINFO_FILE    "/proc/zoneinfo"
-#define SWAPPINESS_FILE  "/proc/sys/vm/swappiness"
-#define DISKSTATS_FILE   "/proc/diskstats"
+/*
+ * Where /proc and /sys are found. Only changed by benchmarks, which run
+ * against a made up tree.
+ */
+#ifndef GUESTINFO_PROC_ROOT
+#define GUESTINFO_PROC_ROOT ""
+#endif
+
+#define STAT_FILE        GUESTINFO_PROC_ROOT "/proc/stat"
+#define VMSTAT_FILE      GUESTINFO_PROC_ROOT "/proc/vmstat"
+#define UPTIME_FILE      GUESTINFO_PROC_ROOT "/proc/uptime"
+#define MEMINFO_FILE     GUESTINFO_PROC_ROOT "/proc/meminfo"
+#define ZONEINFO_FILE    GUESTINFO_PROC_ROOT "/proc/zoneinfo"
+#define SWAPPINESS_FILE  GUESTINFO_PROC_ROOT "/proc/sys/vm/swappiness"
+#define DISKSTATS_FILE   GUESTINFO_PROC_ROOT "/proc/diskstats"
+#define LOADAVG_FILE     GUESTINFO_PROC_ROOT "/proc/loadavg"
+#define PSI_MEMORY_FILE  GUESTINFO_PROC_ROOT "/proc/pressure/memory"
 
-#define SYSFS_BLOCK_FOLDER  "/sys/block"
+#define SYSFS_BLOCK_FOLDER  GUESTINFO_PROC_ROOT "/sys/block"
+
+/* Initial size of the buffer the stat files are read into. */
+#define PROC_BUF_INITIAL_SIZE  (16 * 1024)
+
+/* High resolution sampling limits. */
+#define HIGHRES_MIN_INTERVAL       10      // ms
+#define HIGHRES_MAX_SAMPLES        8192
+#define HIGHRES_DEFAULT_BUDGET     50      // hundredths of a percent
 
 /*
  * For now, all data collection is of uint64 values. Rates are always returned
@@ -55,6 +74,7 @@
 
 static Bool gReleased = TRUE;
 static Bool gInternal = FALSE;
+static Bool gHighRes = FALSE;   // Set while high resolution sampling runs
 #if PUBLISH_EXPERIMENTAL_STATS
 static Bool gExperimental = PUBLISH_EXPERIMENTAL_STATS;
 #endif
@@ -134,6 +154,19 @@ GuestInfoQuery guestInfoQuerySpecTable[] = {
    DECLARE_STAT(&gReleased,  STAT_FILE,       FALSE, "procs_running",   GuestStatID_Linux_CpuRunQueue,         GuestUnitsNumber,          GuestTypeUint64),
    DECLARE_STAT(&gReleased,  NULL,            FALSE, NULL,              GuestStatID_Linux_DiskRequestQueue,    GuestUnitsNumber,          GuestTypeUint64),
    DECLARE_STAT(&gReleased,  NULL,            FALSE, NULL,              GuestStatID_Linux_DiskRequestQueueAvg, GuestUnitsNumber,          GuestTypeDouble),
+
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_CpuRunQueueMin,      GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_CpuRunQueueP50,      GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_CpuRunQueueP95,      GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_CpuRunQueueMax,      GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_DiskRequestQueueMin, GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_DiskRequestQueueP50, GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_DiskRequestQueueP95, GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_DiskRequestQueueMax, GuestUnitsNumber,          GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_MemPressureMin,      GuestUnitsPercent,         GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_MemPressureP50,      GuestUnitsPercent,         GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_MemPressureP95,      GuestUnitsPercent,         GuestTypeUint64),
+   DECLARE_STAT(&gHighRes,   NULL,            FALSE, NULL,              GuestStatID_Linux_MemPressureMax,      GuestUnitsPercent,         GuestTypeUint64),
 };
 
 #define N_QUERIES (sizeof guestInfoQuerySpecTable / sizeof(GuestInfoQuery))
@@ -146,11 +179,6 @@ typedef struct {
 } GuestInfoStat;
 
 typedef struct {
-   HashTable       *exactMatches;
-
-   uint32           numRegExps;
-   GuestInfoStat  **regExps;
-
    uint32           numStats;
    GuestInfoStat   *stats;
 
@@ -163,6 +191,64 @@ typedef struct {
 static GuestInfoCollector *gCurrentCollector = NULL;
 static GuestInfoCollector *gPreviousCollector = NULL;
 
+/*
+ * A field of a stat file that feeds a query. The index is the same for the
+ * query in guestInfoQuerySpecTable and its stat in every collector.
+ */
+typedef struct {
+   const char      *name;
+   size_t           nameLen;
+   uint32           index;
+} GuestInfoField;
+
+/*
+ * A stat file. It is kept open between samples and read from its start, and
+ * the fields of the queries it feeds are mapped once, so a sample costs no
+ * open, no allocation and no hashing.
+ */
+typedef struct {
+   const char      *pathName;
+   char             fieldSeparator;  // '\0' if unspecified
+   int              fd;              // -1 if not open
+
+   uint32           numFields;       // Exact matches, sorted by name
+   GuestInfoField  *fields;
+
+   uint32           numPrefixes;     // Regular expressions (prefixes)
+   GuestInfoField  *prefixes;
+} GuestInfoProcFile;
+
+typedef enum {
+   PROC_MEMINFO,
+   PROC_VMSTAT,
+   PROC_STAT,
+   PROC_ZONEINFO,
+   PROC_UPTIME,
+   PROC_SWAPPINESS,
+   PROC_DISKSTATS,
+   PROC_LOADAVG,
+   PROC_PSI_MEMORY,
+   PROC_MAX
+} GuestInfoProcFileID;
+
+static GuestInfoProcFile gProcFiles[PROC_MAX] = {
+   { MEMINFO_FILE,    ':',  -1 },
+   { VMSTAT_FILE,     '\0', -1 },
+   { STAT_FILE,       '\0', -1 },
+   { ZONEINFO_FILE,   '\0', -1 },
+   { UPTIME_FILE,     '\0', -1 },
+   { SWAPPINESS_FILE, '\0', -1 },
+   { DISKSTATS_FILE,  '\0', -1 },
+   { LOADAVG_FILE,    '\0', -1 },
+   { PSI_MEMORY_FILE, '\0', -1 },
+};
+
+static Bool gProcFieldsMapped = FALSE;
+
+/* Buffer the stat files are read into, grown as needed and kept. */
+static char *gProcBuf = NULL;
+static size_t gProcBufSize = 0;
+
 static void
 GuestInfoDeriveMemNeeded(GuestInfoCollector *collector);
 
@@ -174,6 +260,55 @@ typedef struct GuestInfoDiskStatsList {
 
 static GuestInfoDiskStatsList *gDiskStatsList = NULL;
 
+/*
+ * High resolution sampling: a few counters are sampled between two polls,
+ * and each poll reports a summary of their samples.
+ */
+typedef enum {
+   HIGHRES_RUN_QUEUE,
+   HIGHRES_DISK_QUEUE,
+   HIGHRES_MEM_PRESSURE,
+   HIGHRES_MAX
+} GuestInfoHighResCounter;
+
+/* Samples of a counter; the oldest are overwritten when it is full. */
+typedef struct {
+   uint64          *values;
+   uint32           count;
+   uint32           next;
+} GuestInfoRing;
+
+typedef struct {
+   ToolsAppCtx     *ctx;
+   GSource         *timer;
+   uint32           configured;    // Interval from the config, ms
+   uint32           interval;      // Interval in use, ms
+   uint32           budget;        // Hundredths of a percent of one CPU
+   uint32           capacity;      // Samples per ring
+   GuestInfoRing    rings[HIGHRES_MAX];
+   uint64          *scratch;       // Room to sort one ring
+   uint64           cpuNs;         // CPU time spent sampling since the poll
+   int64            since;         // Time of the poll, us
+   Bool             psiAvailable;
+   Bool             psiValid;
+   uint64           psiTotal;      // Time some task stalled on memory, us
+   int64            psiTime;       // When psiTotal was read, us
+} GuestInfoHighRes;
+
+static GuestInfoHighRes gHighResState;
+
+/* Summaries reported for each counter: minimum, median, p95, maximum. */
+static const GuestStatToolsID gHighResIDs[HIGHRES_MAX][4] = {
+   { GuestStatID_Linux_CpuRunQueueMin, GuestStatID_Linux_CpuRunQueueP50,
+     GuestStatID_Linux_CpuRunQueueP95, GuestStatID_Linux_CpuRunQueueMax },
+   { GuestStatID_Linux_DiskRequestQueueMin,
+     GuestStatID_Linux_DiskRequestQueueP50,
+     GuestStatID_Linux_DiskRequestQueueP95,
+     GuestStatID_Linux_DiskRequestQueueMax },
+   { GuestStatID_Linux_MemPressureMin, GuestStatID_Linux_MemPressureP50,
+     GuestStatID_Linux_MemPressureP95, GuestStatID_Linux_MemPressureMax },
+};
+
 
 /*
  *----------------------------------------------------------------------
@@ -236,13 +371,83 @@ GuestInfoIsBlockDevice(const char *name)  // IN:
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoGetUpTime --
+ * GuestInfoProcRead --
  *
- *      What time is it?
+ *      Reads the whole contents of a stat file into the shared buffer.
+ *      The file is opened on first use and kept open; /proc files are
+ *      regenerated when read from their start, so reading with pread
+ *      at offset 0 gives a fresh snapshot each time.
  *
  * Results:
- *      TRUE   Success! *now is populated
- *      FALSE  Failure! *now remains unchanged
+ *      The NUL terminated contents, valid until the next read of any
+ *      stat file, or NULL on failure.
+ *
+ * Side effects:
+ *      May grow the shared buffer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+GuestInfoProcRead(GuestInfoProcFile *file,  // IN/OUT:
+                  size_t *len)              // OUT/OPT: length of contents
+{
+   size_t size = 0;
+
+   if (file->fd < 0) {
+      file->fd = Posix_Open(file->pathName, O_RDONLY | O_CLOEXEC);
+      if (file->fd < 0) {
+         g_warning("%s: Error opening %s.\n", __FUNCTION__, file->pathName);
+         return NULL;
+      }
+   }
+
+   for (;;) {
+      ssize_t n;
+
+      /* Keep room for the NUL terminator. */
+      if (gProcBufSize - size < 2) {
+         gProcBufSize = MAX(gProcBufSize * 2, PROC_BUF_INITIAL_SIZE);
+         gProcBuf = Util_SafeRealloc(gProcBuf, gProcBufSize);
+      }
+
+      n = pread(file->fd, gProcBuf + size, gProcBufSize - size - 1, size);
+      if (n == 0) {
+         break;
+      }
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         g_warning("%s: Error reading %s: %d.\n", __FUNCTION__,
+                   file->pathName, errno);
+
+         /* Reopen next time, in case the file went away. */
+         close(file->fd);
+         file->fd = -1;
+         return NULL;
+      }
+      size += n;
+   }
+
+   gProcBuf[size] = '\0';
+   if (len != NULL) {
+      *len = size;
+   }
+
+   return gProcBuf;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoFieldCompare --
+ *
+ *      Orders stat file fields by name, for qsort and bsearch.
+ *
+ * Results:
+ *      Negative, zero or positive, like strcmp.
  *
  * Side effects:
  *      None.
@@ -250,28 +455,143 @@ GuestInfoIsBlockDevice(const char *name)  // IN:
  *----------------------------------------------------------------------
  */
 
-static Bool
-GuestInfoGetUpTime(double *now)  // OUT:
+static int
+GuestInfoFieldCompare(const void *a,  // IN:
+                      const void *b)  // IN:
 {
-   char line[512];
-   Bool result = FALSE;
-   FILE *fp = Posix_Fopen(UPTIME_FILE, "r");
+   const GuestInfoField *fa = a;
+   const GuestInfoField *fb = b;
+   int res = memcmp(fa->name, fb->name, MIN(fa->nameLen, fb->nameLen));
 
-   if (fp == NULL) {
-      return result;
+   if (res != 0) {
+      return res;
    }
 
-   if (fgets(line, sizeof line, fp) == line) {
-      double idle;
+   return (fa->nameLen > fb->nameLen) - (fa->nameLen < fb->nameLen);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoMapProcFields --
+ *
+ *      Builds the field map of each stat file from the queries.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoMapProcFields(GuestInfoQuery *queries,  // IN:
+                       uint32 numQueries)        // IN:
+{
+   uint32 i;
+   uint32 j;
+
+   for (j = 0; j < PROC_MAX; j++) {
+      GuestInfoProcFile *file = &gProcFiles[j];
+
+      file->fields = Util_SafeCalloc(numQueries, sizeof *file->fields);
+      file->prefixes = Util_SafeCalloc(numQueries, sizeof *file->prefixes);
+
+      for (i = 0; i < numQueries; i++) {
+         GuestInfoQuery *query = &queries[i];
+         GuestInfoField *field;
+
+         if (query->sourceFile == NULL || query->locatorString == NULL ||
+             strcmp(query->sourceFile, file->pathName) != 0) {
+            continue;
+         }
 
-      if (sscanf(line, "%lf %lf", now, &idle) == 2) {
-         result = TRUE;
+         field = query->isRegExp ? &file->prefixes[file->numPrefixes++]
+                                 : &file->fields[file->numFields++];
+         field->name = query->locatorString;
+         field->nameLen = strlen(query->locatorString);
+         field->index = i;
       }
+
+      qsort(file->fields, file->numFields, sizeof *file->fields,
+            GuestInfoFieldCompare);
    }
 
-   fclose(fp);
+   gProcFieldsMapped = TRUE;
+}
+
 
-   return result;
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoUnmapProcFields --
+ *
+ *      Closes the stat files and frees their field maps and the buffer
+ *      they are read into.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoUnmapProcFields(void)
+{
+   uint32 j;
+
+   for (j = 0; j < PROC_MAX; j++) {
+      GuestInfoProcFile *file = &gProcFiles[j];
+
+      if (file->fd >= 0) {
+         close(file->fd);
+         file->fd = -1;
+      }
+      free(file->fields);
+      file->fields = NULL;
+      file->numFields = 0;
+      free(file->prefixes);
+      file->prefixes = NULL;
+      file->numPrefixes = 0;
+   }
+
+   free(gProcBuf);
+   gProcBuf = NULL;
+   gProcBufSize = 0;
+   gProcFieldsMapped = FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoGetUpTime --
+ *
+ *      What time is it?
+ *
+ * Results:
+ *      TRUE   Success! *now is populated
+ *      FALSE  Failure! *now remains unchanged
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoGetUpTime(double *now)  // OUT:
+{
+   double idle;
+   char *data = GuestInfoProcRead(&gProcFiles[PROC_UPTIME], NULL);
+
+   return data != NULL && sscanf(data, "%lf %lf", now, &idle) == 2;
 }
 
 
@@ -359,15 +679,15 @@ GuestInfoStoreStatByID(GuestStatToolsID reportID,      // IN:
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoCollectStat --
+ * GuestInfoLookupField --
  *
- *      Collect a stat.
+ *      Finds the query a field of a stat file feeds.
  *
  *      NOTE: Exact match data cannot be used in a regExp. This is a
  *            performance choice.
  *
  * Results:
- *      None.
+ *      The field, or NULL if no query uses it.
  *
  * Side effects:
  *      None.
@@ -375,34 +695,32 @@ GuestInfoStoreStatByID(GuestStatToolsID reportID,      // IN:
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoCollectStat(const char *pathName,           // IN:
-                     GuestInfoCollector *collector,  // IN/OUT:
-                     const char *fieldName,          // IN:
-                     uint64 value)                   // IN:
+static const GuestInfoField *
+GuestInfoLookupField(const GuestInfoProcFile *file,  // IN:
+                     const char *fieldName,          // IN: not NUL terminated
+                     size_t nameLen)                 // IN:
 {
-   GuestInfoStat *stat = NULL;
-   char *key = Str_SafeAsprintf(NULL, KEY_FORMAT, pathName, fieldName);
-
-   if (!HashTable_Lookup(collector->exactMatches, key, (void **) &stat)) {
-      uint32 i;
+   GuestInfoField key;
+   const GuestInfoField *field;
+   uint32 i;
 
-      for (i = 0; i < collector->numRegExps; i++) {
-         GuestInfoStat *thisOne = collector->regExps[i];
+   key.name = fieldName;
+   key.nameLen = nameLen;
+   field = bsearch(&key, file->fields, file->numFields, sizeof *file->fields,
+                   GuestInfoFieldCompare);
+   if (field != NULL) {
+      return field;
+   }
 
-         if (strcmp(pathName, thisOne->query->sourceFile) == 0 &&
-             StrUtil_StartsWith(fieldName, thisOne->query->locatorString)) {
-            stat = thisOne;
-            break;
-         }
+   for (i = 0; i < file->numPrefixes; i++) {
+      field = &file->prefixes[i];
+      if (nameLen >= field->nameLen &&
+          memcmp(fieldName, field->name, field->nameLen) == 0) {
+         return field;
       }
    }
 
-   free(key);
-
-   if (stat != NULL) {
-      GuestInfoStoreStat(stat, value);
-   }
+   return NULL;
 }
 
 
@@ -413,9 +731,9 @@ GuestInfoCollectStat(const char *pathName,           // IN:
  *
  *      Reads a "stat file" and contributes to the collection.
  *
- *      NOTE: If caller specifies a fieldSeparator, it has to be present
- *            in the fieldName being parsed. '\0' represents an unspecified
- *            fieldSeparator.
+ *      Lines are "<fieldName> <value> ...", possibly indented. If the
+ *      file has a fieldSeparator, it has to be present in the fieldName
+ *      being parsed, and ends the name.
  *
  * Results:
  *      TRUE   Success!
@@ -428,55 +746,78 @@ GuestInfoCollectStat(const char *pathName,           // IN:
  */
 
 static Bool
-GuestInfoProcData(const char *pathName,           // IN: path name
-                  char fieldSeparator,            // IN/OPT:
+GuestInfoProcData(GuestInfoProcFile *file,        // IN/OUT: stat file
                   GuestInfoCollector *collector)  // IN/OUT:
 {
-   char line[4096];  // Close to length of /proc/stat intr line
-   FILE *fp = Posix_Fopen(pathName, "r");
+   size_t len;
+   const char *line = GuestInfoProcRead(file, &len);
+   const char *end;
 
-   if (fp == NULL) {
-      g_warning("%s: Error opening %s.\n", __FUNCTION__, pathName);
+   if (line == NULL) {
       return FALSE;
    }
 
-   /*
-    * If a line inside the file is longer than what the buffer can hold,
-    * fgets still succeeds, the next fgets call continues at the previously
-    * stopped location in the line.
-    */
-   while (fgets(line, sizeof line, fp) == line) {
-      uint64 value = 0;
-      char *savedPtr = NULL;
-      char *fieldName = strtok_r(line, " \t", &savedPtr);
-      char *fieldData = strtok_r(NULL, " \t", &savedPtr);
+   for (end = line + len; line < end; ) {
+      const char *eol = memchr(line, '\n', end - line);
+      const char *p = line;
+      const char *fieldName;
+      const GuestInfoField *field;
+      size_t nameLen;
+      uint64 value;
 
-      if (fieldName == NULL) {
-         continue;
+      if (eol == NULL) {
+         eol = end;
+      }
+      line = eol + 1;
+
+      while (p < eol && (*p == ' ' || *p == '\t')) {
+         p++;
+      }
+      fieldName = p;
+      while (p < eol && *p != ' ' && *p != '\t') {
+         p++;
       }
+      nameLen = p - fieldName;
 
-      if (fieldSeparator != '\0') {
-         char *p = strrchr(fieldName, fieldSeparator);
-         if (p == NULL) {
+      if (file->fieldSeparator != '\0') {
+         /* Ends at the last separator in the name. */
+         while (nameLen > 0 && fieldName[nameLen - 1] != file->fieldSeparator) {
+            nameLen--;
+         }
+         if (nameLen == 0) {
             /*
              * When fieldSeparator is specified, fieldName is expected
              * to have it.
              */
             continue;
-         } else {
-            *p = '\0';
          }
+         nameLen--;
       }
 
-      if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
+      if (nameLen == 0) {
          continue;
       }
 
-      GuestInfoCollectStat(pathName, collector, fieldName, value);
-   }
+      /* Most lines feed no query; don't parse their values. */
+      field = GuestInfoLookupField(file, fieldName, nameLen);
+      if (field == NULL) {
+         continue;
+      }
 
-   fclose(fp);
+      while (p < eol && (*p == ' ' || *p == '\t')) {
+         p++;
+      }
+      if (p == eol || *p < '0' || *p > '9') {
+         continue;
+      }
+      for (value = 0; p < eol && *p >= '0' && *p <= '9'; p++) {
+         value = value * 10 + (*p - '0');
+      }
+
+      ASSERT(collector->stats[field->index].query->locatorString ==
+             field->name);
+      GuestInfoStoreStat(&collector->stats[field->index], value);
+   }
 
    return TRUE;
 }
@@ -502,12 +843,12 @@ GuestInfoProcData(const char *pathName,           // IN: path name
 #if PUBLISH_EXPERIMENTAL_STATS
 
 static Bool
-GuestInfoProcSimpleValue(GuestStatToolsID reportID,      // IN:
+GuestInfoProcSimpleValue(GuestInfoProcFile *file,        // IN/OUT:
+                         GuestStatToolsID reportID,      // IN:
                          GuestInfoCollector *collector)  // IN/OUT:
 {
-   char line[512];
+   char *data;
    uint64 value;
-   FILE *fp;
    Bool success = FALSE;
    GuestInfoStat *stat = NULL;
 
@@ -520,26 +861,21 @@ GuestInfoProcSimpleValue(GuestStatToolsID reportID,      // IN:
    }
 
    ASSERT(stat->query->sourceFile);
-   fp = Posix_Fopen(stat->query->sourceFile, "r");
-   if (fp == NULL) {
-      g_warning("%s: Error opening %s.\n",
-                __FUNCTION__, stat->query->sourceFile);
+   ASSERT(strcmp(stat->query->sourceFile, file->pathName) == 0);
+   data = GuestInfoProcRead(file, NULL);
+   if (data == NULL) {
       return success;
    }
 
-   if (fgets(line, sizeof line, fp) == line) {
-      value = 0;
-      if (sscanf(line, "%"FMT64"u", &value) == 1) {
-         stat->err = 0;
-         stat->count = 1;
-         stat->value = value;
+   value = 0;
+   if (sscanf(data, "%"FMT64"u", &value) == 1) {
+      stat->err = 0;
+      stat->count = 1;
+      stat->value = value;
 
-         success = TRUE;
-      }
+      success = TRUE;
    }
 
-   fclose(fp);
-
    return success;
 }
 #endif
@@ -688,11 +1024,10 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
    uint64 inflightIOsSum;
    Bool setStats; // Only when no disk device change in between
 
-   char line[512];
-   FILE *fp = Posix_Fopen(DISKSTATS_FILE, "r");
+   char *next;
+   char *line = GuestInfoProcRead(&gProcFiles[PROC_DISKSTATS], NULL);
 
-   if (fp == NULL) {
-      g_warning("%s: Error opening " DISKSTATS_FILE ".\n", __FUNCTION__);
+   if (line == NULL) {
       return FALSE;
    }
 
@@ -701,7 +1036,7 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
    inflightIOsSum = 0;
    setStats = (gDiskStatsList != NULL) ? TRUE : FALSE;
 
-   while (fgets(line, sizeof line, fp) == line) {
+   for (; *line != '\0'; line = next) {
       /*
        * Linux kernel diskstats_show format string:
        * "%4d %7d %s %lu %lu %lu %u %lu %lu %lu %u %u %u %u\n"
@@ -717,6 +1052,14 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
       unsigned int inflightIOs;    // # of I/Os currently in progress
       unsigned int weightedTime;   // Weighted # of milliseconds
                                    // spent in doing I/Os
+
+      next = strchr(line, '\n');
+      if (next != NULL) {
+         *next++ = '\0';
+      } else {
+         next = line + strlen(line);
+      }
+
       assignedCount = sscanf(line,
                              "%*d %*d %" XSTR(NAME_MAX) "s "
                              "%lu %*u %*u %*u "
@@ -727,7 +1070,12 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
                              &writeIOs,
                              &inflightIOs, &weightedTime);
       if (assignedCount != 5 ||
-          (readIOs == 0 && writeIOs == 0) ||
+          (readIOs == 0 && writeIOs == 0)) {
+         continue;
+      }
+
+      /* Disks already known are block devices, spare the access() call. */
+      if ((*listItem == NULL || strcmp((*listItem)->diskName, diskName) != 0) &&
           !GuestInfoIsBlockDevice(diskName)) {
          continue;
       }
@@ -759,8 +1107,6 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
       listItem = &((*listItem)->next);
    }
 
-   fclose(fp);
-
    if (listItem == &gDiskStatsList // No qualified disk device found
        || *listItem != NULL) {     // Disk hot unplug at the end of the list
       GuestInfoDeleteDiskStatsList(*listItem);
@@ -793,6 +1139,430 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoUint64Compare --
+ *
+ *      Orders samples, for qsort.
+ *
+ * Results:
+ *      Negative, zero or positive, like strcmp.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+GuestInfoUint64Compare(const void *a,  // IN:
+                       const void *b)  // IN:
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return (x > y) - (x < y);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoThreadCpuNs --
+ *
+ *      CPU time used by the calling thread.
+ *
+ * Results:
+ *      The time, in nanoseconds.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint64
+GuestInfoThreadCpuNs(void)
+{
+   struct timespec ts;
+
+   if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+      return 0;
+   }
+
+   return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResPush --
+ *
+ *      Adds a sample of a counter to its ring.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Overwrites the oldest sample if the ring is full.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoHighResPush(GuestInfoHighResCounter counter,  // IN:
+                     uint64 value)                     // IN:
+{
+   GuestInfoHighRes *hr = &gHighResState;
+   GuestInfoRing *ring = &hr->rings[counter];
+
+   ring->values[ring->next] = value;
+   ring->next = (ring->next + 1) % hr->capacity;
+   if (ring->count < hr->capacity) {
+      ring->count++;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResRunQueue --
+ *
+ *      Reads the number of runnable tasks from /proc/loadavg, which is
+ *      much shorter than /proc/stat on large guests.
+ *
+ * Results:
+ *      TRUE   Success! *value is populated
+ *      FALSE  Failure!
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoHighResRunQueue(uint64 *value)  // OUT:
+{
+   unsigned int running;
+   char *data = GuestInfoProcRead(&gProcFiles[PROC_LOADAVG], NULL);
+
+   if (data == NULL || sscanf(data, "%*s %*s %*s %u/", &running) != 1) {
+      return FALSE;
+   }
+
+   /* Exclude the sampling thread, like GuestInfoDecreaseCpuRunQueueByOne. */
+   *value = (running > 0) ? running - 1 : 0;
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResDiskQueue --
+ *
+ *      Sums the I/Os in progress of the disks found by the last poll in
+ *      /proc/diskstats, which spares checking /sys/block at each sample.
+ *
+ * Results:
+ *      TRUE   Success! *value is populated
+ *      FALSE  Failure, or no disk known yet.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoHighResDiskQueue(uint64 *value)  // OUT:
+{
+   char *next;
+   char *line;
+   uint64 sum = 0;
+
+   if (gDiskStatsList == NULL) {
+      return FALSE;
+   }
+
+   line = GuestInfoProcRead(&gProcFiles[PROC_DISKSTATS], NULL);
+   if (line == NULL) {
+      return FALSE;
+   }
+
+   for (; *line != '\0'; line = next) {
+      char diskName[NAME_MAX + 1];
+      unsigned int inflightIOs;
+      GuestInfoDiskStatsList *disk;
+
+      next = strchr(line, '\n');
+      if (next != NULL) {
+         *next++ = '\0';
+      } else {
+         next = line + strlen(line);
+      }
+
+      if (sscanf(line,
+                 "%*d %*d %" XSTR(NAME_MAX) "s "
+                 "%*u %*u %*u %*u %*u %*u %*u %*u %u",
+                 diskName, &inflightIOs) != 2) {
+         continue;
+      }
+
+      for (disk = gDiskStatsList; disk != NULL; disk = disk->next) {
+         if (strcmp(disk->diskName, diskName) == 0) {
+            sum += inflightIOs;
+            break;
+         }
+      }
+   }
+
+   *value = sum;
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResMemPressure --
+ *
+ *      Computes the share of the time since the previous sample during
+ *      which some task stalled on memory, from the pressure stall
+ *      information of /proc/pressure/memory (Linux 4.20 and later).
+ *
+ * Results:
+ *      TRUE   Success! *value is populated, in percent
+ *      FALSE  Failure, or first sample.
+ *
+ * Side effects:
+ *      Stops reading the file if the kernel does not provide it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoHighResMemPressure(uint64 *value)  // OUT:
+{
+   GuestInfoHighRes *hr = &gHighResState;
+   char *data;
+   char *total;
+   uint64 stalled;
+   int64 now;
+   Bool result = FALSE;
+
+   if (!hr->psiAvailable) {
+      return FALSE;
+   }
+
+   data = GuestInfoProcRead(&gProcFiles[PROC_PSI_MEMORY], NULL);
+   now = g_get_monotonic_time();
+
+   /* The first total on the file is the one of the "some" line. */
+   total = (data != NULL) ? strstr(data, "total=") : NULL;
+   if (total == NULL ||
+       sscanf(total, "total=%"FMT64"u", &stalled) != 1) {
+      g_debug("%s: Memory pressure not available.\n", __FUNCTION__);
+      hr->psiAvailable = FALSE;
+      return FALSE;
+   }
+
+   if (hr->psiValid && now > hr->psiTime && stalled >= hr->psiTotal) {
+      *value = MIN(100, (stalled - hr->psiTotal) * 100 / (now - hr->psiTime));
+      result = TRUE;
+   }
+
+   hr->psiValid = TRUE;
+   hr->psiTotal = stalled;
+   hr->psiTime = now;
+
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResSample --
+ *
+ *      Timer callback taking a high resolution sample of each counter.
+ *
+ * Results:
+ *      TRUE, to keep the timer.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+GuestInfoHighResSample(gpointer data)  // IN: unused
+{
+   GuestInfoHighRes *hr = &gHighResState;
+   uint64 start = GuestInfoThreadCpuNs();
+   uint64 value;
+
+   if (GuestInfoHighResRunQueue(&value)) {
+      GuestInfoHighResPush(HIGHRES_RUN_QUEUE, value);
+   }
+   if (GuestInfoHighResDiskQueue(&value)) {
+      GuestInfoHighResPush(HIGHRES_DISK_QUEUE, value);
+   }
+   if (GuestInfoHighResMemPressure(&value)) {
+      GuestInfoHighResPush(HIGHRES_MEM_PRESSURE, value);
+   }
+
+   hr->cpuNs += GuestInfoThreadCpuNs() - start;
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResStop --
+ *
+ *      Stops high resolution sampling and frees its samples.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The summaries are no longer published.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoHighResStop(void)
+{
+   GuestInfoHighRes *hr = &gHighResState;
+   uint32 i;
+
+   if (hr->timer != NULL) {
+      g_source_destroy(hr->timer);
+      hr->timer = NULL;
+   }
+
+   for (i = 0; i < HIGHRES_MAX; i++) {
+      free(hr->rings[i].values);
+   }
+   free(hr->scratch);
+   memset(hr, 0, sizeof *hr);
+
+   gHighRes = FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResStartTimer --
+ *
+ *      (Re)starts the sampling timer with the current interval.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoHighResStartTimer(void)
+{
+   GuestInfoHighRes *hr = &gHighResState;
+
+   if (hr->timer != NULL) {
+      g_source_destroy(hr->timer);
+   }
+
+   hr->timer = VMTools_CreateTimer(hr->interval);
+   VMTOOLSAPP_ATTACH_SOURCE(hr->ctx, hr->timer, GuestInfoHighResSample,
+                            NULL, NULL);
+   g_source_unref(hr->timer);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoHighResSummarize --
+ *
+ *      Stores the minimum, median, 95th percentile and maximum of the
+ *      samples of each counter into the collection, and starts new
+ *      rings. Then checks the CPU time spent sampling against the
+ *      budget, and samples less often if it was exceeded.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May change the sampling interval.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoHighResSummarize(GuestInfoCollector *collector)  // IN/OUT:
+{
+   GuestInfoHighRes *hr = &gHighResState;
+   int64 now = g_get_monotonic_time();
+   uint32 i;
+
+   if (hr->timer == NULL) {
+      return;
+   }
+
+   for (i = 0; i < HIGHRES_MAX; i++) {
+      GuestInfoRing *ring = &hr->rings[i];
+      uint32 n = ring->count;
+
+      if (n == 0) {
+         continue;
+      }
+
+      memcpy(hr->scratch, ring->values, n * sizeof *hr->scratch);
+      qsort(hr->scratch, n, sizeof *hr->scratch, GuestInfoUint64Compare);
+
+      GuestInfoStoreStatByID(gHighResIDs[i][0], collector, hr->scratch[0]);
+      GuestInfoStoreStatByID(gHighResIDs[i][1], collector,
+                             hr->scratch[(n - 1) / 2]);
+      GuestInfoStoreStatByID(gHighResIDs[i][2], collector,
+                             hr->scratch[(n - 1) * 95 / 100]);
+      GuestInfoStoreStatByID(gHighResIDs[i][3], collector,
+                             hr->scratch[n - 1]);
+
+      ring->count = 0;
+      ring->next = 0;
+   }
+
+   /* cpuNs / 1000 / elapsed us, in hundredths of a percent. */
+   if (now > hr->since &&
+       hr->cpuNs / 1000 * 10000 > (uint64)hr->budget * (now - hr->since)) {
+      g_warning("%s: Sampling used %.2f%% of a CPU, over the %.2f%% budget. "
+                "Sampling every %u ms instead of %u ms.\n", __FUNCTION__,
+                hr->cpuNs / 10.0 / (now - hr->since), hr->budget / 100.0,
+                hr->interval * 2, hr->interval);
+      hr->interval *= 2;
+      GuestInfoHighResStartTimer();
+   }
+
+   hr->cpuNs = 0;
+   hr->since = now;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -826,17 +1596,20 @@ GuestInfoCollect(GuestInfoCollector *collector)  // IN/OUT:
    }
 
    /* Collect new values */
-   GuestInfoProcData(MEMINFO_FILE, ':', collector);
-   GuestInfoProcData(VMSTAT_FILE, '\0', collector);
-   GuestInfoProcData(STAT_FILE, '\0', collector);
-   GuestInfoProcData(ZONEINFO_FILE, '\0', collector);
+   GuestInfoProcData(&gProcFiles[PROC_MEMINFO], collector);
+   GuestInfoProcData(&gProcFiles[PROC_VMSTAT], collector);
+   GuestInfoProcData(&gProcFiles[PROC_STAT], collector);
+   GuestInfoProcData(&gProcFiles[PROC_ZONEINFO], collector);
 #if PUBLISH_EXPERIMENTAL_STATS
-   GuestInfoProcSimpleValue(GuestStatID_Linux_Swappiness, collector);
+   GuestInfoProcSimpleValue(&gProcFiles[PROC_SWAPPINESS],
+                            GuestStatID_Linux_Swappiness, collector);
    GuestInfoDeriveSwapData(collector);
 #endif
 
    collector->timeData = GuestInfoGetUpTime(&collector->timeStamp);
 
+   GuestInfoHighResSummarize(collector);
+
    /*
     * We make sure physical page size is always present.
     */
@@ -1361,9 +2134,7 @@ static void
 GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
 {
    if (collector != NULL) {
-      HashTable_Free(collector->exactMatches);
       HashTable_Free(collector->reportMap);
-      free(collector->regExps);
       free(collector->stats);
       free(collector);
    }
@@ -1392,7 +2163,6 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
                             uint32 numQueries)        // IN:
 {
    uint32 i;
-   uint32 regExp = 0;
    GuestInfoCollector *collector = Util_SafeCalloc(1, sizeof *collector);
 
    if (collector == NULL) {
@@ -1401,32 +2171,16 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
 
    collector->reportMap = HashTable_Alloc(256, HASH_INT_KEY, NULL);
 
-   collector->exactMatches = HashTable_Alloc(256,
-                                           HASH_STRING_KEY | HASH_FLAG_COPYKEY,
-                                             NULL);
-
-   collector->numRegExps = 0;
-   for (i = 0; i < numQueries; i++) {
-      if (queries[i].isRegExp) {
-         collector->numRegExps++;
-      }
-   }
-
    collector->numStats = numQueries;
    collector->stats = Util_SafeCalloc(numQueries, sizeof *collector->stats);
-   collector->regExps = Util_SafeCalloc(collector->numRegExps,
-                                        sizeof(GuestInfoStat *));
 
-   if ((collector->exactMatches == NULL) ||
-       (collector->reportMap == NULL) ||
-       ((collector->numRegExps != 0) && (collector->regExps == NULL)) ||
+   if ((collector->reportMap == NULL) ||
        ((collector->numStats != 0) && (collector->stats == NULL))) {
       GuestInfoDestroyCollector(collector);
       return NULL;
    }
 
-   regExp = 0;
-
+   /* Stat files are matched with GuestInfoMapProcFields' field maps. */
    for (i = 0; i < numQueries; i++) {
       GuestInfoQuery *query = &queries[i];
       GuestInfoStat *stat = &collector->stats[i];
@@ -1434,20 +2188,8 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
       ASSERT(query->reportID);
 
       stat->query = query;
-
-      if (query->isRegExp) {
-         ASSERT(query->sourceFile);
-         ASSERT(query->locatorString);
-
-         collector->regExps[regExp++] = stat;
-      } else {
-         if (query->sourceFile != NULL && query->locatorString != NULL) {
-            char *key = Str_SafeAsprintf(NULL, KEY_FORMAT, query->sourceFile,
-                                         query->locatorString);
-            HashTable_Insert(collector->exactMatches, key, stat);
-            free(key);
-         }
-      }
+      ASSERT(!query->isRegExp || query->sourceFile != NULL);
+      ASSERT(!query->isRegExp || query->locatorString != NULL);
 
       /* The report lookup */
       HashTable_Insert(collector->reportMap, INT_AS_HASHKEY(query->reportID),
@@ -1496,6 +2238,10 @@ GuestInfoTakeSample(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
                                              N_QUERIES);
    }
 
+   if (!gProcFieldsMapped) {
+      GuestInfoMapProcFields(guestInfoQuerySpecTable, N_QUERIES);
+   }
+
    if ((gCurrentCollector == NULL) ||
        (gPreviousCollector == NULL)) {
       GuestInfoDestroyCollector(gCurrentCollector);
@@ -1565,13 +2311,96 @@ GuestInfo_StatProviderPoll(gpointer data)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfo_StatProviderConfigure --
+ *
+ *      Starts, restarts or stops high resolution sampling according to
+ *      the configuration. The rings hold the samples of one poll.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Attaches or destroys the sampling timer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+GuestInfo_StatProviderConfigure(ToolsAppCtx *ctx,   // IN:
+                                gint statsInterval) // IN: poll interval, ms
+{
+   GuestInfoHighRes *hr = &gHighResState;
+   gint interval = 0;
+   gint budget;
+   uint32 capacity;
+   uint32 i;
+
+   if (statsInterval > 0) {
+      interval = VMTools_ConfigGetInteger(ctx->config,
+                                          CONFGROUPNAME_GUESTINFO,
+                                          CONFNAME_GUESTINFO_HIGHRESINTERVAL,
+                                          0);
+   }
+
+   if (interval <= 0) {
+      if (hr->timer != NULL) {
+         g_info("High resolution stats disabled.\n");
+         GuestInfoHighResStop();
+      }
+      return;
+   }
+
+   interval = MAX(interval, HIGHRES_MIN_INTERVAL);
+   budget = VMTools_ConfigGetInteger(ctx->config,
+                                     CONFGROUPNAME_GUESTINFO,
+                                     CONFNAME_GUESTINFO_HIGHRESBUDGET,
+                                     HIGHRES_DEFAULT_BUDGET);
+   if (budget <= 0) {
+      g_warning("Invalid %s.%s value. Using default %u.\n",
+                CONFGROUPNAME_GUESTINFO, CONFNAME_GUESTINFO_HIGHRESBUDGET,
+                HIGHRES_DEFAULT_BUDGET);
+      budget = HIGHRES_DEFAULT_BUDGET;
+   }
+   capacity = CLAMP(statsInterval / interval + 1, 16, HIGHRES_MAX_SAMPLES);
+
+   /* Keep the samples, and any backed off interval, if nothing changed. */
+   if (hr->timer != NULL && hr->configured == interval &&
+       hr->budget == budget && hr->capacity == capacity) {
+      return;
+   }
+
+   GuestInfoHighResStop();
+
+   hr->ctx = ctx;
+   hr->configured = interval;
+   hr->interval = interval;
+   hr->budget = budget;
+   hr->capacity = capacity;
+   for (i = 0; i < HIGHRES_MAX; i++) {
+      hr->rings[i].values = Util_SafeCalloc(capacity, sizeof(uint64));
+   }
+   hr->scratch = Util_SafeCalloc(capacity, sizeof(uint64));
+   hr->since = g_get_monotonic_time();
+   hr->psiAvailable = access(PSI_MEMORY_FILE, R_OK) == 0;
+
+   g_info("High resolution stats every %d ms, %d samples per poll.\n",
+          interval, capacity);
+
+   GuestInfoHighResStartTimer();
+   gHighRes = TRUE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * GuestInfo_StatProviderShutdown --
  *
- *      Clean up the resource acquired by perfMonLinux.
- *      Nothing to do at the moment.
+ *      Clean up the resource acquired by perfMonLinux, including the
+ *      open stat files.
  *
  * Results:
  *      None.
@@ -1585,6 +2414,8 @@ GuestInfo_StatProviderPoll(gpointer data)
 void
 GuestInfo_StatProviderShutdown(void)
 {
+   GuestInfoHighResStop();
+
    GuestInfoDeleteDiskStatsList(gDiskStatsList);
    gDiskStatsList = NULL;
 
@@ -1592,4 +2423,6 @@ GuestInfo_StatProviderShutdown(void)
    gCurrentCollector = NULL;
    GuestInfoDestroyCollector(gPreviousCollector);
    gPreviousCollector = NULL;
+
+   GuestInfoUnmapProcFields();
 }
@@ -763,7 +763,8 @@ TimeSyncStartLoop(ToolsAppCtx *ctx,
       g_warning("Unable to synchronize time when starting time loop.\n");
    }
 
-   data->timer = g_timeout_source_new(data->timeSyncPeriod * 1000);
+   data->timer = VMTools_CreateCoalescedTimer(data->timeSyncPeriod * 1000,
+                                              VMTOOLS_TIMER_DEFAULT_SLACK);
    VMTOOLSAPP_ATTACH_SOURCE(ctx, data->timer, ToolsDaemonTimeSyncLoop,
                             data, NULL);
 
@@ -785,6 +785,9 @@ exit:
  *    This will do nothing if the file system is already mounted. In some cases
  *    it might be necessary to create the mount path too.
  *
+ *    Runs on a worker thread when the RPC is offloaded, so it keeps no
+ *    static state.
+ *
  * Return value:
  *    TRUE always and VixError status for the RPC call reply.
  *    VIX_OK if mount succeeded or was already mounted
@@ -801,7 +804,7 @@ gboolean
 ToolsDaemonTcloMountHGFS(RpcInData *data) // IN
 {
    VixError err = VIX_OK;
-   static char resultBuffer[DEFAULT_RESULT_MSG_MAX_LENGTH];
+   char *result;
 
 #if defined(__linux__)
 #define MOUNT_PATH_BIN       "/bin/mount"
@@ -911,14 +914,10 @@ exit:
     * All tools commands return results that start with an error
     * and a guest-OS-specific error.
     */
-   Str_Sprintf(resultBuffer,
-               sizeof(resultBuffer),
-               "%"FMT64"d %d",
-               err,
-               Err_Errno());
-   RPCIN_SETRETVALS(data, resultBuffer, TRUE);
+   result = Str_SafeAsprintf(NULL, "%"FMT64"d %d", err, Err_Errno());
 
-   g_message("%s: returning %s\n", __FUNCTION__, resultBuffer);
+   g_message("%s: returning %s\n", __FUNCTION__, result);
+   RPCIN_SETRETVALSF(data, result, TRUE);
 
    return TRUE;
 } // ToolsDaemonTcloMountHGFS
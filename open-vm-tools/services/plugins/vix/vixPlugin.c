@@ -99,8 +99,10 @@ ToolsOnLoad(ToolsAppCtx *ctx)
          FoundryToolsDaemonGetToolsProperties, NULL, NULL, 0 },
       { VIX_BACKDOORCOMMAND_COMMAND,
          ToolsDaemonTcloReceiveVixCommand, NULL, NULL, 0 },
+      /* Runs vmhgfs-fuse and mount to completion, off the main loop. */
       { VIX_BACKDOORCOMMAND_MOUNT_VOLUME_LIST,
-         ToolsDaemonTcloMountHGFS, NULL, NULL, NULL, 0 },
+         ToolsDaemonTcloMountHGFS, NULL, NULL, NULL, 0,
+         RPCCHANNEL_FLAG_OFFLOAD },
    };
    ToolsPluginSignalCb sigs[] = {
       { TOOLS_CORE_SIG_SHUTDOWN, VixShutdown, &regData }
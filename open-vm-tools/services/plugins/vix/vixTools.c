@@ -2147,7 +2147,8 @@ VixToolsRegisterProcHandleInvalidator(void *clientData)    // IN:
    }
 
    gProcHandleInvalidatorTimer =
-         g_timeout_source_new(SECONDS_BETWEEN_INVALIDATING_PROC_HANDLES * 1000);
+         VMTools_CreateCoalescedTimer(SECONDS_BETWEEN_INVALIDATING_PROC_HANDLES * 1000,
+                                      VMTOOLS_TIMER_DEFAULT_SLACK);
 
    g_source_set_callback(gProcHandleInvalidatorTimer,
                          VixToolsInvalidateStaleProcHandles,
@@ -2193,7 +2194,8 @@ VixToolsRegisterHgfsSessionInvalidator(void *clientData)    // IN:
    }
 
    gHgfsSessionInvalidatorTimer =
-         g_timeout_source_new(SECONDS_BETWEEN_INVALIDATING_HGFS_SESSIONS * 1000);
+         VMTools_CreateCoalescedTimer(SECONDS_BETWEEN_INVALIDATING_HGFS_SESSIONS * 1000,
+                                      VMTOOLS_TIMER_DEFAULT_SLACK);
 
    g_source_set_callback(gHgfsSessionInvalidatorTimer,
                          VixToolsInvalidateInactiveHGFSSessions,
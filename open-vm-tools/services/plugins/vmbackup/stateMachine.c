@@ -782,10 +782,11 @@ VmBackupEnableSyncWait(void)
     * and track it with an extra state in the state machine.
     */
    gBackupState->freezeStatus = VMBACKUP_FREEZE_PENDING;
-   if (!ToolsCorePool_SubmitTask(gBackupState->ctx,
-                                 gBackupState->provider->start,
-                                 gBackupState,
-                                 NULL)) {
+   if (!ToolsCorePool_SubmitTaskPrio(gBackupState->ctx,
+                                     TOOLS_CORE_POOL_PRIO_LATENCY,
+                                     gBackupState->provider->start,
+                                     gBackupState,
+                                     NULL)) {
       g_warning("Failed to submit backup start task.");
 #endif
       g_signal_emit_by_name(gBackupState->ctx->serviceObj,
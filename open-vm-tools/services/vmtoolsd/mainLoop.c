@@ -29,6 +29,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include "toolsCoreInt.h"
 #include "conf.h"
 #include "guestApp.h"
@@ -72,6 +73,378 @@
 
 #define CONFNAME_MAX_CHANNEL_ATTEMPTS "maxChannelAttempts"
 
+/*
+ * Main loop iterations busy for longer than this, in milliseconds, are
+ * logged with the callbacks that ran. 0 disables the main loop monitor.
+ */
+#define CONFNAME_STALL_THRESHOLD "mainLoop.stallThreshold"
+#define STALL_THRESHOLD_DEFAULT 500
+
+/*
+ * Coalesced timers fire on ticks this many milliseconds apart, at most the
+ * given percentage of their period late. A tick of 0 disables coalescing.
+ */
+#define CONFNAME_TIMER_TICK "timers.tick"
+#define TIMER_TICK_DEFAULT 1000
+#define CONFNAME_TIMER_SLACK "timers.slack"
+#define TIMER_SLACK_DEFAULT 10
+
+/* Callback dispatch time histogram: < 1, 4, 16, 64, 256, 1024 ms, and more. */
+#define LOOP_HIST_BUCKETS 7
+
+/* Number of callbacks logged for a stalled iteration. */
+#define LOOP_STALL_TOP 3
+
+/** Dispatch statistics of a main loop callback. */
+typedef struct ToolsLoopCbStats {
+   gchar         *name;
+   guint64        count;
+   gint64         totalUs;
+   gint64         maxUs;
+   guint64        hist[LOOP_HIST_BUCKETS];
+} ToolsLoopCbStats;
+
+/** A callback dispatch in the current main loop iteration. */
+typedef struct ToolsLoopDispatch {
+   ToolsLoopCbStats *stats;
+   gint64            start;
+   gint64            durationUs;
+   guint             depth;
+} ToolsLoopDispatch;
+
+/** State of the main loop monitor. */
+typedef struct ToolsLoopMonitor {
+   VMToolsDispatchMonitor funcs;
+   GMainContext  *ctx;
+   GThread       *thread;
+   GPollFunc      poll;
+   gint64         stallUs;
+   gint64         iterStart;
+   GHashTable    *callbacks;
+   GArray        *running;
+   GArray        *iteration;
+   guint64        stalls;
+   gint64         maxStallUs;
+} ToolsLoopMonitor;
+
+/* The poll function gets no data, so there is one monitor per process. */
+static ToolsLoopMonitor gLoopMonitor;
+
+
+/**
+ * Dispatch monitor callback: a main loop callback starts running. Only
+ * callbacks running on the main loop's thread are tracked.
+ *
+ * @param[in]  name     Name of the callback.
+ * @param[in]  data     The loop monitor.
+ *
+ * @return The callback's statistics, as the token for the end callback.
+ */
+
+static gpointer
+ToolsCoreLoopBegin(const gchar *name,
+                   gpointer data)
+{
+   ToolsLoopMonitor *mon = data;
+   ToolsLoopCbStats *stats;
+   ToolsLoopDispatch dispatch;
+
+   /*
+    * This may run with the main context locked, so no main context function
+    * can be used here or in ToolsCoreLoopEnd().
+    */
+   if (g_thread_self() != mon->thread) {
+      return NULL;
+   }
+
+   stats = g_hash_table_lookup(mon->callbacks, name);
+   if (stats == NULL) {
+      stats = g_malloc0(sizeof *stats);
+      stats->name = g_strdup(name);
+      g_hash_table_insert(mon->callbacks, stats->name, stats);
+   }
+
+   dispatch.stats = stats;
+   dispatch.start = g_get_monotonic_time();
+   dispatch.durationUs = 0;
+   dispatch.depth = mon->running->len;
+   g_array_append_val(mon->running, dispatch);
+
+   return stats;
+}
+
+
+/**
+ * Dispatch monitor callback: a main loop callback has returned. Updates the
+ * callback's statistics and adds it to the current iteration's dispatches.
+ *
+ * @param[in]  token    The callback's statistics.
+ * @param[in]  data     The loop monitor.
+ */
+
+static void
+ToolsCoreLoopEnd(gpointer token,
+                 gpointer data)
+{
+   ToolsLoopMonitor *mon = data;
+   ToolsLoopDispatch *dispatch;
+   ToolsLoopCbStats *stats;
+   gint64 ms;
+   guint bucket;
+
+   ASSERT(mon->running->len > 0);
+   dispatch = &g_array_index(mon->running, ToolsLoopDispatch,
+                             mon->running->len - 1);
+   ASSERT(dispatch->stats == token);
+   stats = dispatch->stats;
+
+   dispatch->durationUs = g_get_monotonic_time() - dispatch->start;
+   g_array_append_val(mon->iteration, *dispatch);
+   g_array_set_size(mon->running, mon->running->len - 1);
+
+   dispatch = &g_array_index(mon->iteration, ToolsLoopDispatch,
+                             mon->iteration->len - 1);
+   stats->count++;
+   stats->totalUs += dispatch->durationUs;
+   stats->maxUs = MAX(stats->maxUs, dispatch->durationUs);
+
+   bucket = 0;
+   ms = dispatch->durationUs / 1000;
+   while (ms > 0 && bucket < LOOP_HIST_BUCKETS - 1) {
+      bucket++;
+      ms /= 4;
+   }
+   stats->hist[bucket]++;
+}
+
+
+/**
+ * Sorts dispatches by decreasing duration.
+ *
+ * @param[in]  a     A dispatch.
+ * @param[in]  b     Another dispatch.
+ *
+ * @return Comparison result.
+ */
+
+static gint
+ToolsCoreLoopDispatchCompare(gconstpointer a,
+                             gconstpointer b)
+{
+   const ToolsLoopDispatch *da = a;
+   const ToolsLoopDispatch *db = b;
+
+   return (da->durationUs < db->durationUs) - (da->durationUs > db->durationUs);
+}
+
+
+/**
+ * Poll function of the main context. Ends the previous iteration, logging
+ * its longest callbacks if it was busy for too long, then polls.
+ *
+ * @param[in]  fds      File descriptors to poll.
+ * @param[in]  nfds     Number of descriptors.
+ * @param[in]  timeout  Poll timeout, in milliseconds.
+ *
+ * @return The result of the poll.
+ */
+
+static gint
+ToolsCoreLoopPoll(GPollFD *fds,
+                  guint nfds,
+                  gint timeout)
+{
+   ToolsLoopMonitor *mon = &gLoopMonitor;
+   gint64 busyUs = g_get_monotonic_time() - mon->iterStart;
+   gint ret;
+
+   if (mon->iterStart != 0 && busyUs >= mon->stallUs) {
+      GString *top = g_string_new(NULL);
+      gint64 otherUs = busyUs;
+      guint i;
+
+      for (i = 0; i < mon->iteration->len; i++) {
+         ToolsLoopDispatch *dispatch = &g_array_index(mon->iteration,
+                                                      ToolsLoopDispatch, i);
+         if (dispatch->depth == 0) {
+            otherUs -= dispatch->durationUs;
+         }
+      }
+
+      g_array_sort(mon->iteration, ToolsCoreLoopDispatchCompare);
+      for (i = 0; i < mon->iteration->len && i < LOOP_STALL_TOP; i++) {
+         ToolsLoopDispatch *dispatch = &g_array_index(mon->iteration,
+                                                      ToolsLoopDispatch, i);
+         g_string_append_printf(top, "%s %.1f ms, ", dispatch->stats->name,
+                                dispatch->durationUs / 1000.0);
+      }
+
+      g_warning("Main loop busy for %.1f ms: %sother %.1f ms.\n",
+                busyUs / 1000.0, top->str, MAX(otherUs, 0) / 1000.0);
+      g_string_free(top, TRUE);
+
+      mon->stalls++;
+      mon->maxStallUs = MAX(mon->maxStallUs, busyUs);
+   }
+
+   g_array_set_size(mon->iteration, 0);
+   ret = mon->poll(fds, nfds, timeout);
+   mon->iterStart = g_get_monotonic_time();
+   return ret;
+}
+
+
+/**
+ * Starts monitoring the callbacks run by the main loop, unless disabled in
+ * the config file. Must be called from the thread that runs the main loop.
+ *
+ * @param[in]  state    The service state.
+ */
+
+static void
+ToolsCoreLoopMonitorInit(ToolsServiceState *state)
+{
+   ToolsLoopMonitor *mon = &gLoopMonitor;
+   gint threshold;
+
+   threshold = VMTools_ConfigGetInteger(state->ctx.config, state->name,
+                                        CONFNAME_STALL_THRESHOLD,
+                                        STALL_THRESHOLD_DEFAULT);
+   if (threshold <= 0) {
+      g_info("Main loop monitor disabled.\n");
+      return;
+   }
+
+   mon->funcs.begin = ToolsCoreLoopBegin;
+   mon->funcs.end = ToolsCoreLoopEnd;
+   mon->funcs.data = mon;
+   mon->ctx = g_main_loop_get_context(state->ctx.mainLoop);
+   mon->thread = g_thread_self();
+   mon->stallUs = (gint64) threshold * 1000;
+   mon->callbacks = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          NULL, g_free);
+   mon->running = g_array_new(FALSE, FALSE, sizeof (ToolsLoopDispatch));
+   mon->iteration = g_array_new(FALSE, FALSE, sizeof (ToolsLoopDispatch));
+
+   mon->poll = g_main_context_get_poll_func(mon->ctx);
+   g_main_context_set_poll_func(mon->ctx, ToolsCoreLoopPoll);
+   VMTools_SetDispatchMonitor(&mon->funcs);
+}
+
+
+/**
+ * Configures the wheel that coalesced timers fire on. Called before plugins
+ * create their timers, and again when the service's config group changes.
+ *
+ * @param[in]  state    The service state.
+ */
+
+static void
+ToolsCoreTimerWheelInit(ToolsServiceState *state)
+{
+   gint tick;
+   gint slack;
+
+   tick = VMTools_ConfigGetInteger(state->ctx.config, state->name,
+                                   CONFNAME_TIMER_TICK, TIMER_TICK_DEFAULT);
+   slack = VMTools_ConfigGetInteger(state->ctx.config, state->name,
+                                    CONFNAME_TIMER_SLACK, TIMER_SLACK_DEFAULT);
+   VMTools_ConfigureTimerWheel(MAX(tick, 0), MAX(slack, 0));
+}
+
+
+/**
+ * Stops monitoring the main loop.
+ */
+
+static void
+ToolsCoreLoopMonitorShutdown(void)
+{
+   ToolsLoopMonitor *mon = &gLoopMonitor;
+
+   if (mon->callbacks == NULL) {
+      return;
+   }
+
+   VMTools_SetDispatchMonitor(NULL);
+   g_main_context_set_poll_func(mon->ctx, mon->poll);
+   g_hash_table_destroy(mon->callbacks);
+   g_array_free(mon->running, TRUE);
+   g_array_free(mon->iteration, TRUE);
+   memset(mon, 0, sizeof *mon);
+}
+
+
+/**
+ * Sorts callback statistics by decreasing total dispatch time.
+ *
+ * @param[in]  a     Pointer to callback statistics.
+ * @param[in]  b     Pointer to other callback statistics.
+ *
+ * @return Comparison result.
+ */
+
+static gint
+ToolsCoreLoopStatsCompare(gconstpointer a,
+                          gconstpointer b)
+{
+   const ToolsLoopCbStats *sa = *(ToolsLoopCbStats * const *) a;
+   const ToolsLoopCbStats *sb = *(ToolsLoopCbStats * const *) b;
+
+   return (sa->totalUs < sb->totalUs) - (sa->totalUs > sb->totalUs);
+}
+
+
+/**
+ * Logs the main loop monitor's data as part of the service's state dump:
+ * the stalls, and the dispatch times of each callback, longest total first.
+ */
+
+static void
+ToolsCoreLoopMonitorDump(void)
+{
+   ToolsLoopMonitor *mon = &gLoopMonitor;
+   GPtrArray *sorted;
+   GHashTableIter iter;
+   gpointer value;
+   guint i;
+
+   if (mon->callbacks == NULL) {
+      return;
+   }
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Main loop: %"FMT64"u iterations over %"FMT64"d ms "
+                      "(longest %.1f ms)\n",
+                      mon->stalls, mon->stallUs / 1000,
+                      mon->maxStallUs / 1000.0);
+
+   sorted = g_ptr_array_new();
+   g_hash_table_iter_init(&iter, mon->callbacks);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      g_ptr_array_add(sorted, value);
+   }
+   g_ptr_array_sort(sorted, ToolsCoreLoopStatsCompare);
+
+   for (i = 0; i < sorted->len; i++) {
+      ToolsLoopCbStats *stats = g_ptr_array_index(sorted, i);
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "%s: %"FMT64"u calls, %.3f ms average, %.3f ms max, "
+                         "ms histogram <1:%"FMT64"u <4:%"FMT64"u "
+                         "<16:%"FMT64"u <64:%"FMT64"u <256:%"FMT64"u "
+                         "<1024:%"FMT64"u more:%"FMT64"u\n",
+                         stats->name, stats->count,
+                         stats->totalUs / 1000.0 / stats->count,
+                         stats->maxUs / 1000.0,
+                         stats->hist[0], stats->hist[1], stats->hist[2],
+                         stats->hist[3], stats->hist[4], stats->hist[5],
+                         stats->hist[6]);
+   }
+
+   g_ptr_array_free(sorted, TRUE);
+}
+
 
 /*
  ******************************************************************************
@@ -100,8 +473,10 @@ ToolsCoreCleanup(ToolsServiceState *state)
       RpcChannel_Destroy(state->ctx.rpc);
       state->ctx.rpc = NULL;
    }
+   ToolsCoreLoopMonitorShutdown();
    g_key_file_free(state->ctx.config);
    g_main_loop_unref(state->ctx.mainLoop);
+   ToolsCore_FreeProfile(state);
 
 #if defined(G_PLATFORM_WIN32)
    if (state->ctx.comInitialized) {
@@ -176,6 +551,29 @@ ToolsCoreConfFileCb(gpointer clientData)
 }
 
 
+/**
+ * Starts polling the config file for changes.
+ *
+ * @param[in]  state    The service state.
+ *
+ * @return The ID of the polling source.
+ */
+
+static guint
+ToolsCoreStartConfigCheck(ToolsServiceState *state)
+{
+   GSource *src;
+   guint id;
+
+   src = VMTools_CreateCoalescedTimer(CONF_POLL_TIME * 1000,
+                                      VMTOOLS_TIMER_DEFAULT_SLACK);
+   g_source_set_callback(src, ToolsCoreConfFileCb, state, NULL);
+   id = g_source_attach(src, NULL);
+   g_source_unref(src);
+   return id;
+}
+
+
 /**
  * IO freeze signal handler. Disables the conf file check task if I/O is
  * frozen, re-enable it otherwise. See bug 529653.
@@ -198,9 +596,7 @@ ToolsCoreIOFreezeCb(gpointer src,
       VMTools_SuspendLogIO();
    } else if (state->configCheckTask == 0 && !freeze) {
       VMTools_ResumeLogIO();
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      state->configCheckTask = ToolsCoreStartConfigCheck(state);
    }
 }
 
@@ -379,6 +775,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
    if (!ToolsCore_InitRpc(state)) {
       return 1;
    }
+   ToolsCore_ProfileMark(state, "RPC channel setup");
 
    /*
     * Start the RPC channel if it's been created. The channel may be NULL if this is
@@ -387,10 +784,12 @@ ToolsCoreRunLoop(ToolsServiceState *state)
    if (state->ctx.rpc && !RpcChannel_Start(state->ctx.rpc)) {
       return 1;
    }
+   ToolsCore_ProfileMark(state, "RPC channel start");
 
    /* Report version info as guest Vars */
    if (state->ctx.rpc) {
       ToolsCoreReportVersionData(state);
+      ToolsCore_ProfileMark(state, "version report");
    }
 
    if (!ToolsCore_LoadPlugins(state)) {
@@ -421,6 +820,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
         ToolsCore_GetTcloName(state) == NULL ||
         state->debugPlugin != NULL)) {
       ToolsCore_RegisterPlugins(state);
+      ToolsCore_ProfileMark(state, "plugin registration");
 
       /*
        * Listen for the I/O freeze signal. We have to disable the config file
@@ -451,9 +851,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
                           NULL);
       }
 
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      state->configCheckTask = ToolsCoreStartConfigCheck(state);
 
 #if defined(__APPLE__)
       ToolsCore_CFRunLoop(state);
@@ -464,6 +862,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
       if (state->mainService && ToolsCoreHangDetector_Start(&state->ctx)) {
          g_info("Successfully started tools hang detector");
       }
+      ToolsCore_ProfileMark(state, "main loop start");
       g_main_loop_run(state->ctx.mainLoop);
 #endif
    }
@@ -485,13 +884,20 @@ void
 ToolsCore_DumpState(ToolsServiceState *state)
 {
    guint i;
+   ToolsCorePoolStats poolStats;
+   VMToolsTimerWheelStats timerStats;
    const char *providerStates[] = {
       "idle",
       "active",
       "error"
    };
+   const char *poolPriorities[] = {
+      "latency-critical",
+      "background"
+   };
 
    ASSERT_ON_COMPILE(ARRAYSIZE(providerStates) == TOOLS_PROVIDER_MAX);
+   ASSERT_ON_COMPILE(ARRAYSIZE(poolPriorities) == TOOLS_CORE_POOL_PRIO_MAX);
 
    if (!g_main_loop_is_running(state->ctx.mainLoop)) {
       ToolsCore_LogState(TOOLS_STATE_LOG_ROOT,
@@ -507,6 +913,43 @@ ToolsCore_DumpState(ToolsServiceState *state)
                       "Plugin path: %s\n",
                       state->pluginPath);
 
+   if (state->ctx.rpc != NULL) {
+      RpcChannelStats rpcStats;
+
+      RpcChannel_GetStats(state->ctx.rpc, &rpcStats);
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "RPC channel: %"FMT64"u sends, %"FMT64"u waited "
+                         "for the channel (%"FMT64"u us), %"FMT64"u sent "
+                         "concurrently\n",
+                         rpcStats.sends, rpcStats.contendedSends,
+                         rpcStats.lockWaitUs, rpcStats.concurrentSends);
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "RPC channel: %"FMT64"u commands over vsock, "
+                         "%"FMT64"u over the backdoor in %"FMT64"u polls "
+                         "(%"FMT64"u ms polling delay)\n",
+                         rpcStats.inVSockCommands,
+                         rpcStats.inBackdoorCommands,
+                         rpcStats.inBackdoorPolls,
+                         rpcStats.inBackdoorWaitMs);
+   }
+
+   ToolsCorePool_GetStats(&poolStats);
+   for (i = 0; i < TOOLS_CORE_POOL_PRIO_MAX; i++) {
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "Thread pool: %u %s tasks queued (max %u), "
+                         "%"FMT64"u started, %"FMT64"u us average wait "
+                         "(max %"FMT64"u us)\n",
+                         poolStats.queued[i], poolPriorities[i],
+                         poolStats.maxQueued[i], poolStats.started[i],
+                         poolStats.started[i] > 0 ?
+                            poolStats.waitUs[i] / poolStats.started[i] : 0,
+                         poolStats.maxWaitUs[i]);
+   }
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Thread pool: %"FMT64"u tasks stolen, %"FMT64"u "
+                      "canceled\n",
+                      poolStats.steals, poolStats.canceled);
+
    for (i = 0; i < state->providers->len; i++) {
       ToolsAppProviderReg *prov = &g_array_index(state->providers,
                                                  ToolsAppProviderReg,
@@ -520,6 +963,13 @@ ToolsCore_DumpState(ToolsServiceState *state)
       }
    }
 
+   ToolsCoreLoopMonitorDump();
+   VMTools_GetTimerWheelStats(&timerStats);
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Coalesced timers: %u, %"FMT64"u fires in %"FMT64"u "
+                      "wakeups\n",
+                      timerStats.timers, timerStats.fires, timerStats.wakeups);
+   ToolsCore_DumpProfile(state);
    ToolsCore_DumpPluginInfo(state);
 
    g_signal_emit_by_name(state->ctx.serviceObj,
@@ -588,12 +1038,58 @@ ToolsCore_GetTcloName(ToolsServiceState *state)
 }
 
 
+/**
+ * Tells plugins which parts of the config changed on reload. Each changed
+ * group gets a TOOLS_CORE_SIG_CONF_CHANGED emission detailed with its name,
+ * followed by a single TOOLS_CORE_SIG_CONF_RELOAD.
+ *
+ * @param[in]  state       Service state.
+ * @param[in]  diff        Changed groups, as returned by VMTools_ConfigDiff().
+ */
+
+static void
+ToolsCoreNotifyConfigChanges(ToolsServiceState *state,
+                             GHashTable *diff)
+{
+   guint sigId = g_signal_lookup(TOOLS_CORE_SIG_CONF_CHANGED,
+                                 G_OBJECT_TYPE(state->ctx.serviceObj));
+   GList *groups;
+   GList *l;
+
+   ASSERT(sigId != 0);
+
+   /* Sorted so plugins see the changes in a stable order. */
+   groups = g_list_sort(g_hash_table_get_keys(diff), (GCompareFunc) strcmp);
+   for (l = groups; l != NULL; l = l->next) {
+      const gchar *group = l->data;
+      gchar **keys = g_hash_table_lookup(diff, group);
+
+      g_debug("Config group '%s' changed (%u keys).\n", group,
+              g_strv_length(keys));
+      g_signal_emit(state->ctx.serviceObj,
+                    sigId,
+                    g_quark_from_string(group),
+                    &state->ctx,
+                    keys);
+   }
+   g_list_free(groups);
+
+   g_signal_emit_by_name(state->ctx.serviceObj,
+                         TOOLS_CORE_SIG_CONF_RELOAD,
+                         &state->ctx);
+}
+
+
 /**
  * Reloads the config file and re-configure the logging subsystem if the
- * log file was updated. If the config file is being loaded for the first
- * time, try to upgrade it to the new version if an old version is
+ * logging config was updated. If the config file is being loaded for the
+ * first time, try to upgrade it to the new version if an old version is
  * detected.
  *
+ * On reload, the new config is compared with the current one, and only the
+ * groups that changed are announced to plugins. A config file that was
+ * touched without changing its contents is not announced at all.
+ *
  * @param[in]  state       Service state.
  * @param[in]  reset       Whether to reset the logging subsystem.
  */
@@ -604,22 +1100,39 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
 {
    gboolean first = state->ctx.config == NULL;
    gboolean loaded;
+   gboolean logChanged = FALSE;
+   GKeyFile *config = NULL;
 
    loaded = VMTools_LoadConfig(state->configFile,
                                G_KEY_FILE_NONE,
-                               &state->ctx.config,
+                               &config,
                                &state->configMtime);
-
-   if (!first && loaded) {
-      g_debug("Config file reloaded.\n");
-
-      /*
-       * Inform plugins of config file update.
-       */
-      ASSERT(state->ctx.serviceObj != NULL);
-      g_signal_emit_by_name(state->ctx.serviceObj,
-                            TOOLS_CORE_SIG_CONF_RELOAD,
-                            &state->ctx);
+   if (first) {
+      ToolsCore_ProfileMark(state, "config load");
+      state->ctx.config = config;
+      logChanged = loaded;
+   } else if (loaded) {
+      GHashTable *diff = VMTools_ConfigDiff(state->ctx.config, config);
+
+      g_key_file_free(state->ctx.config);
+      state->ctx.config = config;
+
+      if (diff != NULL) {
+         g_debug("Config file reloaded.\n");
+         logChanged = g_hash_table_lookup(diff, CONFGROUPNAME_LOGGING) != NULL;
+         if (g_hash_table_lookup(diff, state->name) != NULL) {
+            ToolsCoreTimerWheelInit(state);
+         }
+
+         /*
+          * Inform plugins of config file update.
+          */
+         ASSERT(state->ctx.serviceObj != NULL);
+         ToolsCoreNotifyConfigChanges(state, diff);
+         g_hash_table_destroy(diff);
+      } else {
+         g_debug("Config file reloaded, no changes.\n");
+      }
    }
 
    if (state->ctx.config == NULL) {
@@ -627,7 +1140,7 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
       state->ctx.config = g_key_file_new();
    }
 
-   if (reset || loaded) {
+   if (reset || logChanged) {
       VMTools_ConfigLogging(state->name,
                             state->ctx.config,
                             TRUE,
@@ -640,6 +1153,9 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
        * However, reuse the RPC channel since it is not affected.
        */
       VMTools_SetupVmxGuestLog(FALSE, state->ctx.config, NULL);
+      if (first) {
+         ToolsCore_ProfileMark(state, "logging setup");
+      }
    }
 }
 
@@ -693,6 +1209,8 @@ ToolsCore_Setup(ToolsServiceState *state)
                                      &ctxProp);
    g_object_set(state->ctx.serviceObj, TOOLS_CORE_PROP_CTX, &state->ctx, NULL);
    ToolsCorePool_Init(&state->ctx);
+   ToolsCoreLoopMonitorInit(state);
+   ToolsCoreTimerWheelInit(state);
 
    /* Initializes the debug library if needed. */
    if (state->debugPlugin != NULL) {
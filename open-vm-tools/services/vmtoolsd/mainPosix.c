@@ -173,6 +173,7 @@ main(int argc,
    char **argvCopy;
    GSource *src;
 
+   ToolsCore_ProfileMark(&gState, "main");
    Unicode_Init(argc, &argv, NULL);
 
    /*
@@ -248,6 +249,7 @@ main(int argc,
    }
 
    ToolsCore_Setup(&gState);
+   ToolsCore_ProfileMark(&gState, "service setup");
 
    src = VMTools_NewSignalSource(SIGHUP);
    VMTOOLSAPP_ATTACH_SOURCE(&gState.ctx, src,
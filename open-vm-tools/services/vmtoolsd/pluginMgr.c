@@ -34,12 +34,46 @@
 #include "vmware/tools/utils.h"
 
 
+/**
+ * Defines what a plugin handles and how it is loaded, as read from its
+ * manifest, and the stubs registered in its place while its loading is
+ * deferred.
+ */
+typedef struct ToolsPluginManifest {
+   ToolsServiceState   *state;
+   gchar               *path;
+   gchar               *name;
+   gchar              **rpcs;
+   gchar              **signals;
+   gboolean             threadSafeLoad;
+   gchar              **loadAfter;
+   RpcChannelCallback  *rpcStubs;
+   GArray              *sigStubs;
+} ToolsPluginManifest;
+
+/** Progress of a plugin's ToolsOnLoad() call at startup. */
+typedef enum {
+   TOOLS_PLUGIN_LOAD_PENDING,
+   TOOLS_PLUGIN_LOAD_RUNNING,
+   TOOLS_PLUGIN_LOAD_DONE,
+   /* Loaded while the service was asked to quit, not to be registered. */
+   TOOLS_PLUGIN_LOAD_DISCARDED
+} ToolsPluginLoadState;
+
 /** Defines the internal data about a plugin. */
 typedef struct ToolsPlugin {
    gchar               *fileName;
    GModule             *module;
    ToolsPluginOnLoad    onload;
    ToolsPluginData     *data;
+   ToolsPluginManifest *manifest;
+   /* How the plugin is loaded at startup, from its manifest if it has one. */
+   gchar               *loadName;
+   gchar              **loadAfter;
+   gboolean             threadSafeLoad;
+   ToolsPluginLoadState loadState;
+   /* Set by ToolsCoreLoadFinished, under gLoadLock. */
+   gboolean             loadDiscarded;
 } ToolsPlugin;
 
 
@@ -47,6 +81,12 @@ typedef struct ToolsPlugin {
 static Bool (*LoadDependencies)(char *libName, Bool useShipped);
 #endif
 
+/* Where pool threads hand back the plugins they have loaded at startup. */
+static GAsyncQueue *gLoadDone;
+/* Protects the plugin that asked to quit while loading at startup. */
+static GMutex gLoadLock;
+static ToolsPlugin *gLoadQuitter;
+
 typedef void (*PluginDataCallback)(ToolsServiceState *state,
                                    ToolsPluginData *plugin);
 
@@ -56,6 +96,12 @@ typedef gboolean (*PluginAppRegCallback)(ToolsServiceState *state,
                                          ToolsAppProviderReg *preg,
                                          gpointer reg);
 
+static void
+ToolsCoreRemoveStubs(ToolsPlugin *plugin);
+
+static void
+ToolsCoreFreeManifest(ToolsPluginManifest *manifest);
+
 
 /**
  * State dump callback for application registration information.
@@ -147,7 +193,22 @@ ToolsCoreDumpRPC(ToolsAppCtx *ctx,
 {
    if (reg != NULL) {
       RpcChannelCallback *cb = reg;
-      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "RPC callback: %s\n", cb->name);
+      RpcChannelHandlerStats stats;
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "RPC callback: %s%s\n",
+                         cb->name,
+                         (cb->flags & RPCCHANNEL_FLAG_OFFLOAD) ? " (offload)" : "");
+      if (ctx->rpc != NULL &&
+          RpcChannel_GetHandlerStats(ctx->rpc, cb->name, &stats)) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                            "   calls: %"FMT64"u, offloaded: %"FMT64"u, "
+                            "avg: %"FMT64"u us, max: %"FMT64"u us, "
+                            "avg queue: %"FMT64"u us\n",
+                            stats.calls, stats.offloaded,
+                            stats.totalUs / stats.calls, stats.maxUs,
+                            stats.offloaded > 0 ?
+                               stats.queueUs / stats.offloaded : 0);
+      }
    }
 }
 
@@ -182,12 +243,18 @@ ToolsCoreDumpSignal(ToolsAppCtx *ctx,
 static void
 ToolsCoreFreePlugin(ToolsPlugin *plugin)
 {
+   if (plugin->manifest != NULL) {
+      ToolsCoreRemoveStubs(plugin);
+      ToolsCoreFreeManifest(plugin->manifest);
+   }
    if (plugin->module != NULL && !g_module_close(plugin->module)) {
       g_warning("Error unloading plugin '%s': %s\n",
                 plugin->fileName,
                 g_module_error());
    }
    g_free(plugin->fileName);
+   g_free(plugin->loadName);
+   g_strfreev(plugin->loadAfter);
    g_free(plugin);
 }
 
@@ -303,10 +370,77 @@ ToolsCoreRegisterProvider(ToolsServiceState *state,
 }
 
 
+/**
+ * Iterates through a plugin's app registration data, calling the given
+ * callback for each piece of data.
+ *
+ * @param[in]  state       Service state.
+ * @param[in]  plugin      The plugin.
+ * @param[in]  appRegCb    Callback called for each application registration.
+ */
+
+static void
+ToolsCoreForEachApp(ToolsServiceState *state,
+                    ToolsPlugin *plugin,
+                    PluginAppRegCallback appRegCb)
+{
+   GArray *regs = plugin->data->regs;
+   guint j;
+
+   if (regs == NULL) {
+      return;
+   }
+
+   for (j = 0; j < regs->len; j++) {
+      guint k;
+      guint pregIdx;
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
+      ToolsAppProviderReg *preg = NULL;
+
+      /* Find the provider for the desired reg type. */
+      for (k = 0; k < state->providers->len; k++) {
+         ToolsAppProviderReg *tmp = &g_array_index(state->providers,
+                                                   ToolsAppProviderReg,
+                                                   k);
+         if (tmp->prov->regType == reg->type) {
+            preg = tmp;
+            pregIdx = k;
+            break;
+         }
+      }
+
+      if (preg == NULL) {
+         g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
+                   reg->type, plugin->data->name);
+         if (plugin->data->errorCb != NULL &&
+             !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
+            break;
+         }
+         continue;
+      }
+
+      for (k = 0; k < reg->data->len; k++) {
+         gpointer appdata = &reg->data->data[preg->prov->regSize * k];
+         if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
+            /* Break out of the outer loop. */
+            j = regs->len;
+            break;
+         }
+
+         /*
+          * The registration callback may have modified the provider array,
+          * so we need to re-read the provider pointer.
+          */
+         preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
+      }
+   }
+}
+
+
 /**
  * Iterates through the list of plugins, and through each plugin's app
  * registration data, calling the appropriate callback for each piece
- * of data.
+ * of data. Plugins whose loading is deferred are skipped.
  *
  * One of the two callback arguments must be provided.
  *
@@ -326,59 +460,17 @@ ToolsCoreForEachPlugin(ToolsServiceState *state,
 
    for (i = 0; i < state->plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
-      GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
-      guint j;
-
-      if (pluginCb != NULL) {
-         pluginCb(state, plugin->data);
-      }
 
-      if (regs == NULL || appRegCb == NULL) {
+      if (plugin->data == NULL) {
          continue;
       }
 
-      for (j = 0; j < regs->len; j++) {
-         guint k;
-         guint pregIdx;
-         ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
-         ToolsAppProviderReg *preg = NULL;
-
-         /* Find the provider for the desired reg type. */
-         for (k = 0; k < state->providers->len; k++) {
-            ToolsAppProviderReg *tmp = &g_array_index(state->providers,
-                                                      ToolsAppProviderReg,
-                                                      k);
-            if (tmp->prov->regType == reg->type) {
-               preg = tmp;
-               pregIdx = k;
-               break;
-            }
-         }
-
-         if (preg == NULL) {
-            g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
-                      reg->type, plugin->data->name);
-            if (plugin->data->errorCb != NULL &&
-                !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
-               break;
-            }
-            continue;
-         }
-
-         for (k = 0; k < reg->data->len; k++) {
-            gpointer appdata = &reg->data->data[preg->prov->regSize * k];
-            if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
-               /* Break out of the outer loop. */
-               j = regs->len;
-               break;
-            }
+      if (pluginCb != NULL) {
+         pluginCb(state, plugin->data);
+      }
 
-            /*
-             * The registration callback may have modified the provider array,
-             * so we need to re-read the provider pointer.
-             */
-            preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
-         }
+      if (appRegCb != NULL) {
+         ToolsCoreForEachApp(state, plugin, appRegCb);
       }
    }
 }
@@ -488,18 +580,636 @@ ToolsCoreStrPtrCompare(gconstpointer _str1,
 }
 
 
+/**
+ * Reads the manifest of a plugin, if it has one. The manifest is a key file
+ * next to the plugin library, with the library suffix replaced by "manifest",
+ * listing the RPCs and signals the plugin handles, and how it can be loaded:
+ *
+ * @verbatim
+ * [plugin]
+ * name=deployPkg
+ * rpcs=deployPkg.begin;deployPkg.deploy;
+ * signals=
+ * threadSafeLoad=false
+ * after=
+ * @endverbatim
+ *
+ * A plugin that lists RPCs or signals is only loaded when one of those
+ * arrives. Otherwise, "threadSafeLoad" says whether its ToolsOnLoad() may
+ * run on a pool thread, concurrently with other plugins, and "after" names
+ * the plugins whose ToolsOnLoad() must have returned before it is called.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  path     Path to the plugin library.
+ *
+ * @return The manifest, or NULL if the plugin has none.
+ */
+
+static ToolsPluginManifest *
+ToolsCoreReadManifest(ToolsServiceState *state,
+                      const gchar *path)
+{
+   gchar *manifestPath;
+   GKeyFile *keyFile = NULL;
+   GError *err = NULL;
+   ToolsPluginManifest *manifest = NULL;
+
+   manifestPath = g_strdup_printf("%.*smanifest",
+                                  (int) (strlen(path) - strlen(G_MODULE_SUFFIX)),
+                                  path);
+   if (!g_file_test(manifestPath, G_FILE_TEST_IS_REGULAR)) {
+      goto exit;
+   }
+
+   keyFile = g_key_file_new();
+   if (!g_key_file_load_from_file(keyFile, manifestPath, G_KEY_FILE_NONE, &err)) {
+      g_warning("Error reading plugin manifest '%s': %s\n",
+                manifestPath, err->message);
+      g_clear_error(&err);
+      goto exit;
+   }
+
+   manifest = g_malloc0(sizeof *manifest);
+   manifest->state = state;
+   manifest->name = g_key_file_get_string(keyFile, "plugin", "name", NULL);
+   manifest->rpcs = g_key_file_get_string_list(keyFile, "plugin", "rpcs",
+                                               NULL, NULL);
+   manifest->signals = g_key_file_get_string_list(keyFile, "plugin", "signals",
+                                                  NULL, NULL);
+   manifest->threadSafeLoad = g_key_file_get_boolean(keyFile, "plugin",
+                                                     "threadSafeLoad", NULL);
+   manifest->loadAfter = g_key_file_get_string_list(keyFile, "plugin", "after",
+                                                    NULL, NULL);
+
+   if (manifest->name == NULL) {
+      g_warning("Plugin manifest '%s' has no name, ignoring it.\n",
+                manifestPath);
+      ToolsCoreFreeManifest(manifest);
+      manifest = NULL;
+      goto exit;
+   }
+
+   manifest->path = g_strdup(path);
+
+exit:
+   if (keyFile != NULL) {
+      g_key_file_free(keyFile);
+   }
+   g_free(manifestPath);
+   return manifest;
+}
+
+
+/**
+ * Opens a plugin library and looks up its entry point.
+ *
+ * @param[in]  path     Path to the plugin library.
+ * @param[in]  entry    File name of the plugin library, for logging.
+ * @param[out] onload   Where to store the plugin entry point.
+ *
+ * @return The module, or NULL on error.
+ */
+
+static GModule *
+ToolsCoreOpenModule(const gchar *path,
+                    const gchar *entry,
+                    ToolsPluginOnLoad *onload)
+{
+   GModule *module;
+
+#ifdef USE_APPLOADER
+   /* Trying loading the plugins with system libraries */
+   if (!LoadDependencies((char *) path, FALSE)) {
+      g_warning("Loading of library dependencies for %s failed.\n", entry);
+      return NULL;
+   }
+#endif
+
+   module = g_module_open(path, G_MODULE_BIND_LOCAL);
+#ifdef USE_APPLOADER
+   if (module == NULL) {
+      g_info("Opening plugin '%s' with system libraries failed: %s\n",
+                entry, g_module_error());
+      /* Falling back to the shipped libraries */
+      if (!LoadDependencies((char *) path, TRUE)) {
+         g_warning("Loading of shipped library dependencies for %s failed.\n",
+                  entry);
+         return NULL;
+      }
+      module = g_module_open(path, G_MODULE_BIND_LOCAL);
+   }
+#endif
+   if (module == NULL) {
+      g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
+      return NULL;
+   }
+
+   if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) onload)) {
+      g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
+      if (!g_module_close(module)) {
+         g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
+      }
+      return NULL;
+   }
+
+   return module;
+}
+
+
+/**
+ * Loads a plugin whose loading was deferred, and registers its applications
+ * in place of the stubs registered from its manifest.
+ *
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreLoadDeferred(ToolsPlugin *plugin)
+{
+   ToolsPluginManifest *manifest = plugin->manifest;
+   ToolsServiceState *state = manifest->state;
+   ToolsPluginOnLoad onload;
+
+   /* The plugin registers its own handlers under the same names. */
+   ToolsCoreRemoveStubs(plugin);
+   plugin->manifest = NULL;
+
+   g_message("Loading plugin '%s' on first use.\n", manifest->name);
+
+   plugin->module = ToolsCoreOpenModule(manifest->path, plugin->fileName,
+                                        &onload);
+   if (plugin->module != NULL) {
+      plugin->onload = onload;
+      plugin->data = onload(&state->ctx);
+   }
+
+   if (plugin->data == NULL) {
+      g_warning("Plugin '%s' failed to load.\n", manifest->name);
+      if (plugin->module != NULL && !g_module_close(plugin->module)) {
+         g_warning("Error unloading plugin '%s': %s\n",
+                   plugin->fileName, g_module_error());
+      }
+      plugin->module = NULL;
+   } else {
+      ASSERT(plugin->data->name != NULL);
+      g_module_make_resident(plugin->module);
+      VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
+      ToolsCoreForEachApp(state, plugin, ToolsCoreRegisterProvider);
+      ToolsCoreForEachApp(state, plugin, ToolsCoreRegisterApp);
+      g_message("Plugin '%s' initialized.\n", plugin->data->name);
+   }
+
+   ToolsCoreFreeManifest(manifest);
+}
+
+
+/**
+ * RPC stub of a plugin whose loading is deferred: loads the plugin, then
+ * dispatches the RPC again so that it reaches the plugin's own handler.
+ *
+ * @param[in]  data     RPC data.
+ *
+ * @return The result of the plugin's handler.
+ */
+
+static gboolean
+ToolsCoreDeferredRpc(RpcInData *data)
+{
+   ToolsPlugin *plugin = data->clientData;
+   ToolsAppCtx *ctx = data->appCtx;
+   size_t nameLen = strlen(data->name);
+
+   if (plugin->manifest != NULL) {
+      ToolsCoreLoadDeferred(plugin);
+   }
+
+   if (plugin->data == NULL) {
+      return RPCIN_SETRETVALS(data, "Plugin failed to load", FALSE);
+   }
+
+   /* Undo the argument adjustments of RpcChannel_Dispatch(). */
+   data->args -= nameLen;
+   data->argsSize += nameLen;
+   data->clientData = ctx->rpc;
+   return RpcChannel_Dispatch(data);
+}
+
+
+/**
+ * Signal stub of a plugin whose loading is deferred: loads the plugin, and
+ * runs the plugin's handlers for the signal being emitted, since handlers
+ * connected during an emission only see the following ones.
+ *
+ * @param[in]  closure        The stub closure.
+ * @param[out] returnValue    Signal return value.
+ * @param[in]  nParams        Number of signal parameters.
+ * @param[in]  params         Signal parameters.
+ * @param[in]  hint           Signal invocation hint.
+ * @param[in]  marshalData    Unused.
+ */
+
+static void
+ToolsCoreDeferredSignal(GClosure *closure,
+                        GValue *returnValue,
+                        guint nParams,
+                        const GValue *params,
+                        gpointer hint,
+                        gpointer marshalData)
+{
+   ToolsPlugin *plugin = closure->data;
+   GSignalInvocationHint *ihint = hint;
+   GSignalQuery query;
+   GArray *regs;
+   guint i;
+
+   if (plugin->manifest != NULL) {
+      ToolsCoreLoadDeferred(plugin);
+   }
+
+   if (plugin->data == NULL || plugin->data->regs == NULL) {
+      return;
+   }
+
+   g_signal_query(ihint->signal_id, &query);
+   regs = plugin->data->regs;
+   for (i = 0; i < regs->len; i++) {
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, i);
+      guint j;
+
+      if (reg->type != TOOLS_APP_SIGNALS) {
+         continue;
+      }
+
+      for (j = 0; j < reg->data->len; j++) {
+         ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                   ToolsPluginSignalCb,
+                                                   j);
+         GClosure *cb;
+         guint sigId;
+         GQuark sigDetail;
+
+         /* Handlers of a detailed signal only run for their detail. */
+         if (!g_signal_parse_name(sig->signame, query.itype,
+                                  &sigId, &sigDetail, FALSE) ||
+             sigId != ihint->signal_id ||
+             (sigDetail != 0 && sigDetail != ihint->detail)) {
+            continue;
+         }
+
+         cb = g_cclosure_new(sig->callback, sig->clientData, NULL);
+         g_closure_set_marshal(cb, g_cclosure_marshal_generic);
+         g_closure_ref(cb);
+         g_closure_sink(cb);
+         g_closure_invoke(cb, returnValue, nParams, params, hint);
+         g_closure_unref(cb);
+      }
+   }
+}
+
+
+/**
+ * Registers the RPC and signal stubs of a plugin whose loading is deferred.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreAddStubs(ToolsServiceState *state,
+                  ToolsPlugin *plugin)
+{
+   ToolsPluginManifest *manifest = plugin->manifest;
+   guint i;
+
+   if (state->ctx.rpc != NULL && manifest->rpcs != NULL) {
+      manifest->rpcStubs = g_new0(RpcChannelCallback,
+                                  g_strv_length(manifest->rpcs));
+      for (i = 0; manifest->rpcs[i] != NULL; i++) {
+         RpcChannelCallback *rpc = &manifest->rpcStubs[i];
+
+         rpc->name = manifest->rpcs[i];
+         rpc->callback = ToolsCoreDeferredRpc;
+         rpc->clientData = plugin;
+         RpcChannel_RegisterCallback(state->ctx.rpc, rpc);
+      }
+   }
+
+   manifest->sigStubs = g_array_new(FALSE, FALSE, sizeof (gulong));
+   for (i = 0; manifest->signals != NULL && manifest->signals[i] != NULL; i++) {
+      GClosure *closure;
+      gulong id;
+      guint sigId;
+      GQuark sigDetail;
+
+      if (!g_signal_parse_name(manifest->signals[i],
+                               G_OBJECT_TYPE(state->ctx.serviceObj),
+                               &sigId,
+                               &sigDetail,
+                               FALSE)) {
+         g_debug("Plugin '%s' unable to connect to signal '%s'.\n",
+                 manifest->name, manifest->signals[i]);
+         continue;
+      }
+
+      closure = g_closure_new_simple(sizeof *closure, plugin);
+      g_closure_set_marshal(closure, ToolsCoreDeferredSignal);
+      id = g_signal_connect_closure(state->ctx.serviceObj,
+                                    manifest->signals[i],
+                                    closure,
+                                    FALSE);
+      g_array_append_val(manifest->sigStubs, id);
+   }
+}
+
+
+/**
+ * Unregisters the RPC and signal stubs of a plugin whose loading is deferred.
+ *
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreRemoveStubs(ToolsPlugin *plugin)
+{
+   ToolsPluginManifest *manifest = plugin->manifest;
+   ToolsServiceState *state = manifest->state;
+   guint i;
+
+   if (manifest->rpcStubs != NULL) {
+      for (i = 0; state->ctx.rpc != NULL && manifest->rpcs[i] != NULL; i++) {
+         RpcChannel_UnregisterCallback(state->ctx.rpc, &manifest->rpcStubs[i]);
+      }
+      g_free(manifest->rpcStubs);
+      manifest->rpcStubs = NULL;
+   }
+
+   if (manifest->sigStubs != NULL) {
+      for (i = 0; i < manifest->sigStubs->len; i++) {
+         g_signal_handler_disconnect(state->ctx.serviceObj,
+                                     g_array_index(manifest->sigStubs, gulong, i));
+      }
+      g_array_free(manifest->sigStubs, TRUE);
+      manifest->sigStubs = NULL;
+   }
+}
+
+
+/**
+ * Frees a plugin manifest. Its stubs must have been unregistered.
+ *
+ * @param[in]  manifest The manifest.
+ */
+
+static void
+ToolsCoreFreeManifest(ToolsPluginManifest *manifest)
+{
+   ASSERT(manifest->rpcStubs == NULL && manifest->sigStubs == NULL);
+   g_free(manifest->path);
+   g_free(manifest->name);
+   g_strfreev(manifest->rpcs);
+   g_strfreev(manifest->signals);
+   g_strfreev(manifest->loadAfter);
+   g_free(manifest);
+}
+
+
+/**
+ * Tells whether the loading of a plugin can be deferred until first use,
+ * which requires its manifest to list what it handles.
+ *
+ * @param[in]  manifest The plugin's manifest.
+ *
+ * @return Whether the manifest lists any RPC or signal.
+ */
+
+static gboolean
+ToolsCoreCanDefer(ToolsPluginManifest *manifest)
+{
+   return (manifest->rpcs != NULL && manifest->rpcs[0] != NULL) ||
+          (manifest->signals != NULL && manifest->signals[0] != NULL);
+}
+
+
+/**
+ * Records the outcome of a plugin's ToolsOnLoad() call, on the thread that
+ * made it. A plugin that reported an error from that thread is the one that
+ * asked the service to quit; any other plugin finishing once the service
+ * has been asked to quit is discarded.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreLoadFinished(ToolsAppCtx *ctx,
+                      ToolsPlugin *plugin)
+{
+   g_mutex_lock(&gLoadLock);
+   if (g_atomic_int_get(&ctx->errorCode) != 0) {
+      if (gLoadQuitter == NULL &&
+          g_atomic_pointer_get(&ctx->errorThread) == g_thread_self()) {
+         gLoadQuitter = plugin;
+      }
+      plugin->loadDiscarded = TRUE;
+   }
+   g_mutex_unlock(&gLoadLock);
+}
+
+
+/**
+ * Thread pool task that calls the entry point of a plugin whose load is
+ * thread-safe, and hands the plugin back to the main thread.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  data     The plugin.
+ */
+
+static void
+ToolsCoreLoadTask(ToolsAppCtx *ctx,
+                  gpointer data)
+{
+   ToolsPlugin *plugin = data;
+
+   plugin->data = plugin->onload(ctx);
+   ToolsCoreLoadFinished(ctx, plugin);
+   g_async_queue_push(gLoadDone, plugin);
+}
+
+
+/**
+ * Tells whether the plugins a plugin must be loaded after are all loaded.
+ * Names that match no plugin being loaded at startup are ignored.
+ *
+ * @param[in]  plugins  The plugins being loaded.
+ * @param[in]  plugin   The plugin to check.
+ *
+ * @return Whether the plugin can be loaded now.
+ */
+
+static gboolean
+ToolsCoreLoadReady(GPtrArray *plugins,
+                   ToolsPlugin *plugin)
+{
+   guint i;
+   guint j;
+
+   for (i = 0; plugin->loadAfter != NULL && plugin->loadAfter[i] != NULL; i++) {
+      for (j = 0; j < plugins->len; j++) {
+         ToolsPlugin *other = g_ptr_array_index(plugins, j);
+
+         if ((other->loadState == TOOLS_PLUGIN_LOAD_PENDING ||
+              other->loadState == TOOLS_PLUGIN_LOAD_RUNNING) &&
+             g_strcmp0(other->loadName, plugin->loadAfter[i]) == 0) {
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Calls the entry points of the plugins loaded at startup. Plugins whose
+ * load is thread-safe are loaded on the shared thread pool, concurrently
+ * with each other and with the remaining plugins, which are loaded on the
+ * main thread in order. A plugin is only loaded once the plugins named in
+ * its manifest's "after" list are.
+ *
+ * No new plugin is loaded after one has asked the service to quit, and the
+ * plugins whose load finishes after that are not to be registered.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugins  The plugins to load; deferred plugins are skipped.
+ *
+ * @return The plugin that asked the service to quit, if any.
+ */
+
+static ToolsPlugin *
+ToolsCoreCallOnLoad(ToolsServiceState *state,
+                    GPtrArray *plugins)
+{
+   guint i;
+   guint running = 0;
+   gboolean parallel;
+   gboolean ignoreAfter = FALSE;
+   ToolsPlugin *quitter;
+   GError *err = NULL;
+
+   parallel = g_key_file_get_boolean(state->ctx.config, state->name,
+                                     "plugins.parallelLoad", &err);
+   if (err != NULL) {
+      parallel = TRUE;
+      g_clear_error(&err);
+   }
+
+   /*
+    * Without worker threads, pool tasks run from the main loop, which
+    * cannot run while the main thread waits for them.
+    */
+   parallel = parallel && ToolsCorePool_HasWorkers();
+   gLoadDone = g_async_queue_new();
+
+   while (TRUE) {
+      ToolsPlugin *plugin;
+      ToolsPlugin *next = NULL;
+
+      if (running > 0) {
+         plugin = g_async_queue_try_pop(gLoadDone);
+      } else {
+         plugin = NULL;
+      }
+
+      if (plugin == NULL && g_atomic_int_get(&state->ctx.errorCode) == 0) {
+         for (i = 0; i < plugins->len; i++) {
+            ToolsPlugin *p = g_ptr_array_index(plugins, i);
+
+            if (p->manifest != NULL ||
+                p->loadState != TOOLS_PLUGIN_LOAD_PENDING ||
+                !(ignoreAfter || ToolsCoreLoadReady(plugins, p))) {
+               continue;
+            }
+
+            if (parallel && p->threadSafeLoad &&
+                ToolsCorePool_SubmitTaskPrio(&state->ctx,
+                                             TOOLS_CORE_POOL_PRIO_LATENCY,
+                                             ToolsCoreLoadTask, p, NULL) != 0) {
+               p->loadState = TOOLS_PLUGIN_LOAD_RUNNING;
+               running++;
+            } else if (next == NULL) {
+               next = p;
+            }
+         }
+
+         if (next != NULL) {
+            next->loadState = TOOLS_PLUGIN_LOAD_RUNNING;
+            next->data = next->onload(&state->ctx);
+            ToolsCoreLoadFinished(&state->ctx, next);
+            plugin = next;
+         }
+      }
+
+      if (plugin == NULL && running > 0) {
+         plugin = g_async_queue_pop(gLoadDone);
+      }
+
+      if (plugin != NULL) {
+         if (plugin != next) {
+            running--;
+         }
+         plugin->loadState = plugin->loadDiscarded ?
+                             TOOLS_PLUGIN_LOAD_DISCARDED :
+                             TOOLS_PLUGIN_LOAD_DONE;
+         ToolsCore_ProfileMark(state, "%s: ToolsOnLoad", plugin->fileName);
+         continue;
+      }
+
+      /* Nothing is running, and nothing can start. */
+      if (g_atomic_int_get(&state->ctx.errorCode) == 0 && !ignoreAfter) {
+         for (i = 0; i < plugins->len; i++) {
+            ToolsPlugin *p = g_ptr_array_index(plugins, i);
+            if (p->manifest == NULL &&
+                p->loadState == TOOLS_PLUGIN_LOAD_PENDING) {
+               g_warning("Plugin '%s' waits for a plugin that cannot load "
+                         "before it, ignoring load order.\n", p->fileName);
+               ignoreAfter = TRUE;
+               break;
+            }
+         }
+         if (ignoreAfter) {
+            continue;
+         }
+      }
+      break;
+   }
+
+   g_async_queue_unref(gLoadDone);
+   gLoadDone = NULL;
+
+   g_mutex_lock(&gLoadLock);
+   quitter = gLoadQuitter;
+   gLoadQuitter = NULL;
+   g_mutex_unlock(&gLoadLock);
+
+   return quitter;
+}
+
+
 /**
  * Loads all the plugins found in the given directory, adding the registration
- * data to the given array.
+ * data to the given array. Plugins whose manifest lists what they handle are
+ * only added, to be loaded on first use, if deferred loading is enabled.
  *
- * @param[in]  ctx         Application context.
+ * @param[in]  state       The service state.
  * @param[in]  pluginPath  Path where to look for plugins.
+ * @param[in]  deferLoad   Whether plugins with a manifest are loaded on demand.
  * @param[out] regs        Array where to store plugin registration info.
  */
 
 static gboolean
-ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
+ToolsCoreLoadDirectory(ToolsServiceState *state,
                        const gchar *pluginPath,
+                       gboolean deferLoad,
                        GPtrArray *regs)
 {
    gboolean ret = FALSE;
@@ -536,7 +1246,8 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
       gchar *path;
       GModule *module = NULL;
       ToolsPlugin *plugin = NULL;
-      ToolsPluginOnLoad onload;
+      ToolsPluginManifest *manifest = NULL;
+      ToolsPluginOnLoad onload = NULL;
 
       entry = g_ptr_array_index(plugins, i);
       path = g_strdup_printf("%s%c%s", pluginPath, DIRSEPC, entry);
@@ -546,52 +1257,39 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
          goto next;
       }
 
-#ifdef USE_APPLOADER
-      /* Trying loading the plugins with system libraries */
-      if (!LoadDependencies(path, FALSE)) {
-         g_warning("Loading of library dependencies for %s failed.\n", entry);
-         goto next;
-      }
-#endif
+      manifest = ToolsCoreReadManifest(state, path);
 
-      module = g_module_open(path, G_MODULE_BIND_LOCAL);
-#ifdef USE_APPLOADER
-      if (module == NULL) {
-         g_info("Opening plugin '%s' with system libraries failed: %s\n",
-                   entry, g_module_error());
-         /* Falling back to the shipped libraries */
-         if (!LoadDependencies(path, TRUE)) {
-            g_warning("Loading of shipped library dependencies for %s failed.\n",
-                     entry);
+      if (manifest == NULL || !deferLoad || !ToolsCoreCanDefer(manifest)) {
+         module = ToolsCoreOpenModule(path, entry, &onload);
+         if (module == NULL) {
+            if (manifest != NULL) {
+               ToolsCoreFreeManifest(manifest);
+            }
             goto next;
          }
-         module = g_module_open(path, G_MODULE_BIND_LOCAL);
-      }
-#endif
-      if (module == NULL) {
-         g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
-         goto next;
+         ToolsCore_ProfileMark(state, "%s: dlopen", entry);
       }
 
-      if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) &onload)) {
-         g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
-         goto next;
-      }
-
-      plugin = g_malloc(sizeof *plugin);
+      plugin = g_malloc0(sizeof *plugin);
       plugin->fileName = entry;
-      plugin->data = NULL;
       plugin->module = module;
       plugin->onload = onload;
+
+      if (module == NULL) {
+         plugin->manifest = manifest;
+      } else if (manifest != NULL) {
+         /* Only the load options are needed from the manifest. */
+         plugin->loadName = manifest->name;
+         plugin->loadAfter = manifest->loadAfter;
+         plugin->threadSafeLoad = manifest->threadSafeLoad;
+         manifest->name = NULL;
+         manifest->loadAfter = NULL;
+         ToolsCoreFreeManifest(manifest);
+      }
       g_ptr_array_add(regs, plugin);
 
    next:
       g_free(path);
-      if (plugin == NULL && module != NULL) {
-         if (!g_module_close(module)) {
-            g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
-         }
-      }
    }
 
    g_ptr_array_free(plugins, TRUE);
@@ -611,10 +1309,34 @@ exit:
 void
 ToolsCore_DumpPluginInfo(ToolsServiceState *state)
 {
+   guint i;
+
    if (state->plugins == NULL) {
       g_message("   No plugins loaded.");
-   } else {
-      ToolsCoreForEachPlugin(state, ToolsCoreDumpPluginInfo, ToolsCoreDumpAppInfo);
+      return;
+   }
+
+   ToolsCoreForEachPlugin(state, ToolsCoreDumpPluginInfo, ToolsCoreDumpAppInfo);
+
+   for (i = 0; i < state->plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
+      ToolsPluginManifest *manifest = plugin->manifest;
+      guint j;
+
+      if (manifest == NULL) {
+         continue;
+      }
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "Plugin: %s (not loaded yet)\n", manifest->name);
+      for (j = 0; manifest->rpcs != NULL && manifest->rpcs[j] != NULL; j++) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "RPC callback: %s\n",
+                            manifest->rpcs[j]);
+      }
+      for (j = 0; manifest->signals != NULL && manifest->signals[j] != NULL; j++) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "Signal callback: %s\n",
+                            manifest->signals[j]);
+      }
    }
 }
 
@@ -633,10 +1355,13 @@ gboolean
 ToolsCore_LoadPlugins(ToolsServiceState *state)
 {
    gboolean pluginDirExists;
+   gboolean deferLoad;
    gboolean ret = FALSE;
    gchar *pluginRoot;
    guint i;
    GPtrArray *plugins = NULL;
+   ToolsPlugin *quitter;
+   GError *err = NULL;
 
 #if defined(sun) && defined(__x86_64__)
    const char *subdir = "/amd64";
@@ -673,6 +1398,17 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
 
    plugins = g_ptr_array_new();
 
+   /*
+    * Plugins whose manifest lists what they handle are loaded when first
+    * used, unless disabled in the config file.
+    */
+   deferLoad = g_key_file_get_boolean(state->ctx.config, state->name,
+                                      "plugins.deferLoad", &err);
+   if (err != NULL) {
+      deferLoad = TRUE;
+      g_clear_error(&err);
+   }
+
    /*
     * First, load plugins from the common directory. The common directory
     * is not required to exist unless provided on the command line.
@@ -689,7 +1425,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (g_file_test(state->commonPath, G_FILE_TEST_IS_DIR) &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->commonPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->commonPath, deferLoad, plugins)) {
       goto exit;
    }
 
@@ -713,30 +1449,45 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (pluginDirExists &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->pluginPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->pluginPath, deferLoad,
+                               plugins)) {
       goto exit;
    }
 
 
    /*
-    * All plugins are loaded, now initialize them.
+    * All plugins are loaded, now initialize them. Plugins may finish
+    * initializing in any order, but are kept in load order, which is the
+    * order their applications are registered in.
     */
 
+   quitter = ToolsCoreCallOnLoad(state, plugins);
    state->plugins = g_ptr_array_new();
 
    for (i = 0; i < plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
 
-      plugin->data = plugin->onload(&state->ctx);
+      if (plugin->manifest != NULL) {
+         g_ptr_array_add(state->plugins, plugin);
+         g_message("Plugin '%s' will be loaded on first use.\n",
+                   plugin->manifest->name);
+         continue;
+      }
 
-      if (plugin->data == NULL) {
+      if (plugin->loadState != TOOLS_PLUGIN_LOAD_DONE) {
+         /*
+          * Not loaded, or loaded after a plugin has requested the container
+          * to quit.
+          */
+         if (plugin == quitter) {
+            g_message("Plugin '%s' requested the service to quit.\n",
+                      plugin->fileName);
+         }
+         ToolsCoreFreePlugin(plugin);
+      } else if (plugin->data == NULL) {
          g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
                 plugin->fileName);
          ToolsCoreFreePlugin(plugin);
-      } else if (state->ctx.errorCode != 0) {
-         /* Break early if a plugin has requested the container to quit. */
-         ToolsCoreFreePlugin(plugin);
-         break;
       } else {
          ASSERT(plugin->data->name != NULL);
          g_module_make_resident(plugin->module);
@@ -753,9 +1504,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
     */
    if (state->debugData != NULL && state->debugData->debugPlugin->plugin != NULL) {
       ToolsPluginData *data = state->debugData->debugPlugin->plugin;
-      ToolsPlugin *plugin = g_malloc(sizeof *plugin);
-      plugin->fileName = NULL;
-      plugin->module = NULL;
+      ToolsPlugin *plugin = g_malloc0(sizeof *plugin);
       plugin->data = data;
       VMTools_BindTextDomain(data->name, NULL, NULL);
       g_ptr_array_add(state->plugins, plugin);
@@ -781,6 +1530,7 @@ exit:
 void
 ToolsCore_RegisterPlugins(ToolsServiceState *state)
 {
+   guint i;
    ToolsAppProvider *fakeProv;
    ToolsAppProviderReg fakeReg;
 
@@ -852,6 +1602,14 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
     * individual app providers as necessary.
     */
    ToolsCoreForEachPlugin(state, NULL, ToolsCoreRegisterApp);
+
+   /* Finally, stand in for the plugins whose loading is deferred. */
+   for (i = 0; i < state->plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
+      if (plugin->manifest != NULL) {
+         ToolsCoreAddStubs(state, plugin);
+      }
+   }
 }
 
 
@@ -877,6 +1635,14 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
       return;
    }
 
+   /* Plugins that were never used need no shutdown: drop their stubs. */
+   for (i = 0; i < state->plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
+      if (plugin->manifest != NULL) {
+         ToolsCoreRemoveStubs(plugin);
+      }
+   }
+
    /* 
     * Signal handlers in some plugins may require RPC Channel. Therefore, we don't
     * emit the signal if RPC channel is not available. See PR 1798412 for details.
@@ -923,7 +1689,8 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
       GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
 
       g_message("Unloading plugin '%s'.\n",
-                plugin->data != NULL ? plugin->data->name : "unknown");
+                plugin->data != NULL ? plugin->data->name :
+                plugin->manifest != NULL ? plugin->manifest->name : "unknown");
 
       if (regs != NULL) {
          guint i;
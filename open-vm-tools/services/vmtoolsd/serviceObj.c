@@ -336,6 +336,17 @@ ToolsCore_Service_class_init(gpointer _klass,
                 G_TYPE_NONE,
                 1,
                 G_TYPE_POINTER);
+   g_signal_new(TOOLS_CORE_SIG_CONF_CHANGED,
+                G_OBJECT_CLASS_TYPE(klass),
+                G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                0,
+                NULL,
+                NULL,
+                g_cclosure_user_marshal_VOID__POINTER_POINTER,
+                G_TYPE_NONE,
+                2,
+                G_TYPE_POINTER,
+                G_TYPE_POINTER);
    g_signal_new(TOOLS_CORE_SIG_DUMP_STATE,
                 G_OBJECT_CLASS_TYPE(klass),
                 G_SIGNAL_RUN_LAST,
@@ -0,0 +1,172 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file startupProfile.c
+ *
+ * Records a timeline of the service startup, from main() until the first
+ * capability registration, when the host considers the tools ready. The
+ * timeline is logged when startup is done, and on every state dump.
+ */
+
+#include "toolsCoreInt.h"
+#include "vmware/tools/log.h"
+
+/** A point in the startup timeline, recorded when a step ends. */
+typedef struct ToolsStartupMark {
+   gint64   time;
+   gchar   *label;
+} ToolsStartupMark;
+
+
+/**
+ * Logs the startup timeline, one step per line, with the time since the
+ * start of the service and the time the step took.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  level    Level for ToolsCore_LogState(), or -1 to log to the
+ *                      service log.
+ */
+
+static void
+ToolsCoreLogProfile(ToolsServiceState *state,
+                    gint level)
+{
+   guint i;
+   gint64 prev = state->startTime;
+
+   for (i = 0; i < state->startupMarks->len; i++) {
+      ToolsStartupMark *mark = &g_array_index(state->startupMarks,
+                                              ToolsStartupMark, i);
+      gdouble sinceStart = (mark->time - state->startTime) / 1000.0;
+      gdouble step = (mark->time - prev) / 1000.0;
+
+      if (level < 0) {
+         g_info("Startup: %9.3f ms %9.3f ms  %s\n", sinceStart, step,
+                mark->label);
+      } else {
+         ToolsCore_LogState(level, "%9.3f ms %9.3f ms  %s\n", sinceStart, step,
+                            mark->label);
+      }
+      prev = mark->time;
+   }
+}
+
+
+/**
+ * Records the end of a startup step. The first call marks the start of the
+ * service. Does nothing once startup is done.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  fmt      Format string for the step's description.
+ * @param[in]  ...      Arguments for the format string.
+ */
+
+void
+ToolsCore_ProfileMark(ToolsServiceState *state,
+                      const gchar *fmt,
+                      ...)
+{
+   ToolsStartupMark mark;
+   va_list args;
+
+   if (state->startupDone) {
+      return;
+   }
+
+   mark.time = g_get_monotonic_time();
+   if (state->startupMarks == NULL) {
+      state->startupMarks = g_array_new(FALSE, FALSE, sizeof mark);
+      state->startTime = mark.time;
+   }
+
+   va_start(args, fmt);
+   mark.label = g_strdup_vprintf(fmt, args);
+   va_end(args);
+
+   g_array_append_val(state->startupMarks, mark);
+}
+
+
+/**
+ * Records that the service is ready, and logs the startup timeline. The
+ * total is logged as a message, the individual steps at the "info" level.
+ *
+ * @param[in]  state    The service state.
+ */
+
+void
+ToolsCore_ProfileReady(ToolsServiceState *state)
+{
+   ToolsStartupMark *last;
+
+   if (state->startupDone || state->startupMarks == NULL) {
+      return;
+   }
+
+   ToolsCore_ProfileMark(state, "capabilities registered");
+   state->startupDone = TRUE;
+
+   last = &g_array_index(state->startupMarks, ToolsStartupMark,
+                         state->startupMarks->len - 1);
+   g_message("Startup: ready %.3f ms after start.\n",
+             (last->time - state->startTime) / 1000.0);
+   ToolsCoreLogProfile(state, -1);
+}
+
+
+/**
+ * Logs the startup timeline as part of the service's state dump.
+ *
+ * @param[in]  state    The service state.
+ */
+
+void
+ToolsCore_DumpProfile(ToolsServiceState *state)
+{
+   if (state->startupMarks == NULL) {
+      return;
+   }
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER, "Startup timeline%s:\n",
+                      state->startupDone ? "" : " (not ready yet)");
+   ToolsCoreLogProfile(state, TOOLS_STATE_LOG_PLUGIN);
+}
+
+
+/**
+ * Frees the startup timeline.
+ *
+ * @param[in]  state    The service state.
+ */
+
+void
+ToolsCore_FreeProfile(ToolsServiceState *state)
+{
+   guint i;
+
+   if (state->startupMarks == NULL) {
+      return;
+   }
+
+   for (i = 0; i < state->startupMarks->len; i++) {
+      g_free(g_array_index(state->startupMarks, ToolsStartupMark, i).label);
+   }
+   g_array_free(state->startupMarks, TRUE);
+   state->startupMarks = NULL;
+}
@@ -20,6 +20,14 @@
  * @file threadPool.c
  *
  * Implementation of the shared thread pool defined in threadPool.h.
+ *
+ * Queued tasks live in one deque per worker thread, with one queue for each
+ * priority class. A worker runs the oldest task of its own deque, and steals
+ * the newest one from the other deques when its own is empty; latency-critical
+ * tasks from any deque are picked before background ones. The GThreadPool only
+ * provides the threads: each submitted task pushes one "run" request to it.
+ * Queued tasks are also indexed by ID, so that canceling a task does not need
+ * to search the deques.
  */
 
 #include <limits.h>
@@ -33,24 +41,39 @@
 #define DEFAULT_MAX_THREADS         5
 #define DEFAULT_MAX_UNUSED_THREADS  0
 
+typedef struct WorkerDeque {
+   GMutex         lock;
+   GQueue         tasks[TOOLS_CORE_POOL_PRIO_MAX];
+} WorkerDeque;
+
+
 typedef struct ThreadPoolState {
    ToolsCorePool  funcs;
    gboolean       active;
    ToolsAppCtx   *ctx;
    GThreadPool   *pool;
-   GQueue        *workQueue;
+   WorkerDeque   *deques;
+   guint          numDeques;
+   gint           nextDeque;
+   gint           nextSlot;
+   GHashTable    *tasks;
    GPtrArray     *threads;
    GMutex         lock;
    guint          nextWorkId;
+   ToolsCorePoolStats stats;
 } ThreadPoolState;
 
 
 typedef struct WorkerTask {
    guint             id;
    guint             srcId;
+   ToolsCorePoolPriority prio;
    ToolsCorePoolCb   cb;
    gpointer          data;
    GDestroyNotify    dtor;
+   gint64            queueTime;
+   WorkerDeque      *deque;
+   GList            *link;   /* Protected by deque->lock; NULL once claimed. */
 } WorkerTask;
 
 
@@ -66,38 +89,8 @@ typedef struct StandaloneTask {
 
 static ThreadPoolState gState;
 
-
-/*
- *******************************************************************************
- * ToolsCorePoolCompareTask --                                            */ /**
- *
- * Compares two WorkerTask instances.
- *
- * @param[in] p1  Pointer to WorkerTask.
- * @param[in] p2  Pointer to WorkerTask.
- *
- * @return > 0, 0, < 0  if p1's ID is less than, equal, or greater than p2's.
- *
- *******************************************************************************
- */
-
-static gint
-ToolsCorePoolCompareTask(gconstpointer p1,
-                         gconstpointer p2)
-{
-   const WorkerTask *t1 = p1;
-   const WorkerTask *t2 = p2;
-
-   if (t1 != NULL && t2 != NULL) {
-      return (t2->id - t1->id);
-   }
-
-   if (t1 == NULL && t2 == NULL) {
-      return 0;
-   }
-
-   return (t1 != NULL) ? -1 : 1;
-}
+/* Deque index + 1 of the pool thread, 0 for threads outside the pool. */
+static GPrivate gWorkerSlot = G_PRIVATE_INIT(NULL);
 
 
 /*
@@ -147,11 +140,46 @@ ToolsCorePoolDestroyTask(gpointer data)
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePoolTaskStarted --                                            */ /**
+ *
+ * Removes a task that is about to run from the task index, and accounts for
+ * the time it spent queued. Must be called with the state lock held.
+ *
+ * @param[in] work     The task.
+ * @param[in] stolen   Whether the task was taken from another worker's deque.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCorePoolTaskStarted(WorkerTask *work,
+                         gboolean stolen)
+{
+   guint64 waitUs = g_get_monotonic_time() - work->queueTime;
+
+   if (g_hash_table_lookup(gState.tasks, GUINT_TO_POINTER(work->id)) == work) {
+      g_hash_table_remove(gState.tasks, GUINT_TO_POINTER(work->id));
+   }
+
+   gState.stats.queued[work->prio]--;
+   gState.stats.started[work->prio]++;
+   gState.stats.waitUs[work->prio] += waitUs;
+   if (waitUs > gState.stats.maxWaitUs[work->prio]) {
+      gState.stats.maxWaitUs[work->prio] = waitUs;
+   }
+   if (stolen) {
+      gState.stats.steals++;
+   }
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePoolDoWork --                                                 */ /**
  *
- * Execute a work item.
+ * Execute a work item in the service's thread.
  *
  * @param[in] data   A WorkerTask.
  *
@@ -165,15 +193,9 @@ ToolsCorePoolDoWork(gpointer data)
 {
    WorkerTask *work = data;
 
-   /*
-    * In single threaded mode, remove the task being executed from the queue.
-    * In multi-threaded mode, the thread pool callback already did this.
-    */
-   if (gState.pool == NULL) {
-      g_mutex_lock(&gState.lock);
-      g_queue_remove(gState.workQueue, work);
-      g_mutex_unlock(&gState.lock);
-   }
+   g_mutex_lock(&gState.lock);
+   ToolsCorePoolTaskStarted(work, FALSE);
+   g_mutex_unlock(&gState.lock);
 
    work->cb(gState.ctx, work->data);
    return FALSE;
@@ -238,15 +260,84 @@ ToolsCorePoolRunThread(gpointer data)
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePoolEnqueue --                                                */ /**
+ *
+ * Adds a task to a worker deque: the caller's own deque when called from a
+ * pool thread, so that tasks spawning other tasks keep them local, or the
+ * next deque in round-robin order otherwise. Must be called with the state
+ * lock held, so that ToolsCorePoolCancel() cannot see a task that is indexed
+ * but not yet queued.
+ *
+ * @param[in] work   The task.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCorePoolEnqueue(WorkerTask *work)
+{
+   guint slot = GPOINTER_TO_UINT(g_private_get(&gWorkerSlot));
+   GQueue *queue;
+
+   if (slot == 0) {
+      slot = (guint) g_atomic_int_add(&gState.nextDeque, 1) % gState.numDeques;
+   } else {
+      slot = (slot - 1) % gState.numDeques;
+   }
+
+   work->deque = &gState.deques[slot];
+   queue = &work->deque->tasks[work->prio];
+
+   g_mutex_lock(&work->deque->lock);
+   g_queue_push_head(queue, work);
+   work->link = g_queue_peek_head_link(queue);
+   g_mutex_unlock(&work->deque->lock);
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePoolDequeue --                                                */ /**
+ *
+ * Removes a queued task from its deque, unless a worker already claimed it.
+ *
+ * @param[in] work   The task.
+ *
+ * @return Whether the task was still queued.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+ToolsCorePoolDequeue(WorkerTask *work)
+{
+   gboolean queued;
+
+   g_mutex_lock(&work->deque->lock);
+   queued = work->link != NULL;
+   if (queued) {
+      g_queue_delete_link(&work->deque->tasks[work->prio], work->link);
+      work->link = NULL;
+   }
+   g_mutex_unlock(&work->deque->lock);
+
+   return queued;
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePoolRunWorker --                                              */ /**
  *
- * Thread pool callback function. Dequeues the next work item from the work
- * queue and execute it.
+ * Thread pool callback function. Claims the next work item, looking at the
+ * worker's own deque first and stealing from the others if it's empty, and
+ * executes it. Finds nothing to do if the task this request was pushed for
+ * has been canceled.
  *
- * @param[in] state        Description of state.
- * @param[in] clientData   Description of clientData.
+ * @param[in] state        Unused.
+ * @param[in] clientData   Unused.
  *
  *******************************************************************************
  */
@@ -255,28 +346,56 @@ static void
 ToolsCorePoolRunWorker(gpointer state,
                        gpointer clientData)
 {
-   WorkerTask *work;
+   WorkerTask *work = NULL;
+   gboolean stolen = FALSE;
+   guint slot = GPOINTER_TO_UINT(g_private_get(&gWorkerSlot));
+   guint prio;
+
+   if (slot == 0) {
+      slot = (guint) g_atomic_int_add(&gState.nextSlot, 1) % gState.numDeques + 1;
+      g_private_set(&gWorkerSlot, GUINT_TO_POINTER(slot));
+   }
+
+   for (prio = 0; prio < TOOLS_CORE_POOL_PRIO_MAX && work == NULL; prio++) {
+      guint i;
+
+      for (i = 0; i < gState.numDeques && work == NULL; i++) {
+         WorkerDeque *deque = &gState.deques[(slot - 1 + i) % gState.numDeques];
+         GQueue *queue = &deque->tasks[prio];
+
+         g_mutex_lock(&deque->lock);
+         work = (i == 0) ? g_queue_pop_tail(queue) : g_queue_pop_head(queue);
+         if (work != NULL) {
+            work->link = NULL;
+            stolen = (i != 0);
+         }
+         g_mutex_unlock(&deque->lock);
+      }
+   }
+
+   if (work == NULL) {
+      return;
+   }
 
    g_mutex_lock(&gState.lock);
-   work = g_queue_pop_tail(gState.workQueue);
+   ToolsCorePoolTaskStarted(work, stolen);
    g_mutex_unlock(&gState.lock);
 
-   ASSERT(work != NULL);
-
-   ToolsCorePoolDoWork(work);
+   work->cb(gState.ctx, work->data);
    ToolsCorePoolDestroyTask(work);
 }
 
 
 /*
  *******************************************************************************
- * ToolsCorePoolSubmit --                                                 */ /**
+ * ToolsCorePoolSubmitPrio --                                             */ /**
  *
  * Submits a new task for execution in one of the shared worker threads.
  *
- * @see ToolsCorePool_SubmitTask()
+ * @see ToolsCorePool_SubmitTaskPrio()
  *
  * @param[in] ctx    Application context.
+ * @param[in] prio   Priority class of the task.
  * @param[in] cb     Function to execute the task.
  * @param[in] data   Opaque data for the task.
  * @param[in] dtor   Destructor for the task data.
@@ -287,15 +406,20 @@ ToolsCorePoolRunWorker(gpointer state,
  */
 
 static guint
-ToolsCorePoolSubmit(ToolsAppCtx *ctx,
-                    ToolsCorePoolCb cb,
-                    gpointer data,
-                    GDestroyNotify dtor)
+ToolsCorePoolSubmitPrio(ToolsAppCtx *ctx,
+                        ToolsCorePoolPriority prio,
+                        ToolsCorePoolCb cb,
+                        gpointer data,
+                        GDestroyNotify dtor)
 {
    guint id = 0;
-   WorkerTask *task = g_malloc0(sizeof *task);
+   WorkerTask *task;
 
+   g_return_val_if_fail(prio < TOOLS_CORE_POOL_PRIO_MAX, 0);
+
+   task = g_malloc0(sizeof *task);
    task->srcId = 0;
+   task->prio = prio;
    task->cb = cb;
    task->data = data;
    task->dtor = dtor;
@@ -308,44 +432,56 @@ ToolsCorePoolSubmit(ToolsAppCtx *ctx,
    }
 
    /*
-    * XXX: a reeeeeeeeeally long running task could cause clashes (e.g., reusing
-    * the same task ID after the counter wraps). That shouldn't really happen in
-    * practice (and is an abuse of the thread pool, and could cause issues if
-    * someone sets the pool size to 0 or 1), but it might be good to have more
-    * fail-safe code here.
+    * Skip IDs still used by queued tasks when the counter wraps, so that a
+    * reeeeeeeeeally long queued task cannot clash with a new one.
     */
-   if (gState.nextWorkId + 1 == UINT_MAX) {
-      task->id = UINT_MAX;
-      gState.nextWorkId = 0;
-   } else {
-      task->id = ++gState.nextWorkId;
-   }
+   do {
+      if (gState.nextWorkId + 1 == UINT_MAX) {
+         task->id = UINT_MAX;
+         gState.nextWorkId = 0;
+      } else {
+         task->id = ++gState.nextWorkId;
+      }
+   } while (g_hash_table_contains(gState.tasks, GUINT_TO_POINTER(task->id)));
 
    id = task->id;
+   task->queueTime = g_get_monotonic_time();
 
    /*
-    * We always add the task to the queue, even in single threaded mode, so
-    * that it can be canceled. In single threaded mode, it's unlikely someone
-    * will be able to cancel it before it runs, but they can try.
+    * We always index the task, even in single threaded mode, so that it can
+    * be canceled. In single threaded mode, it's unlikely someone will be able
+    * to cancel it before it runs, but they can try.
     */
-   g_queue_push_head(gState.workQueue, task);
+   g_hash_table_insert(gState.tasks, GUINT_TO_POINTER(id), task);
+   gState.stats.queued[prio]++;
+   if (gState.stats.queued[prio] > gState.stats.maxQueued[prio]) {
+      gState.stats.maxQueued[prio] = gState.stats.queued[prio];
+   }
 
    if (gState.pool != NULL) {
       GError *err = NULL;
 
+      ToolsCorePoolEnqueue(task);
+
       /* The client data pointer is bogus, just to avoid passing NULL. */
       g_thread_pool_push(gState.pool, &gState, &err);
       if (err == NULL) {
          goto exit;
-      } else {
-         g_warning("error sending work request, executing in service thread: %s",
-                   err->message);
-         g_clear_error(&err);
+      }
+
+      g_warning("error sending work request, executing in service thread: %s",
+                err->message);
+      g_clear_error(&err);
+
+      /* A worker with a leftover request may have claimed it meanwhile. */
+      if (!ToolsCorePoolDequeue(task)) {
+         goto exit;
       }
    }
 
    /* Run the task in the service's thread. */
-   task->srcId = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+   task->srcId = g_idle_add_full(prio == TOOLS_CORE_POOL_PRIO_LATENCY ?
+                                    G_PRIORITY_DEFAULT : G_PRIORITY_DEFAULT_IDLE,
                                  ToolsCorePoolDoWork,
                                  task,
                                  ToolsCorePoolDestroyTask);
@@ -356,6 +492,36 @@ exit:
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePoolSubmit --                                                 */ /**
+ *
+ * Submits a new background task for execution in one of the shared worker
+ * threads.
+ *
+ * @see ToolsCorePool_SubmitTask()
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] cb     Function to execute the task.
+ * @param[in] data   Opaque data for the task.
+ * @param[in] dtor   Destructor for the task data.
+ *
+ * @return New task's ID, or 0 on error.
+ *
+ *******************************************************************************
+ */
+
+static guint
+ToolsCorePoolSubmit(ToolsAppCtx *ctx,
+                    ToolsCorePoolCb cb,
+                    gpointer data,
+                    GDestroyNotify dtor)
+{
+   return ToolsCorePoolSubmitPrio(ctx, TOOLS_CORE_POOL_PRIO_BACKGROUND,
+                                  cb, data, dtor);
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePoolCancel --                                                 */ /**
@@ -372,9 +538,7 @@ exit:
 static void
 ToolsCorePoolCancel(guint id)
 {
-   GList *taskLnk;
    WorkerTask *task = NULL;
-   WorkerTask search = { id, };
 
    g_return_if_fail(id != 0);
 
@@ -383,12 +547,21 @@ ToolsCorePoolCancel(guint id)
       goto exit;
    }
 
-   taskLnk = g_queue_find_custom(gState.workQueue, &search, ToolsCorePoolCompareTask);
-   if (taskLnk != NULL) {
-      task = taskLnk->data;
-      g_queue_delete_link(gState.workQueue, taskLnk);
+   task = g_hash_table_lookup(gState.tasks, GUINT_TO_POINTER(id));
+   if (task == NULL) {
+      goto exit;
    }
 
+   /* A task claimed by a worker is running, and cannot be canceled. */
+   if (task->srcId == 0 && !ToolsCorePoolDequeue(task)) {
+      task = NULL;
+      goto exit;
+   }
+
+   g_hash_table_remove(gState.tasks, GUINT_TO_POINTER(id));
+   gState.stats.queued[task->prio]--;
+   gState.stats.canceled++;
+
 exit:
    g_mutex_unlock(&gState.lock);
 
@@ -478,6 +651,7 @@ exit:
 void
 ToolsCorePool_Init(ToolsAppCtx *ctx)
 {
+   guint i;
    gint maxThreads;
    GError *err = NULL;
 
@@ -486,6 +660,7 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
    gState.funcs.submit = ToolsCorePoolSubmit;
    gState.funcs.cancel = ToolsCorePoolCancel;
    gState.funcs.start = ToolsCorePoolStart;
+   gState.funcs.submitPrio = ToolsCorePoolSubmitPrio;
    gState.ctx = ctx;
 
    maxThreads = g_key_file_get_integer(ctx->config, ctx->name,
@@ -518,6 +693,12 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
 
          g_thread_pool_set_max_idle_time(maxIdleTime);
          g_thread_pool_set_max_unused_threads(maxUnused);
+
+         gState.numDeques = maxThreads;
+         gState.deques = g_new0(WorkerDeque, gState.numDeques);
+         for (i = 0; i < gState.numDeques; i++) {
+            g_mutex_init(&gState.deques[i].lock);
+         }
       } else {
          g_warning("error initializing thread pool, running single threaded: %s",
                    err->message);
@@ -528,7 +709,7 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
    gState.active = TRUE;
    g_mutex_init(&gState.lock);
    gState.threads = g_ptr_array_new();
-   gState.workQueue = g_queue_new();
+   gState.tasks = g_hash_table_new(NULL, NULL);
 
    ToolsCoreService_RegisterProperty(ctx->serviceObj, &prop);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, &gState.funcs, NULL);
@@ -577,20 +758,66 @@ ToolsCorePool_Shutdown(ToolsAppCtx *ctx)
    }
 
    /* Destroy all pending tasks. */
-   while (1) {
-      WorkerTask *task = g_queue_pop_tail(gState.workQueue);
-      if (task != NULL) {
-         ToolsCorePoolDestroyTask(task);
-      } else {
-         break;
+   for (i = 0; i < gState.numDeques; i++) {
+      WorkerDeque *deque = &gState.deques[i];
+      guint prio;
+
+      for (prio = 0; prio < TOOLS_CORE_POOL_PRIO_MAX; prio++) {
+         WorkerTask *task;
+
+         while ((task = g_queue_pop_tail(&deque->tasks[prio])) != NULL) {
+            ToolsCorePoolDestroyTask(task);
+         }
       }
+      g_mutex_clear(&deque->lock);
    }
 
    /* Cleanup. */
    g_ptr_array_free(gState.threads, TRUE);
-   g_queue_free(gState.workQueue);
+   g_hash_table_destroy(gState.tasks);
+   g_free(gState.deques);
    g_mutex_clear(&gState.lock);
    memset(&gState, 0, sizeof gState);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, NULL, NULL);
 }
 
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePool_HasWorkers --                                            */ /**
+ *
+ * Tells whether tasks submitted to the shared thread pool run on worker
+ * threads. When they don't, they run from the main loop, so the main thread
+ * must not block waiting for them.
+ *
+ * @return Whether the pool has worker threads.
+ *
+ *******************************************************************************
+ */
+
+gboolean
+ToolsCorePool_HasWorkers(void)
+{
+   return gState.pool != NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePool_GetStats --                                              */ /**
+ *
+ * Returns the queue depth and wait time counters of the shared thread pool.
+ *
+ * @param[out] stats   Where to store the counters.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCorePool_GetStats(ToolsCorePoolStats *stats)
+{
+   g_mutex_lock(&gState.lock);
+   *stats = gState.stats;
+   g_mutex_unlock(&gState.lock);
+}
@@ -34,6 +34,7 @@
 #include <time.h>
 #include "vmware/tools/plugin.h"
 #include "vmware/tools/rpcdebug.h"
+#include "vmware/tools/threadPool.h"
 
 /* Used by the Windows implementation to communicate with other processes. */
 #if defined(G_PLATFORM_WIN32)
@@ -67,6 +68,17 @@ typedef struct ToolsAppProviderReg {
    ToolsAppProviderState   state;
 } ToolsAppProviderReg;
 
+/** Queue depth and wait time counters of the shared thread pool. */
+typedef struct ToolsCorePoolStats {
+   guint          queued[TOOLS_CORE_POOL_PRIO_MAX];
+   guint          maxQueued[TOOLS_CORE_POOL_PRIO_MAX];
+   guint64        started[TOOLS_CORE_POOL_PRIO_MAX];
+   guint64        waitUs[TOOLS_CORE_POOL_PRIO_MAX];
+   guint64        maxWaitUs[TOOLS_CORE_POOL_PRIO_MAX];
+   guint64        steals;
+   guint64        canceled;
+} ToolsCorePoolStats;
+
 /** Defines internal service state. */
 typedef struct ToolsServiceState {
    gchar         *name;
@@ -99,6 +111,9 @@ typedef struct ToolsServiceState {
    int            vsockDev;
    int            vsockFamily;
 #endif
+   gint64         startTime;
+   GArray        *startupMarks;
+   gboolean       startupDone;
 } ToolsServiceState;
 
 
@@ -159,9 +174,29 @@ void
 ToolsCore_CFRunLoop(ToolsServiceState *state);
 #endif
 
+void
+ToolsCore_ProfileMark(ToolsServiceState *state,
+                      const gchar *fmt,
+                      ...) G_GNUC_PRINTF(2, 3);
+
+void
+ToolsCore_ProfileReady(ToolsServiceState *state);
+
+void
+ToolsCore_DumpProfile(ToolsServiceState *state);
+
+void
+ToolsCore_FreeProfile(ToolsServiceState *state);
+
 void
 ToolsCorePool_Init(ToolsAppCtx *ctx);
 
+void
+ToolsCorePool_GetStats(ToolsCorePoolStats *stats);
+
+gboolean
+ToolsCorePool_HasWorkers(void);
+
 void
 ToolsCorePool_Shutdown(ToolsAppCtx *ctx);
 
@@ -442,7 +442,8 @@ ScheduleCheckinTimer(ToolsAppCtx *ctx)
    ASSERT(NULL == state->checkinTimer);
    ASSERT(NULL != mainCtx);
 
-   eventSource = VMTools_CreateTimer(CHECKIN_INTERVAL * 1000);
+   eventSource = VMTools_CreateCoalescedTimer(CHECKIN_INTERVAL * 1000,
+                                              VMTOOLS_TIMER_DEFAULT_SLACK);
 
    if (NULL == eventSource) {
       return FALSE;
@@ -287,6 +287,7 @@ ToolsCoreRpcCapReg(RpcInData *data)
    }
 
    state->capsRegistered = TRUE;
+   ToolsCore_ProfileReady(state);
    free(confPath);
    return RPCIN_SETRETVALS(data, "", TRUE);
 }
@@ -337,6 +338,93 @@ ToolsCoreRpcSetOption(RpcInData *data)
 }
 
 
+/** An offloaded RPC handler, see ToolsCoreRpcOffload. */
+typedef struct ToolsCoreRpcWork {
+   RpcChannelWorkFunc   work;
+   gpointer             workData;
+   gboolean             ran;
+} ToolsCoreRpcWork;
+
+
+/**
+ * Runs an offloaded RPC handler on a pool thread.
+ *
+ * @param[in]  ctx      Unused.
+ * @param[in]  data     The handler to run.
+ */
+
+static void
+ToolsCoreRpcRunWork(ToolsAppCtx *ctx,
+                    gpointer data)
+{
+   ToolsCoreRpcWork *w = data;
+
+   w->ran = TRUE;
+   w->work(w->workData, TRUE);
+}
+
+
+/**
+ * Frees an offloaded RPC handler, failing the RPC if the pool dropped it
+ * without running it.
+ *
+ * @param[in]  data     The handler.
+ */
+
+static void
+ToolsCoreRpcFreeWork(gpointer data)
+{
+   ToolsCoreRpcWork *w = data;
+
+   if (!w->ran) {
+      w->work(w->workData, FALSE);
+   }
+   g_free(w);
+}
+
+
+/**
+ * Offload function of the RPC channel: runs the handlers flagged with
+ * RPCCHANNEL_FLAG_OFFLOAD as latency-critical pool tasks, so they don't
+ * block the main loop. When the pool has no worker threads they are run
+ * on the main loop as usual.
+ *
+ * @param[in]  work        The work to run.
+ * @param[in]  workData    Data for the work.
+ * @param[in]  data        The service state.
+ *
+ * @return Whether the work was taken.
+ */
+
+static gboolean
+ToolsCoreRpcOffload(RpcChannelWorkFunc work,
+                    gpointer workData,
+                    gpointer data)
+{
+   ToolsServiceState *state = data;
+   ToolsCoreRpcWork *w;
+
+   if (!ToolsCorePool_HasWorkers()) {
+      return FALSE;
+   }
+
+   w = g_new0(ToolsCoreRpcWork, 1);
+   w->work = work;
+   w->workData = workData;
+   if (ToolsCorePool_SubmitTaskPrio(&state->ctx,
+                                    TOOLS_CORE_POOL_PRIO_LATENCY,
+                                    ToolsCoreRpcRunWork,
+                                    w,
+                                    ToolsCoreRpcFreeWork) == 0) {
+      /* The pool is shutting down, fail the RPC rather than block on it. */
+      g_warning("Unable to offload an RPC handler.\n");
+      ToolsCoreRpcFreeWork(w);
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Initializes the RPC channel. Currently this instantiates an RpcIn loop.
  * This function should only be called once.
@@ -414,6 +502,7 @@ ToolsCore_InitRpc(ToolsServiceState *state)
                        state,
                        failureCb,
                        errorLimit);
+      RpcChannel_SetOffloadFunc(state->ctx.rpc, ToolsCoreRpcOffload, state);
 
       /* Register the "built in" RPCs. */
       for (i = 0; i < ARRAYSIZE(rpcs); i++) {
@@ -0,0 +1,494 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file benchRpc.c
+ *
+ * Measures the cost of guest RPCs in each layer of the stack, without a
+ * hypervisor: Message_Send/Message_Receive, RpcOut_send, the HGFS backdoor
+ * path and RpcChannel_Send. The first three run over the fake backdoor of
+ * fakeBackdoor.c; RpcChannel runs over the debug channel of vmrpcdbg, so
+ * it measures the channel's own overhead.
+ *
+ * For each layer and message size from 16 bytes to 64 KiB, prints the
+ * messages per second and the average, median and 99th percentile
+ * latency. With --trace, also prints the backdoor calls made per message
+ * and the share of the time spent in them, the rest being the guest
+ * layers' own work.
+ */
+
+#define G_LOG_DOMAIN "benchrpc"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "hgfs.h"
+#include "hgfsBd.h"
+#include "message.h"
+#include "rpcout.h"
+#include "util.h"
+#include "vmrpcdbgInt.h"
+#include "vmware/tools/guestrpc.h"
+#include "fakeBackdoor.h"
+
+#define BENCH_MIN_SIZE        16
+#define BENCH_MAX_SIZE        (64 * 1024)
+#define BENCH_DEFAULT_ITERS   10000
+
+typedef enum {
+   BENCH_MESSAGE,
+   BENCH_RPCOUT,
+   BENCH_RPCOUT_BUFFER,
+   BENCH_HGFS,
+   BENCH_HGFS_INPLACE,
+   BENCH_RPCCHANNEL,
+   BENCH_MAX
+} BenchLayer;
+
+static const char *gLayerNames[] = {
+   "message",
+   "rpcout",
+   "rpcout-buffer",
+   "hgfs",
+   "hgfs-inplace",
+   "rpcchannel",
+};
+
+/** State of the layer being measured. */
+typedef struct BenchState {
+   BenchLayer        layer;
+   size_t            size;
+   char             *request;
+   char             *replyBuf;
+   Message_Channel   msgChan;
+   gboolean          msgChanOpen;
+   RpcOut           *out;
+   char             *hgfsPacket;
+   RpcChannel       *chan;
+   ToolsAppCtx       ctx;
+   RpcDebugPlugin    plugin;
+   RpcDebugLibData   libData;
+} BenchState;
+
+static gint gIterations = BENCH_DEFAULT_ITERS;
+static gboolean gLegacy = FALSE;
+static gint gExitCostNs = 0;
+static gboolean gTrace = FALSE;
+static gchar *gLayers = NULL;
+
+
+/**
+ * Receive function of the debug plugin behind the RpcChannel layer: replies
+ * with the arguments of the request, like the fake backdoor host.
+ *
+ * @param[in]  data        Request, NUL terminated.
+ * @param[in]  dataLen     Request size.
+ * @param[out] result      Reply.
+ * @param[out] resultLen   Reply size.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+BenchEchoRecv(char *data,
+              size_t dataLen,
+              char **result,
+              size_t *resultLen)
+{
+   char *args = memchr(data, ' ', dataLen);
+   size_t argsLen = 0;
+
+   if (args != NULL) {
+      args++;
+      argsLen = dataLen - (args - data);
+   }
+
+   *result = Util_SafeMalloc(argsLen + 1);
+   memcpy(*result, args != NULL ? args : "", argsLen);
+   (*result)[argsLen] = '\0';
+   *resultLen = argsLen;
+   return TRUE;
+}
+
+
+/**
+ * Opens the channel of a layer and builds the request.
+ *
+ * @param[in,out] state    Benchmark state, with layer and size set.
+ *
+ * @return Whether the layer can run at this size.
+ */
+
+static gboolean
+BenchSetup(BenchState *state)
+{
+   size_t i;
+
+   state->request = g_malloc(state->size);
+   memcpy(state->request, "bench ", 6);
+   for (i = 6; i < state->size; i++) {
+      state->request[i] = 'a' + i % 26;
+   }
+
+   switch (state->layer) {
+   case BENCH_MESSAGE:
+      state->msgChanOpen = Message_OpenAllocated(RPCI_PROTOCOL_NUM,
+                                                 &state->msgChan, NULL, 0);
+      return state->msgChanOpen;
+
+   case BENCH_RPCOUT:
+   case BENCH_RPCOUT_BUFFER:
+      state->replyBuf = g_malloc(state->size + 3);
+      state->out = RpcOut_Construct();
+      return RpcOut_start(state->out);
+
+   case BENCH_HGFS:
+   case BENCH_HGFS_INPLACE:
+      /* The in-place reply also needs room for a NUL. */
+      if (state->size + 1 > HGFS_LARGE_PACKET_MAX) {
+         return FALSE;
+      }
+      state->hgfsPacket = HgfsBd_GetLargeBuf();
+      state->out = HgfsBd_GetChannel();
+      return state->hgfsPacket != NULL && state->out != NULL;
+
+   case BENCH_RPCCHANNEL:
+      state->ctx.name = "benchrpc";
+      state->ctx.mainLoop = g_main_loop_new(NULL, FALSE);
+      state->plugin.dfltRecvFn = BenchEchoRecv;
+      state->libData.debugPlugin = &state->plugin;
+      state->chan = RpcDebug_NewDebugChannel(&state->ctx, &state->libData);
+      RpcChannel_Setup(state->chan, state->ctx.name, g_main_context_default(),
+                       &state->ctx, NULL, NULL, NULL, 0);
+      return TRUE;
+
+   default:
+      NOT_REACHED();
+   }
+}
+
+
+/**
+ * Closes the channel of a layer.
+ *
+ * @param[in,out] state    Benchmark state.
+ */
+
+static void
+BenchTeardown(BenchState *state)
+{
+   switch (state->layer) {
+   case BENCH_MESSAGE:
+      if (state->msgChanOpen) {
+         Message_CloseAllocated(&state->msgChan);
+      }
+      break;
+
+   case BENCH_RPCOUT:
+   case BENCH_RPCOUT_BUFFER:
+      RpcOut_stop(state->out);
+      RpcOut_Destruct(state->out);
+      break;
+
+   case BENCH_HGFS:
+   case BENCH_HGFS_INPLACE:
+      if (state->out != NULL) {
+         HgfsBd_CloseChannel(state->out);
+      }
+      if (state->hgfsPacket != NULL) {
+         HgfsBd_PutBuf(state->hgfsPacket);
+      }
+      break;
+
+   case BENCH_RPCCHANNEL:
+      RpcChannel_Destroy(state->chan);
+      g_main_loop_unref(state->ctx.mainLoop);
+      break;
+
+   default:
+      NOT_REACHED();
+   }
+
+   g_free(state->replyBuf);
+   g_free(state->request);
+   memset(state, 0, sizeof *state);
+}
+
+
+/**
+ * Sends one request through a layer and receives its reply.
+ *
+ * @param[in,out] state    Benchmark state.
+ *
+ * @return Whether the round trip succeeded with a reply of the right size.
+ */
+
+static gboolean
+BenchRoundTrip(BenchState *state)
+{
+   size_t expected = state->size - 6;
+   Bool rpcStatus;
+   char const *reply;
+   size_t replyLen = 0;
+   gboolean ok;
+
+   switch (state->layer) {
+   case BENCH_MESSAGE:
+      {
+         unsigned char *msgReply;
+
+         ok = Message_Send(&state->msgChan,
+                           (const unsigned char *)state->request,
+                           state->size) &&
+              Message_Receive(&state->msgChan, &msgReply, &replyLen);
+         replyLen -= 2;
+         break;
+      }
+
+   case BENCH_RPCOUT:
+      ok = RpcOut_send(state->out, state->request, state->size,
+                       &rpcStatus, &reply, &replyLen) && rpcStatus;
+      break;
+
+   case BENCH_RPCOUT_BUFFER:
+      ok = RpcOut_sendBuffer(state->out, state->request, state->size,
+                             state->replyBuf, state->size + 3,
+                             &rpcStatus, &reply, &replyLen) && rpcStatus;
+      break;
+
+   case BENCH_HGFS:
+   case BENCH_HGFS_INPLACE:
+      /* The whole request is the HGFS packet. */
+      expected = state->size;
+      replyLen = state->size;
+      memcpy(state->hgfsPacket, state->request, state->size);
+      if (state->layer == BENCH_HGFS) {
+         ok = HgfsBd_Dispatch(state->out, state->hgfsPacket, &replyLen,
+                              &reply) == 0;
+      } else {
+         ok = HgfsBd_DispatchInPlace(state->out, state->hgfsPacket,
+                                     HGFS_LARGE_PACKET_MAX, &replyLen) == 0;
+      }
+      break;
+
+   case BENCH_RPCCHANNEL:
+      {
+         char *chanReply = NULL;
+
+         ok = RpcChannel_Send(state->chan, state->request, state->size,
+                              &chanReply, &replyLen);
+         RpcChannel_Free(chanReply);
+         break;
+      }
+
+   default:
+      NOT_REACHED();
+   }
+
+   return ok && replyLen == expected;
+}
+
+
+/**
+ * qsort comparison function for latencies.
+ */
+
+static int
+BenchCompare(const void *a,
+             const void *b)
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Prints the backdoor calls made during a run.
+ *
+ * @param[in]  totalNs     Duration of the run.
+ */
+
+static void
+BenchPrintTrace(uint64 totalNs)
+{
+   FakeBackdoorTrace trace;
+   uint64 calls = 0;
+   uint64 ns = 0;
+   int op;
+
+   FakeBackdoor_GetTrace(&trace);
+   for (op = 0; op < FAKEBD_OP_MAX; op++) {
+      calls += trace.count[op];
+      ns += trace.ns[op];
+   }
+
+   printf("    backdoor: %.1f calls/msg, %.2f us/msg (%.0f%% of the time)\n",
+          (double)calls / gIterations, ns / 1000.0 / gIterations,
+          totalNs > 0 ? 100.0 * ns / totalNs : 0.0);
+   for (op = 0; op < FAKEBD_OP_MAX; op++) {
+      if (trace.count[op] > 0) {
+         printf("      %-12s %8.1f calls/msg %8.3f us/call\n",
+                FakeBackdoor_OpName(op),
+                (double)trace.count[op] / gIterations,
+                trace.ns[op] / 1000.0 / trace.count[op]);
+      }
+   }
+}
+
+
+/**
+ * Measures one layer at one message size, and prints the results.
+ *
+ * @param[in]  layer    The layer.
+ * @param[in]  size     Request size.
+ *
+ * @return FALSE if a round trip failed.
+ */
+
+static gboolean
+BenchRun(BenchLayer layer,
+         size_t size)
+{
+   BenchState state;
+   uint64 *latencies;
+   uint64 start;
+   uint64 total;
+   gint i;
+   gboolean ok = TRUE;
+
+   memset(&state, 0, sizeof state);
+   state.layer = layer;
+   state.size = size;
+
+   if (!BenchSetup(&state)) {
+      BenchTeardown(&state);
+      return TRUE;
+   }
+
+   /* Warm up buffers and caches. */
+   for (i = 0; i < 10 && ok; i++) {
+      ok = BenchRoundTrip(&state);
+   }
+   FakeBackdoor_ResetTrace();
+
+   latencies = g_new(uint64, gIterations);
+   start = FakeBackdoor_Now();
+   for (i = 0; i < gIterations && ok; i++) {
+      uint64 t = FakeBackdoor_Now();
+
+      ok = BenchRoundTrip(&state);
+      latencies[i] = FakeBackdoor_Now() - t;
+   }
+   total = FakeBackdoor_Now() - start;
+
+   if (ok) {
+      qsort(latencies, gIterations, sizeof *latencies, BenchCompare);
+      printf("%-14s %6"FMTSZ"u B %10.0f msg/s  avg %8.2f us  "
+             "p50 %8.2f us  p99 %8.2f us\n",
+             gLayerNames[layer], size,
+             total > 0 ? gIterations * 1e9 / total : 0.0,
+             total / 1000.0 / gIterations,
+             latencies[gIterations / 2] / 1000.0,
+             latencies[gIterations * 99 / 100] / 1000.0);
+      if (gTrace) {
+         BenchPrintTrace(total);
+      }
+   } else {
+      g_printerr("%s: round trip of %"FMTSZ"u bytes failed.\n",
+                 gLayerNames[layer], size);
+   }
+
+   g_free(latencies);
+   BenchTeardown(&state);
+   return ok;
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   GOptionEntry options[] = {
+      { "iterations", 'n', 0, G_OPTION_ARG_INT, &gIterations,
+        "Round trips per layer and size.", "N" },
+      { "layers", 'L', 0, G_OPTION_ARG_STRING, &gLayers,
+        "Comma separated layers to measure (default: all).", "LIST" },
+      { "legacy", 'l', 0, G_OPTION_ARG_NONE, &gLegacy,
+        "Use the 4-byte backdoor instead of the high-bandwidth one.", NULL },
+      { "exit-cost", 'e', 0, G_OPTION_ARG_INT, &gExitCostNs,
+        "Time each backdoor call takes, to model VM exits.", "NS" },
+      { "trace", 't', 0, G_OPTION_ARG_NONE, &gTrace,
+        "Break the time of a message down by backdoor call.", NULL },
+      { NULL }
+   };
+   GOptionContext *octx;
+   GError *err = NULL;
+   int layer;
+   int ret = 0;
+
+   octx = g_option_context_new(NULL);
+   g_option_context_set_summary(octx, "Measures the cost of guest RPCs.");
+   g_option_context_add_main_entries(octx, options, NULL);
+   if (!g_option_context_parse(octx, &argc, &argv, &err)) {
+      g_printerr("%s\n", err->message);
+      g_clear_error(&err);
+      g_option_context_free(octx);
+      return 1;
+   }
+   g_option_context_free(octx);
+
+   if (gIterations <= 0 || gExitCostNs < 0) {
+      g_printerr("Invalid iterations or exit cost.\n");
+      return 1;
+   }
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(gLayerNames) == BENCH_MAX);
+   FakeBackdoor_Configure(!gLegacy, gExitCostNs, gTrace);
+
+   for (layer = 0; layer < BENCH_MAX; layer++) {
+      size_t size;
+
+      if (gLayers != NULL) {
+         gchar **names = g_strsplit(gLayers, ",", 0);
+         gboolean wanted = FALSE;
+         guint i;
+
+         for (i = 0; names[i] != NULL && !wanted; i++) {
+            wanted = strcmp(names[i], gLayerNames[layer]) == 0;
+         }
+         g_strfreev(names);
+         if (!wanted) {
+            continue;
+         }
+      }
+
+      for (size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size *= 4) {
+         if (!BenchRun(layer, size)) {
+            ret = 1;
+         }
+      }
+   }
+
+   g_free(gLayers);
+   return ret;
+}
@@ -0,0 +1,443 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file fakeBackdoor.c
+ *
+ * Replaces lib/backdoor for the RPC benchmark: Backdoor(), Backdoor_HbOut()
+ * and Backdoor_HbIn() play the host side of the message protocol (see
+ * guest_msg_def.h) in process. The host answers every request with a
+ * success status followed by the request's arguments, i.e. everything
+ * after the first space, so replies are about as large as requests.
+ *
+ * A real backdoor call exits to the hypervisor; that cost can be modeled
+ * with a busy wait per call. Each call can also be traced, to split the
+ * time of a message between the backdoor and the layers above it.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "backdoor_def.h"
+#include "backdoor.h"
+#include "guest_msg_def.h"
+#include "fakeBackdoor.h"
+
+#define FAKEBD_MAX_CHANNELS 8
+
+typedef struct FakeChannel {
+   gboolean          open;
+   uint32            cookieHigh;
+   uint32            cookieLow;
+   /* Request being received from the guest. */
+   unsigned char    *req;
+   size_t            reqAlloc;
+   size_t            reqSize;
+   size_t            reqGot;
+   /* Reply being sent to the guest. */
+   unsigned char    *reply;
+   size_t            replyAlloc;
+   size_t            replySize;
+   size_t            replyGot;
+   gboolean          replyPending;
+} FakeChannel;
+
+static FakeChannel gChannels[FAKEBD_MAX_CHANNELS];
+static gboolean gHighBandwidth = TRUE;
+static uint32 gExitCostNs = 0;
+static gboolean gTraceEnabled = FALSE;
+static FakeBackdoorTrace gTrace;
+
+
+/**
+ * Returns a monotonic time stamp.
+ *
+ * @return The time in nanoseconds.
+ */
+
+uint64
+FakeBackdoor_Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Sets how the fake host behaves.
+ *
+ * @param[in]  highBandwidth  Whether to offer the high-bandwidth backdoor,
+ *                            or make the guest move 4 bytes per call.
+ * @param[in]  exitCostNs     Time each backdoor call busy waits for.
+ * @param[in]  trace          Whether to trace the backdoor calls.
+ */
+
+void
+FakeBackdoor_Configure(Bool highBandwidth,
+                       uint32 exitCostNs,
+                       Bool trace)
+{
+   gHighBandwidth = highBandwidth;
+   gExitCostNs = exitCostNs;
+   gTraceEnabled = trace;
+}
+
+
+/**
+ * Gets the backdoor calls traced since the last reset.
+ *
+ * @param[out] trace    Where to copy the trace.
+ */
+
+void
+FakeBackdoor_GetTrace(FakeBackdoorTrace *trace)
+{
+   *trace = gTrace;
+}
+
+
+/**
+ * Clears the trace.
+ */
+
+void
+FakeBackdoor_ResetTrace(void)
+{
+   memset(&gTrace, 0, sizeof gTrace);
+}
+
+
+/**
+ * Returns a printable name for a backdoor operation.
+ *
+ * @param[in]  op    The operation.
+ *
+ * @return The name.
+ */
+
+const char *
+FakeBackdoor_OpName(FakeBackdoorOp op)
+{
+   static const char *names[] = {
+      "open",
+      "sendsize",
+      "sendpayload",
+      "recvsize",
+      "recvpayload",
+      "recvstatus",
+      "close",
+      "hbout",
+      "hbin",
+   };
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(names) == FAKEBD_OP_MAX);
+   return op < FAKEBD_OP_MAX ? names[op] : "unknown";
+}
+
+
+/**
+ * Models the cost of exiting to the hypervisor, and records the call in
+ * the trace. Called when the fake host is done with a call.
+ *
+ * @param[in]  op       The operation performed.
+ * @param[in]  start    When the call started.
+ */
+
+static void
+FakeBackdoorExit(FakeBackdoorOp op,
+                 uint64 start)
+{
+   if (gExitCostNs > 0) {
+      uint64 end = start + gExitCostNs;
+
+      while (FakeBackdoor_Now() < end) {
+         /* Busy wait, as the vCPU would be descheduled. */
+      }
+   }
+
+   if (gTraceEnabled) {
+      gTrace.count[op]++;
+      gTrace.ns[op] += FakeBackdoor_Now() - start;
+   }
+}
+
+
+/**
+ * Grows a buffer of the fake host as needed.
+ *
+ * @param[in,out] buf      The buffer.
+ * @param[in,out] alloc    Its allocated size.
+ * @param[in]     size     The size needed.
+ */
+
+static void
+FakeBackdoorReserve(unsigned char **buf,
+                    size_t *alloc,
+                    size_t size)
+{
+   if (size > *alloc) {
+      *buf = g_realloc(*buf, size);
+      *alloc = size;
+   }
+}
+
+
+/**
+ * Looks up the channel a call is for.
+ *
+ * @param[in]  id          Channel id.
+ * @param[in]  cookieHigh  High part of the cookie.
+ * @param[in]  cookieLow   Low part of the cookie.
+ *
+ * @return The channel, NULL if the id or cookie is wrong.
+ */
+
+static FakeChannel *
+FakeBackdoorGetChannel(uint16 id,
+                       uint32 cookieHigh,
+                       uint32 cookieLow)
+{
+   FakeChannel *ch;
+
+   if (id >= FAKEBD_MAX_CHANNELS) {
+      return NULL;
+   }
+   ch = &gChannels[id];
+   if (!ch->open || ch->cookieHigh != cookieHigh || ch->cookieLow != cookieLow) {
+      return NULL;
+   }
+   return ch;
+}
+
+
+/**
+ * Executes a request the guest finished sending: the reply is a success
+ * status followed by the arguments of the request.
+ *
+ * @param[in]  ch    The channel.
+ */
+
+static void
+FakeBackdoorProcess(FakeChannel *ch)
+{
+   const unsigned char *args;
+   size_t argsLen;
+
+   args = memchr(ch->req, ' ', ch->reqSize);
+   if (args != NULL) {
+      args++;
+      argsLen = ch->reqSize - (args - ch->req);
+   } else {
+      argsLen = 0;
+   }
+
+   ch->replySize = 2 + argsLen;
+   FakeBackdoorReserve(&ch->reply, &ch->replyAlloc, ch->replySize);
+   memcpy(ch->reply, "1 ", 2);
+   if (argsLen > 0) {
+      memcpy(ch->reply + 2, args, argsLen);
+   }
+   ch->replyGot = 0;
+   ch->replyPending = TRUE;
+}
+
+
+/**
+ * Low-bandwidth backdoor call, as made by lib/message.
+ *
+ * @param[in,out] bp    Registers.
+ */
+
+void
+Backdoor(Backdoor_proto *bp)
+{
+   uint64 start = FakeBackdoor_Now();
+   uint16 type = bp->in.cx.halfs.high;
+   uint16 hb = gHighBandwidth ? MESSAGE_STATUS_HB : 0;
+   FakeBackdoorOp op = FAKEBD_OP_MAX;
+   FakeChannel *ch;
+
+   ASSERT(bp->in.cx.halfs.low == BDOOR_CMD_MESSAGE);
+
+   if (type == MESSAGE_TYPE_OPEN) {
+      uint16 id;
+
+      op = FAKEBD_OP_OPEN;
+      bp->in.cx.halfs.high = 0;
+      for (id = 0; id < FAKEBD_MAX_CHANNELS; id++) {
+         ch = &gChannels[id];
+         if (!ch->open) {
+            ch->open = TRUE;
+            ch->cookieHigh = g_random_int();
+            ch->cookieLow = g_random_int();
+            ch->replyPending = FALSE;
+            bp->in.dx.halfs.high = id;
+            bp->out.si.word = ch->cookieHigh;
+            bp->out.di.word = ch->cookieLow;
+            bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+            break;
+         }
+      }
+      goto exit;
+   }
+
+   ch = FakeBackdoorGetChannel(bp->in.dx.halfs.high, bp->in.si.word,
+                               bp->in.di.word);
+   bp->in.cx.halfs.high = 0;
+   if (ch == NULL) {
+      goto exit;
+   }
+
+   switch (type) {
+   case MESSAGE_TYPE_SENDSIZE:
+      op = FAKEBD_OP_SENDSIZE;
+      ch->reqSize = bp->in.size;
+      ch->reqGot = 0;
+      ch->replyPending = FALSE;
+      FakeBackdoorReserve(&ch->req, &ch->reqAlloc, ch->reqSize);
+      if (ch->reqSize == 0) {
+         FakeBackdoorProcess(ch);
+      }
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS | hb;
+      break;
+
+   case MESSAGE_TYPE_SENDPAYLOAD:
+      {
+         uint32 word = (uint32)bp->in.size;
+         size_t n = MIN(4, ch->reqSize - ch->reqGot);
+
+         op = FAKEBD_OP_SENDPAYLOAD;
+         memcpy(ch->req + ch->reqGot, &word, n);
+         ch->reqGot += n;
+         if (ch->reqGot == ch->reqSize) {
+            FakeBackdoorProcess(ch);
+         }
+         bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+         break;
+      }
+
+   case MESSAGE_TYPE_RECVSIZE:
+      op = FAKEBD_OP_RECVSIZE;
+      if (ch->replyPending) {
+         bp->in.dx.halfs.high = MESSAGE_TYPE_SENDSIZE;
+         bp->out.bx.word = ch->replySize;
+         bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS |
+                                MESSAGE_STATUS_DORECV | hb;
+      } else {
+         bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      }
+      break;
+
+   case MESSAGE_TYPE_RECVPAYLOAD:
+      {
+         uint32 word = 0;
+         size_t n = MIN(4, ch->replySize - ch->replyGot);
+
+         op = FAKEBD_OP_RECVPAYLOAD;
+         memcpy(&word, ch->reply + ch->replyGot, n);
+         ch->replyGot += n;
+         bp->in.dx.halfs.high = MESSAGE_TYPE_SENDPAYLOAD;
+         bp->out.bx.word = word;
+         bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+         break;
+      }
+
+   case MESSAGE_TYPE_RECVSTATUS:
+      op = FAKEBD_OP_RECVSTATUS;
+      ch->replyPending = FALSE;
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      break;
+
+   case MESSAGE_TYPE_CLOSE:
+      op = FAKEBD_OP_CLOSE;
+      g_free(ch->req);
+      g_free(ch->reply);
+      memset(ch, 0, sizeof *ch);
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      break;
+
+   default:
+      break;
+   }
+
+exit:
+   if (op != FAKEBD_OP_MAX) {
+      FakeBackdoorExit(op, start);
+   }
+}
+
+
+/**
+ * High-bandwidth call sending a whole request to the host.
+ *
+ * @param[in,out] bp    Registers.
+ */
+
+void
+Backdoor_HbOut(Backdoor_proto_hb *bp)
+{
+   uint64 start = FakeBackdoor_Now();
+   FakeChannel *ch;
+
+   ASSERT(bp->in.bx.halfs.low == BDOORHB_CMD_MESSAGE);
+
+   ch = FakeBackdoorGetChannel(bp->in.dx.halfs.high, bp->in.bp.word,
+                               (uint32)bp->in.dstAddr);
+   if (ch == NULL || bp->in.size != ch->reqSize) {
+      bp->in.bx.halfs.high = 0;
+   } else {
+      memcpy(ch->req, (const void *)bp->in.srcAddr, ch->reqSize);
+      ch->reqGot = ch->reqSize;
+      FakeBackdoorProcess(ch);
+      bp->in.bx.halfs.high = MESSAGE_STATUS_SUCCESS;
+   }
+
+   FakeBackdoorExit(FAKEBD_OP_HBOUT, start);
+}
+
+
+/**
+ * High-bandwidth call receiving a whole reply from the host.
+ *
+ * @param[in,out] bp    Registers.
+ */
+
+void
+Backdoor_HbIn(Backdoor_proto_hb *bp)
+{
+   uint64 start = FakeBackdoor_Now();
+   FakeChannel *ch;
+
+   ASSERT(bp->in.bx.halfs.low == BDOORHB_CMD_MESSAGE);
+
+   ch = FakeBackdoorGetChannel(bp->in.dx.halfs.high, (uint32)bp->in.srcAddr,
+                               bp->in.bp.word);
+   if (ch == NULL || !ch->replyPending || bp->in.size != ch->replySize) {
+      bp->in.bx.halfs.high = 0;
+   } else {
+      memcpy((void *)bp->in.dstAddr, ch->reply, ch->replySize);
+      ch->replyGot = ch->replySize;
+      bp->in.bx.halfs.high = MESSAGE_STATUS_SUCCESS;
+   }
+
+   FakeBackdoorExit(FAKEBD_OP_HBIN, start);
+}
@@ -0,0 +1,69 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _FAKEBACKDOOR_H_
+#define _FAKEBACKDOOR_H_
+
+/**
+ * @file fakeBackdoor.h
+ *
+ * A Backdoor implementation that plays the host side of the message
+ * protocol in process, so that the layers above it can be measured
+ * without a hypervisor.
+ */
+
+#include "vm_basic_types.h"
+
+/** Backdoor operations, as counted by the trace. */
+typedef enum {
+   FAKEBD_OP_OPEN,
+   FAKEBD_OP_SENDSIZE,
+   FAKEBD_OP_SENDPAYLOAD,
+   FAKEBD_OP_RECVSIZE,
+   FAKEBD_OP_RECVPAYLOAD,
+   FAKEBD_OP_RECVSTATUS,
+   FAKEBD_OP_CLOSE,
+   FAKEBD_OP_HBOUT,
+   FAKEBD_OP_HBIN,
+   FAKEBD_OP_MAX
+} FakeBackdoorOp;
+
+/** Number and duration of the backdoor operations since the last reset. */
+typedef struct FakeBackdoorTrace {
+   uint64 count[FAKEBD_OP_MAX];
+   uint64 ns[FAKEBD_OP_MAX];
+} FakeBackdoorTrace;
+
+void
+FakeBackdoor_Configure(Bool highBandwidth,
+                       uint32 exitCostNs,
+                       Bool trace);
+
+void
+FakeBackdoor_GetTrace(FakeBackdoorTrace *trace);
+
+void
+FakeBackdoor_ResetTrace(void);
+
+const char *
+FakeBackdoor_OpName(FakeBackdoorOp op);
+
+uint64
+FakeBackdoor_Now(void);
+
+#endif /* _FAKEBACKDOOR_H_ */
@@ -0,0 +1,588 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file benchStats.c
+ *
+ * Measures the cost of a guest stats sample, GuestInfoTakeSample() of the
+ * guestInfo plugin, which is built into this program with its /proc and
+ * /sys paths made relative to the current directory.
+ *
+ * By default the sample is taken from a made up tree whose /proc/stat is
+ * that of a guest with 128 vCPUs; the other files are copied from the host
+ * when it has them. With --live, it is taken from the host's own /proc.
+ * Prints the average, median and 99th percentile time of a sample.
+ *
+ * With --highres, runs high resolution sampling on a main loop for a while
+ * instead, with a poll every second, and prints the summaries of the last
+ * poll and the CPU time the process used. Fails if that exceeds the budget.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "vmware.h"
+#include "conf.h"
+#include "dynbuf.h"
+#include "guestInfoInt.h"
+#include "guestStats.h"
+
+#define BENCH_DEFAULT_CPUS    128
+#define BENCH_DEFAULT_ITERS   2000
+/* Interrupt sources listed in the made up /proc/stat. */
+#define BENCH_IRQS            1024
+#define BENCH_POLL_INTERVAL   1000    // ms
+#define BENCH_DEFAULT_SECONDS 10
+#define BENCH_DEFAULT_BUDGET  50      // hundredths of a percent
+
+Bool GuestInfoTakeSample(DynBuf *statBuf);
+
+static gint gCpus = BENCH_DEFAULT_CPUS;
+static gint gIterations = BENCH_DEFAULT_ITERS;
+static gboolean gLive = FALSE;
+static gboolean gKeep = FALSE;
+static gint gHighResInterval = 0;
+static gint gSeconds = BENCH_DEFAULT_SECONDS;
+static gint gBudget = BENCH_DEFAULT_BUDGET;
+
+#undef DEFINE_GUEST_STAT
+#define DEFINE_GUEST_STAT(x, y, z) z,
+static const char *gStatNames[] = {
+   GUEST_STAT_TOOLS_IDS
+};
+#undef DEFINE_GUEST_STAT
+
+
+/**
+ * Stub for the plugin's reporting function, which perfMonLinux.c refers to.
+ *
+ * @param[in]  ctx      Unused.
+ * @param[in]  stats    Unused.
+ *
+ * @return TRUE.
+ */
+
+Bool
+GuestInfo_ServerReportStats(ToolsAppCtx *ctx,
+                            DynBuf *stats)
+{
+   return TRUE;
+}
+
+
+/**
+ * Returns the monotonic time.
+ *
+ * @return The time, in nanoseconds.
+ */
+
+static uint64
+BenchNow(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * qsort comparison function for latencies.
+ */
+
+static int
+BenchCompare(const void *a,
+             const void *b)
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Writes a file of the made up tree, creating its directory.
+ *
+ * @param[in]  path     Path of the file, relative to the tree.
+ * @param[in]  data     Contents.
+ * @param[in]  len      Size of the contents.
+ *
+ * @return Whether the file was written.
+ */
+
+static gboolean
+BenchWriteFile(const gchar *path,
+               const gchar *data,
+               gssize len)
+{
+   gchar *dir = g_path_get_dirname(path);
+   GError *err = NULL;
+   gboolean ok;
+
+   g_mkdir_with_parents(dir, 0755);
+   g_free(dir);
+
+   ok = g_file_set_contents(path, data, len, &err);
+   if (!ok) {
+      g_printerr("%s: %s\n", path, err->message);
+      g_clear_error(&err);
+   }
+   return ok;
+}
+
+
+/**
+ * Copies a file from the host's /proc into the made up tree, or writes the
+ * given contents if the host does not have it.
+ *
+ * @param[in]  path        Path of the file, relative to the tree.
+ * @param[in]  fallback    Contents to use if the host has no such file.
+ *
+ * @return Whether the file was written.
+ */
+
+static gboolean
+BenchCopyFile(const gchar *path,
+              const gchar *fallback)
+{
+   gchar *host = g_strconcat("/", path, NULL);
+   gchar *data = NULL;
+   gsize len;
+   gboolean ok;
+
+   if (g_file_get_contents(host, &data, &len, NULL)) {
+      ok = BenchWriteFile(path, data, len);
+   } else {
+      ok = BenchWriteFile(path, fallback, -1);
+   }
+
+   g_free(data);
+   g_free(host);
+   return ok;
+}
+
+
+/**
+ * Creates the made up tree in the current directory.
+ *
+ * @return Whether the tree was created.
+ */
+
+static gboolean
+BenchMakeTree(void)
+{
+   GString *stat = g_string_new(NULL);
+   gboolean ok;
+   gint cpu;
+   gint i;
+
+   /* /proc/stat, as printed by show_stat() in fs/proc/stat.c. */
+   g_string_append(stat, "cpu  7734589 1234 3411122 912334455 80123 0 "
+                         "120345 0 0 0\n");
+   for (cpu = 0; cpu < gCpus; cpu++) {
+      g_string_append_printf(stat, "cpu%d 60426 10 26649 7127613 625 0 "
+                                   "940 0 0 0\n", cpu);
+   }
+   g_string_append(stat, "intr 3492245521");
+   for (i = 0; i < BENCH_IRQS; i++) {
+      g_string_append_printf(stat, " %d", (i % 7 == 0) ? 1000 + i : 0);
+   }
+   g_string_append(stat, "\nctxt 6178318931\n"
+                         "btime 1563384012\n"
+                         "processes 4471286\n"
+                         "procs_running 3\n"
+                         "procs_blocked 0\n"
+                         "softirq 1855309478 0 401234567 123456 "
+                         "312345678 23456789 0 1234567 "
+                         "587654321 0 528765432\n");
+
+   ok = BenchWriteFile("proc/stat", stat->str, stat->len) &&
+        BenchCopyFile("proc/meminfo",
+                      "MemTotal:       16393956 kB\n"
+                      "MemFree:         1151840 kB\n"
+                      "MemAvailable:   12017444 kB\n"
+                      "Buffers:          671220 kB\n"
+                      "Cached:         10045000 kB\n"
+                      "SwapTotal:       2097148 kB\n"
+                      "SwapFree:        2097148 kB\n") &&
+        BenchCopyFile("proc/vmstat",
+                      "pgpgin 12345678\n"
+                      "pgpgout 23456789\n"
+                      "pswpin 0\n"
+                      "pswpout 0\n"
+                      "pgfault 345678901\n"
+                      "pgmajfault 12345\n") &&
+        BenchCopyFile("proc/zoneinfo",
+                      "Node 0, zone   Normal\n"
+                      "  pages free     287960\n"
+                      "        min      11273\n"
+                      "        low      14091\n"
+                      "        high     16909\n"
+                      "        spanned  3407872\n"
+                      "        present  3407872\n"
+                      "        managed  3327462\n") &&
+        BenchCopyFile("proc/uptime", "1234567.89 98765432.10\n") &&
+        BenchCopyFile("proc/sys/vm/swappiness", "60\n") &&
+        BenchCopyFile("proc/loadavg", "0.52 0.58 0.59 3/1207 12345\n") &&
+        BenchCopyFile("proc/pressure/memory",
+                      "some avg10=0.00 avg60=0.00 avg300=0.00 "
+                      "total=1234567\n"
+                      "full avg10=0.00 avg60=0.00 avg300=0.00 "
+                      "total=234567\n") &&
+        BenchWriteFile("proc/diskstats",
+                       "   8       0 sda 1234567 2345 98765432 456789 "
+                       "2345678 3456 87654321 567890 2 678901 1024680\n"
+                       "   8       1 sda1 1234000 2345 98760000 456700 "
+                       "2345600 3456 87650000 567800 0 678800 1024500\n",
+                       -1) &&
+        g_mkdir_with_parents("sys/block/sda", 0755) == 0;
+
+   g_string_free(stat, TRUE);
+   return ok;
+}
+
+
+/**
+ * Removes a directory tree.
+ *
+ * @param[in]  path     The tree.
+ */
+
+static void
+BenchRemoveTree(const gchar *path)
+{
+   GDir *dir = g_dir_open(path, 0, NULL);
+
+   if (dir != NULL) {
+      const gchar *name;
+
+      while ((name = g_dir_read_name(dir)) != NULL) {
+         gchar *child = g_build_filename(path, name, NULL);
+
+         if (g_file_test(child, G_FILE_TEST_IS_DIR) &&
+             !g_file_test(child, G_FILE_TEST_IS_SYMLINK)) {
+            BenchRemoveTree(child);
+         } else {
+            g_unlink(child);
+         }
+         g_free(child);
+      }
+      g_dir_close(dir);
+   }
+   g_rmdir(path);
+}
+
+
+/**
+ * Prints the high resolution summaries found in a stats sample.
+ *
+ * @param[in]  stats    The sample, as encoded by GuestInfoEncodeStats().
+ */
+
+static void
+BenchPrintSummaries(DynBuf *stats)
+{
+   const char *data = DynBuf_Get(stats);
+   size_t size = DynBuf_GetSize(stats);
+   size_t offset = sizeof(GuestMemInfoLegacy);
+
+   while (offset + sizeof(GuestStatHeader) <= size) {
+      GuestStatHeader header;
+      uint64 id = 0;
+      uint64 value = 0;
+      Bool hasValue = FALSE;
+      uint32 bit;
+
+      memcpy(&header, data + offset, sizeof header);
+      offset += sizeof header;
+
+      /* The data follow in the order of their bits. */
+      for (bit = 1; bit <= GUEST_DATUM_VALUE; bit <<= 1) {
+         GuestDatumHeader datum;
+
+         if ((header.datumFlags & bit) == 0) {
+            continue;
+         }
+         if (offset + sizeof datum > size) {
+            return;
+         }
+         memcpy(&datum, data + offset, sizeof datum);
+         offset += sizeof datum;
+         if (offset + datum.dataSize > size) {
+            return;
+         }
+         if (bit == GUEST_DATUM_ID) {
+            memcpy(&id, data + offset, MIN(datum.dataSize, sizeof id));
+         } else if (bit == GUEST_DATUM_VALUE) {
+            memcpy(&value, data + offset, MIN(datum.dataSize, sizeof value));
+            hasValue = TRUE;
+         }
+         offset += datum.dataSize;
+      }
+
+      if (id >= GuestStatID_Linux_CpuRunQueueMin && id < GuestStatID_Max) {
+         if (hasValue) {
+            printf("   %-30s %"FMT64"u\n", gStatNames[id], value);
+         } else {
+            printf("   %-30s -\n", gStatNames[id]);
+         }
+      }
+   }
+}
+
+
+/**
+ * Poll callback: takes a stats sample, which summarizes the high resolution
+ * samples taken since the previous one.
+ *
+ * @param[in]  data     The DynBuf to store the sample into.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+BenchPoll(gpointer data)
+{
+   DynBuf *stats = data;
+
+   DynBuf_SetSize(stats, 0);
+   if (!GuestInfoTakeSample(stats)) {
+      g_printerr("Sample failed.\n");
+   }
+   return TRUE;
+}
+
+
+/**
+ * Stops the main loop.
+ *
+ * @param[in]  data     The main loop.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+BenchQuit(gpointer data)
+{
+   g_main_loop_quit(data);
+   return FALSE;
+}
+
+
+/**
+ * Returns the CPU time used by the process.
+ *
+ * @return The time, in microseconds.
+ */
+
+static uint64
+BenchCpuTime(void)
+{
+   struct rusage ru;
+
+   getrusage(RUSAGE_SELF, &ru);
+   return (uint64)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+          ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+
+/**
+ * Runs high resolution sampling for gSeconds seconds, and checks the CPU
+ * time the process used against the budget. The polls are counted in.
+ *
+ * @param[in]  stats    Buffer for the samples.
+ *
+ * @return Whether the process stayed within the budget.
+ */
+
+static gboolean
+BenchHighRes(DynBuf *stats)
+{
+   ToolsAppCtx ctx;
+   uint64 cpu;
+   uint64 wall;
+   double overhead;
+
+   memset(&ctx, 0, sizeof ctx);
+   ctx.config = g_key_file_new();
+   ctx.mainLoop = g_main_loop_new(NULL, FALSE);
+   g_key_file_set_integer(ctx.config, CONFGROUPNAME_GUESTINFO,
+                          CONFNAME_GUESTINFO_HIGHRESINTERVAL,
+                          gHighResInterval);
+   g_key_file_set_integer(ctx.config, CONFGROUPNAME_GUESTINFO,
+                          CONFNAME_GUESTINFO_HIGHRESBUDGET, gBudget);
+
+   GuestInfo_StatProviderConfigure(&ctx, BENCH_POLL_INTERVAL);
+   g_timeout_add(BENCH_POLL_INTERVAL, BenchPoll, stats);
+   g_timeout_add_seconds(gSeconds, BenchQuit, ctx.mainLoop);
+
+   cpu = BenchCpuTime();
+   wall = BenchNow();
+   g_main_loop_run(ctx.mainLoop);
+   cpu = BenchCpuTime() - cpu;
+   wall = BenchNow() - wall;
+
+   /* In hundredths of a percent of one CPU, like the budget. */
+   overhead = cpu * 1000.0 * 10000 / wall;
+   printf("high resolution sampling every %d ms for %d s, last poll:\n",
+          gHighResInterval, gSeconds);
+   BenchPrintSummaries(stats);
+   printf("CPU: %"FMT64"u us in %.2f s, %.3f%% of one CPU, budget %.3f%%\n",
+          cpu, wall / 1e9, overhead / 100, gBudget / 100.0);
+
+   GuestInfo_StatProviderConfigure(&ctx, 0);
+   g_main_loop_unref(ctx.mainLoop);
+   g_key_file_free(ctx.config);
+
+   return overhead <= gBudget;
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   GOptionEntry options[] = {
+      { "cpus", 'c', 0, G_OPTION_ARG_INT, &gCpus,
+        "vCPUs listed in the made up /proc/stat.", "N" },
+      { "iterations", 'n', 0, G_OPTION_ARG_INT, &gIterations,
+        "Samples to take.", "N" },
+      { "live", 'l', 0, G_OPTION_ARG_NONE, &gLive,
+        "Sample the host's /proc instead of a made up one.", NULL },
+      { "keep", 'k', 0, G_OPTION_ARG_NONE, &gKeep,
+        "Keep the made up tree, and print where it is.", NULL },
+      { "highres", 'r', 0, G_OPTION_ARG_INT, &gHighResInterval,
+        "Run high resolution sampling every N ms instead.", "N" },
+      { "seconds", 't', 0, G_OPTION_ARG_INT, &gSeconds,
+        "How long to run high resolution sampling.", "N" },
+      { "budget", 'b', 0, G_OPTION_ARG_INT, &gBudget,
+        "CPU budget, in hundredths of a percent of one CPU.", "N" },
+      { NULL }
+   };
+   GOptionContext *octx;
+   GError *err = NULL;
+   gchar *tree = NULL;
+   uint64 *latencies;
+   uint64 start;
+   uint64 total;
+   DynBuf stats;
+   size_t statsSize = 0;
+   gint i;
+   int ret = 0;
+
+   octx = g_option_context_new(NULL);
+   g_option_context_set_summary(octx, "Measures the cost of a guest stats "
+                                      "sample.");
+   g_option_context_add_main_entries(octx, options, NULL);
+   if (!g_option_context_parse(octx, &argc, &argv, &err)) {
+      g_printerr("%s\n", err->message);
+      g_clear_error(&err);
+      g_option_context_free(octx);
+      return 1;
+   }
+   g_option_context_free(octx);
+
+   if (gIterations <= 0 || gCpus <= 0 || gHighResInterval < 0 ||
+       gSeconds <= 0 || gBudget <= 0) {
+      g_printerr("Invalid iterations, vCPU count, interval or budget.\n");
+      return 1;
+   }
+
+   if (gLive) {
+      if (chdir("/") != 0) {
+         g_printerr("Cannot change to /.\n");
+         return 1;
+      }
+   } else {
+      tree = g_dir_make_tmp("benchstats-XXXXXX", &err);
+      if (tree == NULL) {
+         g_printerr("%s\n", err->message);
+         g_clear_error(&err);
+         return 1;
+      }
+      if (chdir(tree) != 0 || !BenchMakeTree()) {
+         g_printerr("Cannot create the tree in %s.\n", tree);
+         ret = 1;
+         goto exit;
+      }
+   }
+
+   DynBuf_Init(&stats);
+
+   /* The first sample sets up the collectors and opens the files. */
+   for (i = 0; i < 10; i++) {
+      DynBuf_SetSize(&stats, 0);
+      if (!GuestInfoTakeSample(&stats)) {
+         g_printerr("Sample failed.\n");
+         ret = 1;
+         goto exit_stats;
+      }
+   }
+
+   if (gHighResInterval > 0) {
+      if (!BenchHighRes(&stats)) {
+         g_printerr("Over the CPU budget.\n");
+         ret = 1;
+      }
+      goto exit_stats;
+   }
+
+   latencies = g_new(uint64, gIterations);
+   start = BenchNow();
+   for (i = 0; i < gIterations; i++) {
+      uint64 t = BenchNow();
+
+      DynBuf_SetSize(&stats, 0);
+      GuestInfoTakeSample(&stats);
+      latencies[i] = BenchNow() - t;
+      statsSize = DynBuf_GetSize(&stats);
+   }
+   total = BenchNow() - start;
+
+   qsort(latencies, gIterations, sizeof *latencies, BenchCompare);
+   printf("%s, %d samples of %"FMTSZ"u bytes: avg %8.2f us  "
+          "p50 %8.2f us  p99 %8.2f us\n",
+          gLive ? "live /proc" : "made up /proc",
+          gIterations, statsSize,
+          total / 1000.0 / gIterations,
+          latencies[gIterations / 2] / 1000.0,
+          latencies[gIterations * 99 / 100] / 1000.0);
+   g_free(latencies);
+
+exit_stats:
+   GuestInfo_StatProviderShutdown();
+   DynBuf_Destroy(&stats);
+
+exit:
+   if (tree != NULL) {
+      if (gKeep) {
+         printf("Tree kept in %s.\n", tree);
+      } else {
+         BenchRemoveTree(tree);
+      }
+      g_free(tree);
+   }
+   return ret;
+}
@@ -0,0 +1,101 @@
+#!/bin/sh
+##########################################################
+# Copyright (C) 2019 VMware, Inc. All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of version 2 of the GNU General Public License as
+# published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+##########################################################
+
+
+#
+# bench-startup.sh
+#
+# Starts vmtoolsd repeatedly with the testDebug plugin, so no VM is
+# needed, and prints how long each run took to register its
+# capabilities, as recorded by the service's startup timeline:
+#
+#    bench-startup.sh [-b vmtoolsd] [-d libtestDebug.so] [-n runs]
+#                     [-p plugin dir] [-v]
+#
+# Each run prints "run <n> <wall seconds> ready=<ms>"; the last line
+# gives the median time to ready. With -v, the timeline of the slowest
+# run is printed too, which shows the step on its critical path.
+#
+
+bin=vmtoolsd
+debug=libtestDebug.so
+runs=10
+plugins=
+verbose=0
+
+while getopts b:d:n:p:v opt; do
+    case $opt in
+    b) bin=$OPTARG ;;
+    d) debug=$OPTARG ;;
+    n) runs=$OPTARG ;;
+    p) plugins=$OPTARG ;;
+    v) verbose=1 ;;
+    *) echo "usage: $0 [-b vmtoolsd] [-d libtestDebug.so] [-n runs]" \
+            "[-p plugin dir] [-v]" >&2
+       exit 2 ;;
+    esac
+done
+
+tmp=`mktemp -d` || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+cat > "$tmp/tools.conf" << EOF
+[logging]
+log = true
+vmsvc.level = info
+vmsvc.handler = file
+vmsvc.data = $tmp/vmsvc.log
+EOF
+
+now() {
+    date +%s.%N
+}
+
+set -- -n vmsvc -c "$tmp/tools.conf" -g "$debug"
+if [ -n "$plugins" ]; then
+    set -- "$@" -p "$plugins"
+fi
+
+i=0
+slowest=
+while [ $i -lt $runs ]; do
+    rm -f "$tmp/vmsvc.log"
+    start=`now`
+    "$bin" "$@" > /dev/null 2>&1 || echo "run $i failed" >&2
+    end=`now`
+    ready=`sed -n 's/.*Startup: ready \([0-9.]*\) ms.*/\1/p' "$tmp/vmsvc.log"`
+    echo "run $i `echo "$end - $start" | bc` ready=$ready"
+    if [ -n "$ready" ]; then
+        echo "$ready" >> "$tmp/ready"
+        if [ -z "$slowest" ] || \
+           [ `echo "$ready > $slowest" | bc` -eq 1 ]; then
+            slowest=$ready
+            grep 'Startup:' "$tmp/vmsvc.log" > "$tmp/slowest.log"
+        fi
+    fi
+    i=`expr $i + 1`
+done
+
+if [ -r "$tmp/ready" ]; then
+    sort -n "$tmp/ready" | \
+       awk '{ v[NR] = $1 } END { print "median_ready_ms", v[int((NR + 1) / 2)] }'
+    if [ $verbose -eq 1 ]; then
+        cat "$tmp/slowest.log"
+    fi
+fi
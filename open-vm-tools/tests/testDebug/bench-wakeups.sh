@@ -0,0 +1,98 @@
+#!/bin/sh
+##########################################################
+# Copyright (C) 2019 VMware, Inc. All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of version 2 of the GNU General Public License as
+# published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+##########################################################
+
+
+#
+# bench-wakeups.sh
+#
+# Runs an idle vmtoolsd once for each timer wheel tick given, and
+# prints how often its threads woke up:
+#
+#    bench-wakeups.sh [-b vmtoolsd] [-p plugin dir] [-t seconds]
+#                     [tick ms ...]
+#
+# The default ticks are 0, which disables timer coalescing, and 1000,
+# the service's default. Must run inside a virtual machine, as root,
+# with no other vmtoolsd running. Each run prints
+# "tick=<ms> wakeups=<n> per_min=<n>" followed by the timer wheel
+# counters from the service's state dump.
+#
+
+bin=vmtoolsd
+plugins=
+secs=60
+
+while getopts b:p:t: opt; do
+    case $opt in
+    b) bin=$OPTARG ;;
+    p) plugins=$OPTARG ;;
+    t) secs=$OPTARG ;;
+    *) echo "usage: $0 [-b vmtoolsd] [-p plugin dir] [-t seconds]" \
+            "[tick ms ...]" >&2
+       exit 2 ;;
+    esac
+done
+shift `expr $OPTIND - 1`
+if [ $# -eq 0 ]; then
+    set -- 0 1000
+fi
+
+tmp=`mktemp -d` || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# Voluntary context switches of all threads of a process.
+switches() {
+    cat /proc/$1/task/*/status 2>/dev/null | \
+       awk '/^voluntary_ctxt_switches/ { n += $2 } END { print n + 0 }'
+}
+
+for tick in "$@"; do
+    cat > "$tmp/tools.conf" << EOF
+[vmsvc]
+timers.tick = $tick
+
+[logging]
+log = true
+vmsvc.level = info
+vmsvc.handler = file
+vmsvc.data = $tmp/vmsvc.log
+EOF
+
+    rm -f "$tmp/vmsvc.log"
+    if [ -n "$plugins" ]; then
+        "$bin" -n vmsvc -c "$tmp/tools.conf" -p "$plugins" > /dev/null 2>&1 &
+    else
+        "$bin" -n vmsvc -c "$tmp/tools.conf" > /dev/null 2>&1 &
+    fi
+    pid=$!
+
+    # Let the startup work settle before counting.
+    sleep 5
+    before=`switches $pid`
+    sleep $secs
+    after=`switches $pid`
+    kill -USR1 $pid
+    sleep 1
+    kill $pid
+    wait $pid
+
+    n=`expr $after - $before`
+    echo "tick=$tick wakeups=$n per_min=`expr $n \* 60 / $secs`"
+    grep 'Coalesced timers:' "$tmp/vmsvc.log"
+done
@@ -55,6 +55,7 @@ static RpcDebugMsgMapping gRpcMessages[] = {
    { NULL, 0, NULL, TRUE },
    { "test.rpcin.msg2", sizeof "test.rpcin.msg2", NULL, FALSE },
    { "test.rpcin.msg3", sizeof "test.rpcin.msg3", TestDebugValidateRpc3, FALSE },
+   { "test.rpcin.tpool", sizeof "test.rpcin.tpool", NULL, FALSE },
    { SET_OPTION_TEST, sizeof SET_OPTION_TEST, NULL, FALSE },
    { "Capabilities_Register", sizeof "Capabilities_Register", NULL, FALSE },
    /* NULL terminator. */
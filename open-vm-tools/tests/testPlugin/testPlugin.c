@@ -35,6 +35,7 @@
 #include "vmware/tools/log.h"
 #include "vmware/tools/plugin.h"
 #include "vmware/tools/rpcdebug.h"
+#include "vmware/tools/threadPool.h"
 #include "vmware/tools/utils.h"
 
 #define TEST_APP_PROVIDER        "TestProvider"
@@ -44,6 +45,8 @@
 
 #define TEST_SIG_INVALID   "TestInvalidSignal"
 
+#define TEST_POOL_TASKS    100000
+
 typedef struct TestApp {
    const char *name;
 } TestApp;
@@ -53,6 +56,8 @@ static gboolean gInvalidAppError = FALSE;
 static gboolean gInvalidAppProvider = FALSE;
 static gboolean gInvalidSigError = FALSE;
 static gboolean gValidAppRegistration = FALSE;
+static gint gPoolTasksRun = 0;
+static gint gPoolTasksFreed = 0;
 
 
 /**
@@ -141,6 +146,88 @@ TestPluginRpc3(RpcInData *data)
 }
 
 
+/**
+ * Thread pool task used by the "test.rpcin.tpool" RPC; counts its executions.
+ *
+ * @param[in]  ctx      Unused.
+ * @param[in]  data     Unused.
+ */
+
+static void
+TestPluginPoolTask(ToolsAppCtx *ctx,
+                   gpointer data)
+{
+   g_atomic_int_inc(&gPoolTasksRun);
+}
+
+
+/**
+ * Destructor of the "test.rpcin.tpool" tasks; counts tasks that were either
+ * executed or canceled.
+ *
+ * @param[in]  data     Unused.
+ */
+
+static void
+TestPluginPoolTaskFree(gpointer data)
+{
+   g_atomic_int_inc(&gPoolTasksFreed);
+}
+
+
+/**
+ * Handles a "test.rpcin.tpool" RPC message. Stresses the shared thread pool
+ * by submitting TEST_POOL_TASKS tasks of both priority classes, canceling
+ * every other one, and waiting until every task has either run or been
+ * canceled. Tasks running in the service thread (when the pool is single
+ * threaded) are run while waiting.
+ *
+ * @param[in]  data     RPC data.
+ *
+ * @return TRUE on success.
+ */
+
+static gboolean
+TestPluginRpcPool(RpcInData *data)
+{
+   ToolsAppCtx *ctx = data->appCtx;
+   gint64 deadline;
+   guint i;
+
+   g_atomic_int_set(&gPoolTasksRun, 0);
+   g_atomic_int_set(&gPoolTasksFreed, 0);
+
+   for (i = 0; i < TEST_POOL_TASKS; i++) {
+      ToolsCorePoolPriority prio = (i % 4 == 0) ? TOOLS_CORE_POOL_PRIO_LATENCY
+                                                : TOOLS_CORE_POOL_PRIO_BACKGROUND;
+      guint id = ToolsCorePool_SubmitTaskPrio(ctx, prio, TestPluginPoolTask,
+                                              NULL, TestPluginPoolTaskFree);
+
+      CU_ASSERT(id != 0);
+      if (id != 0 && i % 2 == 1) {
+         /* Does nothing if the task is already running. */
+         ToolsCorePool_CancelTask(ctx, id);
+      }
+   }
+
+   deadline = g_get_monotonic_time() + 60 * G_TIME_SPAN_SECOND;
+   while (g_atomic_int_get(&gPoolTasksFreed) < TEST_POOL_TASKS &&
+          g_get_monotonic_time() < deadline) {
+      if (!g_main_context_iteration(NULL, FALSE)) {
+         g_usleep(1000);
+      }
+   }
+
+   CU_ASSERT_EQUAL(g_atomic_int_get(&gPoolTasksFreed), TEST_POOL_TASKS);
+   CU_ASSERT(g_atomic_int_get(&gPoolTasksRun) >= TEST_POOL_TASKS / 2);
+   CU_ASSERT(g_atomic_int_get(&gPoolTasksRun) <= TEST_POOL_TASKS);
+
+   vm_debug("%s: %d of %d tasks ran", data->name,
+            g_atomic_int_get(&gPoolTasksRun), TEST_POOL_TASKS);
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+
+
 /**
  * Called by the service core when the host requests the capabilities supported
  * by the guest tools.
@@ -368,7 +455,9 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       { "test.rpcin.msg2",
          TestPluginRpc2, NULL, NULL, NULL, 0 },
       { "test.rpcin.msg3",
-            TestPluginRpc3, NULL, NULL, xdr_TestPluginData, 0 }
+            TestPluginRpc3, NULL, NULL, xdr_TestPluginData, 0 },
+      { "test.rpcin.tpool",
+         TestPluginRpcPool, NULL, NULL, NULL, 0 }
    };
    ToolsAppProvider provs[] = {
       { TEST_APP_PROVIDER, 42, sizeof (char *), NULL, TestProviderRegisterApp, NULL, NULL }
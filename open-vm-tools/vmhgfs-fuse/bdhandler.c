@@ -145,10 +145,11 @@ HgfsBdChannelClose(HgfsTransportChannel *channel) // IN: Channel
  *
  * HgfsBdChannelSend --
  *
- *     Send a request via backdoor.
+ *     Send a request via backdoor. The reply is received in the request.
  *
  * Results:
- *     0 on success, negative error on failure.
+ *     0 on success, negative error on failure. -EPROTO if the server got
+ *     the request but its reply was lost.
  *
  * Side effects:
  *     None
@@ -160,7 +161,6 @@ static int
 HgfsBdChannelSend(HgfsTransportChannel *channel, // IN: Channel
                   HgfsReq *req)                  // IN: request to send
 {
-   char const *replyPacket = NULL;
    size_t payloadSize;
    int ret;
 
@@ -178,13 +178,24 @@ HgfsBdChannelSend(HgfsTransportChannel *channel, // IN: Channel
 
    payloadSize = req->payloadSize;
    LOG(8, ("Backdoor sending.\n"));
-   ret = HgfsBd_Dispatch(channel->priv, HGFS_REQ_PAYLOAD(req), &payloadSize,
-                         &replyPacket);
+   ret = HgfsBd_DispatchInPlace(channel->priv, HGFS_REQ_PAYLOAD(req),
+                                sizeof req->packet - HGFS_CLIENT_CMD_LEN,
+                                &payloadSize);
    if (ret == 0) {
       LOG(8, ("Backdoor reply received.\n"));
-      /* Request sent successfully. Copy the reply and wake the client. */
-      ASSERT(replyPacket);
-      HgfsCompleteReq(req, replyPacket, payloadSize);
+      /* The reply was received in the request, wake the client. */
+      HgfsCompleteReq(req, HGFS_REQ_PAYLOAD(req), payloadSize);
+   } else if (ret == -2) {
+      /*
+       * The server got the request but part of its reply overwrote it, so
+       * it must not be sent again.
+       */
+      LOG(4, ("Backdoor reply lost.\n"));
+      ret = -EPROTO;
+   } else if (ret == -3) {
+      /* The host failed the request, it may be sent again. */
+      LOG(4, ("Backdoor request failed by the host.\n"));
+      ret = -EIO;
    } else {
       /* Map rpc failure to EIO. */
       ret = -EIO;
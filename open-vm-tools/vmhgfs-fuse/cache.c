@@ -36,6 +36,29 @@
 #define CACHE_PURGE_SLEEP_TIME 30
 #define HASH_THRESHOLD_SIZE (2046 * 4)
 #define HASH_PURGE_SIZE (HASH_THRESHOLD_SIZE / 2)
+/*
+ * Negative entries remember paths the server reported as nonexistent,
+ * to avoid a round trip for every probe of a missing file by compilers
+ * and PATH lookups. They are bounded separately from the positive ones.
+ */
+#define NEGATIVE_CACHE_TIMEOUT HGFS_DEFAULT_TTL
+#define NEGATIVE_CACHE_MAX_SIZE 2048
+/*
+ * With the refresh_ahead mount option, entries used within the last
+ * CACHE_REFRESH_HOT_TIME seconds are revalidated in the background once
+ * they are older than CACHE_REFRESH_AGE (half of the timeout, in NT time
+ * units), i.e. before they expire, so hot paths keep hitting the cache.
+ * The refresher runs every CACHE_REFRESH_INTERVAL microseconds, so every
+ * entry is seen at least once in that window, and sleeps while there are
+ * no hot entries. Candidates sharing a parent directory are refreshed
+ * with one search of the directory when there are at least
+ * CACHE_REFRESH_BATCH_MIN of them.
+ */
+#define CACHE_REFRESH_HOT_TIME 5
+#define CACHE_REFRESH_AGE (CACHE_TIMEOUT * 10000000ULL / 2)
+#define CACHE_REFRESH_INTERVAL (CACHE_TIMEOUT * 1000000 / 4)
+#define CACHE_REFRESH_MAX 256
+#define CACHE_REFRESH_BATCH_MIN 4
 #include "cache.h"
 
 /*
@@ -46,6 +69,14 @@ typedef struct HgfsAttrCache {
    HgfsAttrInfo attr; /* Attribute of a file or directory */
    uint64 changeTime; /* time the attribute was last updated */
    struct list_head list; /* used in linked list implementation */
+   struct HgfsAttrCache *parent; /* entry of the parent directory */
+   uint32 refCount;       /* HashTable reference plus one per child */
+   uint64 updateSeq;      /* cache sequence of the last update */
+   uint64 invalidateSeq;  /* cache sequence of the last invalidation */
+   Bool negative;         /* the path does not exist on the server */
+   Bool parentWriteTimeValid; /* parentWriteTime was known when cached */
+   uint64 parentWriteTime;    /* parent's write time for negative entries */
+   time_t lastAccess;     /* time of the last cache hit */
    char path[0];      /* path of the file corresponding the the attr */
 } HgfsAttrCache;
 
@@ -56,9 +87,33 @@ struct HgfsAttrCache attrList;
 /*Lock for accessing the attribute cache*/
 static pthread_mutex_t HgfsAttrCacheLock = PTHREAD_MUTEX_INITIALIZER;
 
-#if !defined(__FreeBSD__) && !defined(__SOLARIS__)
-static void HgfsInvalidateParentsChildren(const char* parent);
-#endif
+/* Cache counters, protected by HgfsAttrCacheLock. */
+static HgfsCacheStats gCacheStats;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetCacheStats
+ *
+ *    Takes a snapshot of the attribute cache counters.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsGetCacheStats(HgfsCacheStats *stats)      //OUT: Counters snapshot
+{
+   pthread_mutex_lock(&HgfsAttrCacheLock);
+   *stats = gCacheStats;
+   pthread_mutex_unlock(&HgfsAttrCacheLock);
+}
 
 /*
  * Lists are used to manage attribute cache in Solaris and FreeBSD,
@@ -136,11 +191,39 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
       }
    }
 
+   if (res == 0) {
+      gCacheStats.hits++;
+   } else {
+      gCacheStats.misses++;
+   }
+
    pthread_mutex_unlock(&HgfsAttrCacheLock);
    return res;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetNegativeAttrCache
+ *
+ *    Negative entries are only kept in the HashTable implementation.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsSetNegativeAttrCache(const char* path)      //IN: Path of missing file
+{
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -194,6 +277,55 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetAttrCacheSince
+ *
+ *    The list does not track invalidations, so this is the same as
+ *    HgfsSetAttrCache.
+ *
+ * Results:
+ *    0 on success else negative value on error
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsSetAttrCacheSince(const char* path,   //IN: Path of file or directory
+                      HgfsAttrInfo *attr, //IN: Attribute for a given path
+                      uint64 seq)         //IN: Unused
+{
+   return HgfsSetAttrCache(path, attr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheSeq
+ *
+ *    The list does not track invalidations.
+ *
+ * Results:
+ *    Always 0.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+uint64
+HgfsAttrCacheSeq(void)
+{
+   return 0;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -264,6 +396,7 @@ HgfsPurgeCache(void* unused) //IN: Thread argument
          if (diff > CACHE_PURGE_TIME) {
             list_del (&tmp->list);
             free (tmp);
+            gCacheStats.evictions++;
          }
       }
 
@@ -277,6 +410,284 @@ HgfsPurgeCache(void* unused) //IN: Thread argument
 
 GHashTable *g_hash_table;
 
+/*
+ * Sequence number source for the attribute cache. Every update and every
+ * directory invalidation takes the next value, so an entry is only valid
+ * if it was updated after the last invalidation of all of its ancestors.
+ */
+static uint64 gAttrCacheSeq;
+
+/*
+ * The refresh_ahead thread sets gRefreshIdle and waits on gRefreshCond
+ * when it finds no hot entry. The next cache hit wakes it up. Both are
+ * protected by HgfsAttrCacheLock.
+ */
+static pthread_cond_t gRefreshCond = PTHREAD_COND_INITIALIZER;
+static Bool gRefreshIdle;
+
+static void HgfsAttrCacheLinkParent(HgfsAttrCache *entry);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheNow
+ *
+ *    Gets the current time for cache entries, with sub-second precision
+ *    so the refresh window can be shorter than the timeout.
+ *
+ * Results:
+ *    The current time in NT format.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint64
+HgfsAttrCacheNow(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_REALTIME, &now);
+   return HgfsConvertTimeSpecToNtTime(&now);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheUnref
+ *
+ *    Drops a reference to a cache entry, freeing it and releasing its
+ *    reference on the parent entry once the last reference goes away.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The entry and its unreferenced ancestors may be freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsAttrCacheUnref(HgfsAttrCache *entry)      //IN: Cache entry
+{
+   while (entry != NULL) {
+      HgfsAttrCache *parent = entry->parent;
+
+      ASSERT(entry->refCount > 0);
+      if (--entry->refCount > 0) {
+         break;
+      }
+      free(entry);
+      entry = parent;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheNewEntry
+ *
+ *    Allocates a cache entry for the path, links it to the entry of its
+ *    parent directory and adds it to the HashTable. The new entry holds
+ *    no valid attributes until it is updated with HgfsSetAttrCache.
+ *
+ * Results:
+ *    The new entry, NULL if out of memory.
+ *
+ * Side effects:
+ *    Placeholder entries may be created for the missing ancestors.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsAttrCache *
+HgfsAttrCacheNewEntry(const char *path)      //IN: Path of file or directory
+{
+   size_t pathLen = strlen(path);
+   HgfsAttrCache *entry;
+
+   entry = malloc(sizeof *entry + pathLen + 1);
+   if (entry == NULL) {
+      return NULL;
+   }
+
+   memset(entry, 0, sizeof *entry);
+   Str_Strcpy(entry->path, path, pathLen + 1);
+   entry->refCount = 1;
+   HgfsAttrCacheLinkParent(entry);
+
+   g_hash_table_insert(g_hash_table, (gpointer)entry->path, (gpointer)entry);
+   return entry;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheLinkParent
+ *
+ *    Points the entry to the cache entry of its parent directory,
+ *    creating a placeholder for the parent if it is not cached yet.
+ *    Linking every entry to its parent lets a directory invalidation
+ *    reach all cached descendants without walking the HashTable.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsAttrCacheLinkParent(HgfsAttrCache *entry)      //IN/OUT: Cache entry
+{
+   HgfsAttrCache *parent = NULL;
+   char *sep = strrchr(entry->path, '/');
+
+   if (sep != NULL && entry->path[1] != '\0') {
+      /* The parent of a top level entry "/foo" is the root "/". */
+      size_t parentLen = MAX(sep - entry->path, 1);
+      char *parentPath = g_strndup(entry->path, parentLen);
+
+      parent = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, parentPath);
+      if (parent == NULL) {
+         parent = HgfsAttrCacheNewEntry(parentPath);
+      }
+      g_free(parentPath);
+   }
+
+   if (parent == entry->parent) {
+      return;
+   }
+   if (parent != NULL) {
+      parent->refCount++;
+   }
+   HgfsAttrCacheUnref(entry->parent);
+   entry->parent = parent;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheIsValid
+ *
+ *    Checks that the entry has not timed out and that none of its
+ *    ancestors has been invalidated since it was last updated. Negative
+ *    entries time out after NEGATIVE_CACHE_TIMEOUT seconds.
+ *
+ * Results:
+ *    TRUE if the cached attributes can be used, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsAttrCacheIsValid(const HgfsAttrCache *entry)      //IN: Cache entry
+{
+   const HgfsAttrCache *cur;
+   int diff;
+
+   if (entry->updateSeq == 0) {
+      return FALSE;
+   }
+
+   diff = (HgfsAttrCacheNow() - entry->changeTime) / 10000000;
+   LOG(4, ("time since last updated is %d seconds\n", diff));
+   if (diff > (entry->negative ? NEGATIVE_CACHE_TIMEOUT : CACHE_TIMEOUT)) {
+      return FALSE;
+   }
+
+   for (cur = entry; cur != NULL; cur = cur->parent) {
+      if (cur->invalidateSeq > entry->updateSeq) {
+         LOG(4, ("invalidated by %s\n", cur->path));
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNegativeAttrCacheIsValid
+ *
+ *    Checks a negative entry. Besides the usual timeout, the entry is
+ *    dropped as soon as the cached write time of the parent directory
+ *    differs from the one seen when the entry was added, i.e. when the
+ *    directory has been modified on the host.
+ *
+ * Results:
+ *    TRUE if the path is still known not to exist, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNegativeAttrCacheIsValid(const HgfsAttrCache *entry)      //IN: Cache entry
+{
+   const HgfsAttrCache *parent = entry->parent;
+
+   ASSERT(entry->negative);
+
+   if (!HgfsAttrCacheIsValid(entry)) {
+      return FALSE;
+   }
+
+   if (entry->parentWriteTimeValid &&
+       parent != NULL &&
+       parent->updateSeq != 0 &&
+       (parent->attr.mask & HGFS_ATTR_VALID_WRITE_TIME) &&
+       parent->attr.writeTime != entry->parentWriteTime) {
+      LOG(4, ("parent %s modified\n", parent->path));
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheClearNegative
+ *
+ *    Turns a negative entry back into an ordinary one.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsAttrCacheClearNegative(HgfsAttrCache *entry)      //IN/OUT: Cache entry
+{
+   if (entry->negative) {
+      entry->negative = FALSE;
+      ASSERT(gCacheStats.negativeEntries > 0);
+      gCacheStats.negativeEntries--;
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -308,7 +719,8 @@ HgfsInitCache()
  *    Retrieves the attr from the HashTable for a given path.
  *
  * Results:
- *    0 on success else -1 on error
+ *    0 on success, -ENOENT if the path is cached as nonexistent,
+ *    else -1 on error
  *
  * Side effects:
  *    None
@@ -322,7 +734,6 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
 {
    HgfsAttrCache *tmp;
    int res = -1;
-   int diff;
 
    pthread_mutex_lock(&HgfsAttrCacheLock);
 
@@ -330,19 +741,63 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
    if (tmp != NULL) {
       LOG(4, ("cache hit. path = %s\n", tmp->path));
 
-      diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-      LOG(4, ("time since last updated is %d seconds\n", diff));
-      if ( diff <= CACHE_TIMEOUT ) {
+      if (tmp->negative) {
+         if (HgfsNegativeAttrCacheIsValid(tmp)) {
+            res = -ENOENT;
+         }
+      } else if (HgfsAttrCacheIsValid(tmp)) {
          *attr = tmp->attr;
+         tmp->lastAccess = time(NULL);
          res = 0;
+         if (gRefreshIdle) {
+            gRefreshIdle = FALSE;
+            pthread_cond_signal(&gRefreshCond);
+         }
       }
    }
 
+   if (res == 0) {
+      gCacheStats.hits++;
+   } else if (res == -ENOENT) {
+      gCacheStats.negativeHits++;
+   } else {
+      gCacheStats.misses++;
+   }
+
    pthread_mutex_unlock(&HgfsAttrCacheLock);
    return res;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheSeq
+ *
+ *    Returns the current cache sequence number. Attributes fetched after
+ *    this call can be stored with HgfsSetAttrCacheSince and this value.
+ *
+ * Results:
+ *    The sequence number.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+uint64
+HgfsAttrCacheSeq(void)
+{
+   uint64 seq;
+
+   pthread_mutex_lock(&HgfsAttrCacheLock);
+   seq = gAttrCacheSeq;
+   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   return seq;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -362,30 +817,70 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
 int
 HgfsSetAttrCache(const char* path,         //IN: Path of file or directory
                  HgfsAttrInfo *attr)       //IN: Attribute for a given path
+{
+   return HgfsSetAttrCacheSince(path, attr, MAX_UINT64);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetAttrCacheSince
+ *
+ *    Updates the HashTable with attributes that were requested from the
+ *    server when the cache sequence number was seq. The update is
+ *    dropped if the entry, or one of its ancestors, has been updated or
+ *    invalidated since, as the attributes may then predate that change.
+ *    Used for attributes fetched in the background or by a search that
+ *    may race with local modifications.
+ *
+ * Results:
+ *    0 on success else negative value on error
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsSetAttrCacheSince(const char* path,         //IN: Path of file or directory
+                      HgfsAttrInfo *attr,       //IN: Attribute for a given path
+                      uint64 seq)               //IN: Sequence when requested
 {
    HgfsAttrCache *tmp;
+   HgfsAttrCache *cur;
    int res = 0;
 
    pthread_mutex_lock(&HgfsAttrCacheLock);
 
    tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
    if (tmp != NULL) {
-      tmp->attr = *attr;
-      tmp->changeTime = HGFS_GET_TIME(time(NULL));
-      goto out;
+      /* The parent may have been purged and re-created since. */
+      HgfsAttrCacheLinkParent(tmp);
+   } else {
+      tmp = HgfsAttrCacheNewEntry(path);
+      if (tmp == NULL) {
+         res = -ENOMEM;
+         goto out;
+      }
    }
 
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      res = -ENOMEM;
+   if (tmp->updateSeq > seq) {
+      LOG(4, ("stale update dropped. path = %s\n", path));
       goto out;
    }
+   for (cur = tmp; cur != NULL; cur = cur->parent) {
+      if (cur->invalidateSeq > seq) {
+         LOG(4, ("stale update dropped, %s invalidated\n", cur->path));
+         goto out;
+      }
+   }
 
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
+   HgfsAttrCacheClearNegative(tmp);
    tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
-
-   g_hash_table_insert(g_hash_table, (gpointer)tmp->path, (gpointer)tmp);
+   tmp->changeTime = HgfsAttrCacheNow();
+   tmp->updateSeq = ++gAttrCacheSeq;
 
 out:
    pthread_mutex_unlock(&HgfsAttrCacheLock);
@@ -393,12 +888,77 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetNegativeAttrCache
+ *
+ *    Records that the path does not exist on the server. The write time
+ *    of the parent directory is remembered, if cached, so the entry can
+ *    be dropped once the directory changes.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsSetNegativeAttrCache(const char* path)      //IN: Path of missing file
+{
+   HgfsAttrCache *tmp;
+   HgfsAttrCache *parent;
+
+   pthread_mutex_lock(&HgfsAttrCacheLock);
+
+   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   if (tmp == NULL || !tmp->negative) {
+      if (gCacheStats.negativeEntries >= NEGATIVE_CACHE_MAX_SIZE) {
+         LOG(4, ("negative cache full, not adding %s\n", path));
+         goto out;
+      }
+   }
+
+   if (tmp != NULL) {
+      HgfsAttrCacheLinkParent(tmp);
+   } else {
+      tmp = HgfsAttrCacheNewEntry(path);
+      if (tmp == NULL) {
+         goto out;
+      }
+   }
+
+   if (!tmp->negative) {
+      tmp->negative = TRUE;
+      gCacheStats.negativeEntries++;
+   }
+   memset(&tmp->attr, 0, sizeof tmp->attr);
+   tmp->changeTime = HgfsAttrCacheNow();
+   tmp->updateSeq = ++gAttrCacheSeq;
+
+   parent = tmp->parent;
+   tmp->parentWriteTimeValid = parent != NULL &&
+                               !parent->negative &&
+                               HgfsAttrCacheIsValid(parent) &&
+                               (parent->attr.mask & HGFS_ATTR_VALID_WRITE_TIME);
+   tmp->parentWriteTime = tmp->parentWriteTimeValid ?
+                          parent->attr.writeTime : 0;
+
+out:
+   pthread_mutex_unlock(&HgfsAttrCacheLock);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * HgfsInvalidateAttrCache
  *
- *    Invalidate the HashTable entry for a path.
+ *    Invalidate the HashTable entry for a path. Cached descendants of
+ *    a directory are invalidated along with it, in constant time.
  *
  * Results:
  *    None
@@ -417,10 +977,9 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
    pthread_mutex_lock(&HgfsAttrCacheLock);
    tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
    if (tmp != NULL) {
+      LOG(4, ("Invalidating cache entry and children for = %s\n", path));
       tmp->changeTime = 0;
-      if (tmp->attr.type == HGFS_FILE_TYPE_DIRECTORY) {
-         HgfsInvalidateParentsChildren(tmp->path);
-      }
+      tmp->invalidateSeq = ++gAttrCacheSeq;
    }
    pthread_mutex_unlock(&HgfsAttrCacheLock);
 }
@@ -429,11 +988,9 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInvalidateParentsChildren
+ * HgfsRefreshPathsFree
  *
- *    This routine is called by the general function to invalidate a cache
- *    entry. If the entry is a directory this function is called to invalidate
- *    any cached children.
+ *    Frees an array of paths collected by HgfsRefreshCache.
  *
  * Results:
  *    None
@@ -445,36 +1002,178 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
  */
 
 static void
-HgfsInvalidateParentsChildren(const char* parent)      //IN: parent
+HgfsRefreshPathsFree(gpointer data)      //IN: GPtrArray of paths
 {
-   gpointer key, value;
+   GPtrArray *paths = (GPtrArray *)data;
+   guint i;
+
+   for (i = 0; i < paths->len; i++) {
+      g_free(g_ptr_array_index(paths, i));
+   }
+   g_ptr_array_free(paths, TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsRefreshCache
+ *
+ *    Revalidates the entries that were hit recently and are about to
+ *    expire. The candidates are grouped by parent directory: a directory
+ *    with enough of them is searched once, which refreshes all of its
+ *    entries from the V3 search replies, the others are refreshed with
+ *    a getattr each. The server is only contacted with the lock dropped
+ *    and the results are stored against the sequence number taken when
+ *    the candidates were collected, so a concurrent modification is not
+ *    overwritten with older attributes.
+ *
+ * Results:
+ *    TRUE if there were hot entries, FALSE otherwise.
+ *
+ * Side effects:
+ *    Entries of refreshed directories that were not cached yet are added.
+ *    Without hot entries, gRefreshIdle is set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsRefreshCache(void)
+{
+   GHashTable *byParent;
    GHashTableIter iter;
-   size_t parentLen = Str_Strlen(parent, PATH_MAX);
+   gpointer key, value;
+   time_t now = time(NULL);
+   uint64 ntNow = HgfsAttrCacheNow();
+   uint64 seq;
+   uint64 refreshes = 0;
+   uint64 searches = 0;
+   guint count = 0;
+   Bool hot = FALSE;
 
-   LOG(4, ("Invalidating cache children for parent = %s\n",
-           parent));
+   byParent = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                    g_free, HgfsRefreshPathsFree);
 
+   pthread_mutex_lock(&HgfsAttrCacheLock);
+   seq = gAttrCacheSeq;
    g_hash_table_iter_init(&iter, g_hash_table);
+   while (count < CACHE_REFRESH_MAX &&
+          g_hash_table_iter_next(&iter, &key, &value)) {
+      HgfsAttrCache *entry = (HgfsAttrCache *)value;
+      const char *parentPath;
+      GPtrArray *paths;
+
+      if (entry->negative ||
+          now - entry->lastAccess > CACHE_REFRESH_HOT_TIME ||
+          !HgfsAttrCacheIsValid(entry)) {
+         continue;
+      }
+      hot = TRUE;
+      if (ntNow - entry->changeTime < CACHE_REFRESH_AGE) {
+         continue;
+      }
+
+      parentPath = entry->parent != NULL ? entry->parent->path : "";
+      paths = (GPtrArray *)g_hash_table_lookup(byParent, parentPath);
+      if (paths == NULL) {
+         paths = g_ptr_array_new();
+         g_hash_table_insert(byParent, g_strdup(parentPath), paths);
+      }
+      g_ptr_array_add(paths, g_strdup(entry->path));
+      count++;
+   }
+   if (!hot) {
+      gRefreshIdle = TRUE;
+   }
+   pthread_mutex_unlock(&HgfsAttrCacheLock);
 
+   g_hash_table_iter_init(&iter, byParent);
    while (g_hash_table_iter_next(&iter, &key, &value)) {
-      HgfsAttrCache *child = (HgfsAttrCache *)value;
+      const char *parentPath = (const char *)key;
+      GPtrArray *paths = (GPtrArray *)value;
+      guint i;
+
+      if (paths->len >= CACHE_REFRESH_BATCH_MIN &&
+          parentPath[0] != '\0' &&
+          HgfsPrimeAttrCache(parentPath, seq) == 0) {
+         LOG(4, ("refreshed %u entries of %s\n", paths->len, parentPath));
+         refreshes += paths->len;
+         searches++;
+         continue;
+      }
 
-      if (Str_Strncasecmp(parent, child->path, parentLen) == 0) {
-         LOG(10, ("Invalidating cache child = %s\n", child->path));
-         child->changeTime = 0;
+      for (i = 0; i < paths->len; i++) {
+         const char *path = (const char *)g_ptr_array_index(paths, i);
+         HgfsAttrInfo attr;
+         int res;
+
+         memset(&attr, 0, sizeof attr);
+         res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path, &attr);
+         if (res == 0) {
+            HgfsSetAttrCacheSince(path, &attr, seq);
+         } else {
+            LOG(4, ("refresh of %s failed %d\n", path, res));
+            HgfsInvalidateAttrCache(path);
+         }
+         refreshes++;
       }
    }
+   g_hash_table_destroy(byParent);
+
+   pthread_mutex_lock(&HgfsAttrCacheLock);
+   gCacheStats.refreshes += refreshes;
+   gCacheStats.refreshSearches += searches;
+   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   return hot;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache
+ * HgfsRefreshWait
  *
- *    This routine is called by an independent thread to purge the cache,
- *    for performance reasons, the deletion is done in random based
- *    on the order of iteration.
+ *    Waits for the next cache hit after HgfsRefreshCache found no hot
+ *    entries, or until the deadline.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    gRefreshIdle is cleared.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsRefreshWait(time_t deadline)      //IN: Latest time to wake up
+{
+   struct timespec ts;
+
+   ts.tv_sec = deadline;
+   ts.tv_nsec = 0;
+
+   pthread_mutex_lock(&HgfsAttrCacheLock);
+   while (gRefreshIdle) {
+      if (pthread_cond_timedwait(&gRefreshCond, &HgfsAttrCacheLock,
+                                 &ts) == ETIMEDOUT) {
+         break;
+      }
+   }
+   gRefreshIdle = FALSE;
+   pthread_mutex_unlock(&HgfsAttrCacheLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPurgeCacheOnce
+ *
+ *    Drops the expired negative entries, and purges the cache when it
+ *    has grown past its threshold. For performance reasons, the
+ *    deletion is done in random based on the order of iteration.
  *
  * Results:
  *    None
@@ -485,27 +1184,100 @@ HgfsInvalidateParentsChildren(const char* parent)      //IN: parent
  *----------------------------------------------------------------------
  */
 
-void*
-HgfsPurgeCache(void* unused)      //IN: Thread argument
+static void
+HgfsPurgeCacheOnce(void)
 {
    gpointer key, value;
    GHashTableIter iter;
 
-   while (1) {
-      sleep(CACHE_PURGE_SLEEP_TIME);
+   pthread_mutex_lock(&HgfsAttrCacheLock);
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+   /* Expired negative entries are dropped so they free their slots. */
+   if (gCacheStats.negativeEntries > 0) {
+      g_hash_table_iter_init(&iter, g_hash_table);
+      while (g_hash_table_iter_next(&iter, &key, &value)) {
+         HgfsAttrCache *entry = (HgfsAttrCache *)value;
 
-      if (g_hash_table_size(g_hash_table) >= HASH_THRESHOLD_SIZE) {
-         g_hash_table_iter_init(&iter, g_hash_table);
-         while (g_hash_table_iter_next(&iter, &key, &value) &&
-               (g_hash_table_size(g_hash_table) >= HASH_PURGE_SIZE)) {
+         if (entry->negative && !HgfsNegativeAttrCacheIsValid(entry)) {
+            HgfsAttrCacheClearNegative(entry);
+            entry->invalidateSeq = ++gAttrCacheSeq;
             g_hash_table_iter_remove(&iter);
-            free(value);
+            HgfsAttrCacheUnref(entry);
+            gCacheStats.evictions++;
+         }
+      }
+   }
+
+   if (g_hash_table_size(g_hash_table) >= HASH_THRESHOLD_SIZE) {
+      g_hash_table_iter_init(&iter, g_hash_table);
+      while (g_hash_table_iter_next(&iter, &key, &value) &&
+            (g_hash_table_size(g_hash_table) >= HASH_PURGE_SIZE)) {
+         HgfsAttrCache *entry = (HgfsAttrCache *)value;
+
+         /*
+          * The root is pinned: every top level entry is linked to it, so
+          * evicting it would expire the whole cache at once.
+          */
+         if (strcmp(entry->path, "/") == 0) {
+            continue;
          }
+
+         /*
+          * Children still linked to a purged directory would no longer
+          * see invalidations of its replacement, so expire them now.
+          */
+         HgfsAttrCacheClearNegative(entry);
+         entry->invalidateSeq = ++gAttrCacheSeq;
+         g_hash_table_iter_remove(&iter);
+         HgfsAttrCacheUnref(entry);
+         gCacheStats.evictions++;
       }
+   }
 
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&HgfsAttrCacheLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPurgeCache
+ *
+ *    This routine is called by an independent thread to purge the cache.
+ *    With the refresh_ahead mount option it also wakes up every
+ *    CACHE_REFRESH_INTERVAL microseconds to refresh the hot entries
+ *    before they expire, and sleeps until the next cache hit while there
+ *    are none.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void*
+HgfsPurgeCache(void* unused)      //IN: Thread argument
+{
+   time_t lastPurge = time(NULL);
+
+   while (1) {
+      if (!gState->refreshAhead) {
+         sleep(CACHE_PURGE_SLEEP_TIME);
+         HgfsPurgeCacheOnce();
+         continue;
+      }
+
+      usleep(CACHE_REFRESH_INTERVAL);
+      if (!HgfsRefreshCache()) {
+         HgfsRefreshWait(lastPurge + CACHE_PURGE_SLEEP_TIME);
+      }
+      if (time(NULL) - lastPurge >= CACHE_PURGE_SLEEP_TIME) {
+         HgfsPurgeCacheOnce();
+         lastPurge = time(NULL);
+      }
    }
    return 0;
 }
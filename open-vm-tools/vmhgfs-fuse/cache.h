@@ -25,10 +25,27 @@
 #ifndef _HGFS_DRIVER_CACHE_H_
 #define _HGFS_DRIVER_CACHE_H_
 
+/*
+ * Attribute cache counters, reported through the statistics file.
+ */
+typedef struct HgfsCacheStats {
+   uint64 hits;            /* Lookups answered with cached attributes */
+   uint64 negativeHits;    /* Lookups answered with a cached ENOENT */
+   uint64 misses;          /* Lookups that went to the server */
+   uint64 evictions;       /* Entries dropped by the purge thread */
+   uint64 refreshes;       /* Entries revalidated ahead of expiry */
+   uint64 refreshSearches; /* Directory searches used to revalidate */
+   uint32 negativeEntries; /* Negative entries currently cached */
+} HgfsCacheStats;
+
 int HgfsGetAttrCache(const char* path, HgfsAttrInfo *attr);
 int HgfsSetAttrCache(const char* path, HgfsAttrInfo *attr);
+int HgfsSetAttrCacheSince(const char* path, HgfsAttrInfo *attr, uint64 seq);
+uint64 HgfsAttrCacheSeq(void);
+void HgfsSetNegativeAttrCache(const char* path);
 void HgfsInitCache();
 void* HgfsPurgeCache(void*);
 void HgfsInvalidateAttrCache(const char* path);
+void HgfsGetCacheStats(HgfsCacheStats *stats);
 
 #endif
@@ -78,6 +78,11 @@ const struct fuse_opt vmhgfsOpts[] = {
      /* We will change the default value, unless it is specified explicitly. */
      FUSE_OPT_KEY("big_writes",     KEY_BIG_WRITES),
      FUSE_OPT_KEY("nobig_writes",   KEY_NO_BIG_WRITES),
+#ifdef VMHGFS_LOOPBACK
+     VMHGFS_OPT("loopback",         loopback, TRUE),
+#endif
+     VMHGFS_OPT("refresh_ahead",    refreshAhead, TRUE),
+     VMHGFS_OPT("stats_file=%s",    statsFile, 0),
 
      FUSE_OPT_KEY("-V",             KEY_VERSION),
      FUSE_OPT_KEY("--version",      KEY_VERSION),
@@ -121,12 +126,22 @@ Usage(char *prog_name)  // IN
            "                           1 - system OS version is not supported for HGFS FUSE\n"
            "                           2 - system needs FUSE packages for HGFS FUSE\n"
            "\n"
+#ifdef VMHGFS_LOOPBACK
+           "    -o loopback            serve the share from this machine with an\n"
+           "                           in-process HGFS server, for testing only.\n"
+           "                           e.g. %s .host:/root/tmp/dir /mnt/dir -o loopback\n"
+#endif
+           "    -o refresh_ahead       revalidate recently used attributes in the\n"
+           "                           background before they expire\n"
+           "    -o stats_file=PATH     write the client's counters to PATH every\n"
+           "                           few seconds, e.g. /run/vmhgfs-fuse.stats\n"
+           "\n"
 #ifdef VMX86_DEVEL
            "vmhgfs options:\n"
            "    -l   --loglevel NUM    set loglevel=NUM only available in debug build.\n"
            "\n"
 #endif
-           , prog_name, prog_name, prog_name);
+           , prog_name, prog_name, prog_name, prog_name);
 }
 
 #define LIB_MODULEPATH         "/lib/modules"
@@ -502,6 +517,9 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #else
    config.addBigWrites = TRUE;
 #endif
+   config.loopback = FALSE;
+   config.refreshAhead = FALSE;
+   config.statsFile = NULL;
 
    res = fuse_opt_parse(outargs, &config, vmhgfsOpts, vmhgfsOptProc);
    if (res != 0) {
@@ -511,6 +529,9 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #ifdef VMX86_DEVEL
    LOGLEVEL_THRESHOLD = config.logLevel;
 #endif
+   gState->loopback = config.loopback;
+   gState->refreshAhead = config.refreshAhead;
+   gState->statsFile = config.statsFile;
    /* Default option changes for vmhgfs fuse client. */
    if (config.addBigWrites) {
       res = fuse_opt_add_arg(outargs, "-obig_writes");
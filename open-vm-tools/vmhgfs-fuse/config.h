@@ -32,6 +32,9 @@ struct vmhgfsConfig {
 #endif
    int addBigWrites;
    int addAllowOther;
+   int loopback;
+   int refreshAhead;
+   char *statsFile;
 };
 
 int vmhgfsOptProc(void *data, const char *arg,
@@ -22,6 +22,7 @@
  * File operations for the hgfs driver.
  */
 #include "module.h"
+#include "cache.h"
 
 
 #define HGFS_CREATE_DIR_MASK (HGFS_CREATE_DIR_VALID_FILE_NAME | \
@@ -30,6 +31,56 @@
                               HGFS_CREATE_DIR_VALID_GROUP_PERMS | \
                               HGFS_CREATE_DIR_VALID_OTHER_PERMS)
 
+/* Number of directory listings kept by the listing cache. */
+#define HGFS_DIR_LISTING_SLOTS 64
+
+/* Largest listing (in bytes of names) the listing cache will keep. */
+#define HGFS_DIR_LISTING_MAX_SIZE (256 * 1024)
+
+/*
+ * Coarsest timestamp granularity expected of host file systems (FAT
+ * keeps 2 seconds), in NT time units. A directory changed within that
+ * long of being listed may change again without its times moving, so
+ * such a listing is not kept. This also absorbs small differences
+ * between the guest and host clocks.
+ */
+#define HGFS_DIR_LISTING_RACY_TIME (2 * 10000000ULL)
+
+/*
+ * A complete listing of one directory, together with the directory
+ * attributes that were current when it was read. The listing is reused
+ * for as long as the directory reports the same times.
+ */
+typedef struct HgfsDirListing {
+   char *path;           /* Absolute path of the directory, NULL if unused */
+   uint64 writeTime;     /* Directory write time when listed */
+   uint64 attrChangeTime; /* Directory change time when listed */
+   uint64 hostFileId;    /* Directory file id when listed */
+   uint64 listedTime;    /* When the directory was read, NT time */
+   uint64 lastUse;       /* For picking a slot to recycle */
+   uint32 count;         /* Number of entries */
+   char *names;          /* Entry names, each NUL terminated */
+   size_t namesSize;     /* Bytes used in names */
+   size_t namesAlloc;    /* Bytes allocated for names */
+   mode_t *modes;        /* File type bits of each entry */
+   uint32 modesAlloc;    /* Entries allocated for modes */
+} HgfsDirListing;
+
+/*
+ * Passed to HgfsReadDirFromReply in place of the fuse buffer while a
+ * directory is read from the server, so that the entries can be
+ * recorded as they are handed to fuse.
+ */
+typedef struct HgfsDirListingFill {
+   void *dirent;             /* The fuse buffer */
+   fuse_fill_dir_t filldir;  /* The fuse filler */
+   HgfsDirListing *listing;  /* Listing being built, NULL on failure */
+} HgfsDirListingFill;
+
+static HgfsDirListing hgfsDirListings[HGFS_DIR_LISTING_SLOTS];
+static uint64 hgfsDirListingClock;
+static pthread_mutex_t hgfsDirListingLock = PTHREAD_MUTEX_INITIALIZER;
+
 
 
 
@@ -226,6 +277,11 @@ out:
  *    server, while for V3 we may have multiple directory entries. The
  *    number of entries can be read from the reply packet.
  *
+ *    V3 replies carry the same attributes a getattr would return, so
+ *    each entry is also added to the attribute cache. A following
+ *    "ls -l" then stats the entries without a round trip per entry.
+ *    Entries modified locally since cacheSeq are left alone.
+ *
  * Results:
  *    0 on success, anything else on failure.
  *
@@ -236,11 +292,13 @@ out:
  */
 
 static int
-HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
+HgfsReadDirFromReply(const char *dirPath, // IN: Path of the directory
+                     uint32 *f_pos,     // IN/OUT: Offset
                      void *vfsDirent,   // OUT: Buffer to copy dentries into
                      fuse_fill_dir_t filldir, // IN:  Filler function
                      HgfsReq *req,      // IN:  The request containing reply
                      HgfsOp opUsed,     // IN:  request type
+                     uint64 cacheSeq,   // IN:  Cache sequence at search start
                      Bool *done)        // OUT: Set true when there are no
                                         //      more entries
 {
@@ -249,6 +307,8 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
    HgfsDirEntry *hgfsDirent = NULL; /* Only for V3. */
    char *escName = NULL;            /* Buffer for escaped version of name */
    size_t escNameLength = NAME_MAX + 1;
+   char *entryPath = NULL;          /* Buffer for the path of an entry */
+   size_t dirPathLength = strlen(dirPath);
    int result = 0;
 
    ASSERT(req);
@@ -259,6 +319,18 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       return  -ENOMEM;
    }
 
+   if (opUsed == HGFS_OP_SEARCH_READ_V3) {
+      /* The root directory path already ends with a separator. */
+      if (dirPathLength > 0 && dirPath[dirPathLength - 1] == '/') {
+         dirPathLength--;
+      }
+      entryPath = malloc(dirPathLength + 1 + escNameLength);
+      if (entryPath != NULL) {
+         memcpy(entryPath, dirPath, dirPathLength);
+         entryPath[dirPathLength] = '/';
+      }
+   }
+
    replyCount = 1;
    if (opUsed == HGFS_OP_SEARCH_READ_V3) {
       HgfsReplySearchReadV3 *replyV3 = HgfsGetReplyPayload(req);
@@ -277,8 +349,6 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       void *rawAttr;
       char *fileName;
       uint32 fileNameLength;
-      ino_t ino;
-      uint32 d_type;
       struct stat st;
 
       switch(opUsed) {
@@ -324,6 +394,7 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
          *done = TRUE;
          goto out;
       }
+      memset(&attr, 0, sizeof attr);
       result = HgfsUnpackCommonAttr(rawAttr, opUsed, &attr);
       if (result != 0) {
          goto out;
@@ -367,35 +438,14 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       /* Reuse fileNameLength to store the filename length after escape. */
       fileNameLength = result;
 
-      /* Assign the correct dentry type. */
-      switch (attr.type) {
-      case HGFS_FILE_TYPE_SYMLINK:
-         d_type = DT_LNK;
-         break;
-      case HGFS_FILE_TYPE_REGULAR:
-         d_type = DT_REG;
-         break;
-      case HGFS_FILE_TYPE_DIRECTORY:
-         d_type = DT_DIR;
-         break;
-      default:
-         /*
-          * XXX Should never happen. I'd put NOT_IMPLEMENTED() here
-          * but if the driver ever goes in the host it's probably not
-          * a good idea for an attacker to be able to hang the host
-          * simply by using a bogus file type in a reply. [bac]
-          */
-         d_type = DT_UNKNOWN;
-         break;
+      HgfsAttrConvertToStat(&attr, &st);
+
+      if (entryPath != NULL &&
+          strcmp(escName, ".") != 0 && strcmp(escName, "..") != 0) {
+         memcpy(entryPath + dirPathLength + 1, escName, fileNameLength + 1);
+         HgfsSetAttrCacheSince(entryPath, &attr, cacheSeq);
       }
 
-      ino = attr.hostFileId;
-      memset(&st, 0, sizeof(st));
-      st.st_blksize = HGFS_BLOCKSIZE;
-      st.st_blocks = HgfsCalcBlockSize(attr.size);
-      st.st_size = attr.size;
-      st.st_ino = ino;
-      st.st_mode = d_type << 12;
       result = filldir(vfsDirent, escName, &st, 0);
 
       if (result) {
@@ -426,6 +476,7 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
    }
 
 out:
+   free(entryPath);
    free(escName);
    return result;
 }
@@ -515,9 +566,10 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
 /*
  *----------------------------------------------------------------------
  *
- * HgfsReaddir --
+ * HgfsReadDirEntries --
  *
- *    Handle a readdir request. See details below if interested.
+ *    Read all entries of an open search from the server. See details
+ *    below if interested.
  *
  *    Readdir is a bit complicated, and is best understood by reading
  *    the code. For the impatient, here is an overview of the major
@@ -548,10 +600,14 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
  *----------------------------------------------------------------------
  */
 
-int
-HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
-            void *dirent,             // OUT: Buffer to copy dentries into
-            fuse_fill_dir_t filldir)  // IN:  Filler function
+static int
+HgfsReadDirEntries(const char *path,         // IN:  Path of the directory
+                   HgfsHandle handle,        // IN:  Directory handle to read from
+                   void *dirent,             // OUT: Buffer to copy dentries into
+                   fuse_fill_dir_t filldir,  // IN:  Filler function
+                   uint64 cacheSeq,          // IN:  Cache sequence at open
+                   Bool *complete)           // OUT: TRUE if all entries were
+                                             //      passed to filldir
 {
    Bool done = FALSE;
    HgfsReq *request;
@@ -559,6 +615,7 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
    uint32 f_pos = 0;
 
    ASSERT(dirent);
+   *complete = FALSE;
 
    request = HgfsGetNewRequest();
    if (!request) {
@@ -577,8 +634,8 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
          break;
       }
 
-      result = HgfsReadDirFromReply(&f_pos, dirent, filldir, request, opUsed,
-                                    &done);
+      result = HgfsReadDirFromReply(path, &f_pos, dirent, filldir, request,
+                                    opUsed, cacheSeq, &done);
 
       LOG(4, ("f_pos = %d\n", f_pos));
       if (result == -ENAMETOOLONG) {
@@ -595,11 +652,600 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
    if (done == TRUE) {
       LOG(6, ("End of dir reached.\n"));
    }
+   *complete = done && result == 0;
    HgfsFreeRequest(request);
    return result;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirClose --
+ *
+ *    Close a search opened with HgfsDirOpen.
+ *
+ * Results:
+ *    Returns zero on success, negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsDirClose(HgfsHandle handle)     // IN: Handle to the dir
+{
+   HgfsReq *req;
+   HgfsOp opUsed;
+   HgfsStatus replyStatus;
+   int result;
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      LOG(4, ("Out of memory while getting new request.\n"));
+      result = -ENOMEM;
+      goto out;
+   }
+
+retry:
+   opUsed = hgfsVersionSearchClose;
+   if (opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+      HgfsRequestSearchCloseV3 *requestV3 = HgfsGetRequestPayload(req);
+
+      requestV3->search = handle;
+      requestV3->reserved = 0;
+      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+   } else {
+      HgfsRequestSearchClose *request;
+
+      request = (HgfsRequestSearchClose *)(HGFS_REQ_PAYLOAD(req));
+      request->search = handle;
+      req->payloadSize = sizeof *request;
+   }
+
+   /* Fill in header here as payloadSize needs to be there. */
+   HgfsPackHeader(req, opUsed);
+
+   /* Send the request and process the reply. */
+   result = HgfsSendRequest(req);
+   if (result == 0) {
+      replyStatus = HgfsGetReplyStatus(req);
+      result = HgfsStatusConvertToLinux(replyStatus);
+
+      switch (result) {
+      case 0:
+         LOG(6, ("Closed search handle %u\n", handle));
+         break;
+      case -EPROTO:
+         /* Retry with older version(s). Set globally. */
+         if (opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+            LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
+            hgfsVersionSearchClose = HGFS_OP_SEARCH_CLOSE;
+            goto retry;
+         }
+         break;
+      default:
+         LOG(4, ("Failed. handle = %u\n", handle));
+         break;
+      }
+   } else if (result == -EIO) {
+      LOG(4, ("Timed out. error: %d\n", result));
+   } else if (result == -EPROTO) {
+      LOG(4, ("Server returned error: %d\n", result));
+   } else {
+      LOG(4, ("Unknown error: %d\n", result));
+   }
+
+out:
+   HgfsFreeRequest(req);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingFree --
+ *
+ *    Release the contents of a listing cache slot.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The slot is marked unused.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsDirListingFree(HgfsDirListing *listing)   // IN/OUT: Listing to free
+{
+   free(listing->path);
+   free(listing->names);
+   free(listing->modes);
+   memset(listing, 0, sizeof *listing);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingMatches --
+ *
+ *    Checks whether a cached listing was taken while the directory had
+ *    the given attributes. Both the write and the change time must be
+ *    reported by the server, otherwise the listing is never trusted.
+ *
+ * Results:
+ *    TRUE if the listing can be replayed, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsDirListingMatches(const HgfsDirListing *listing, // IN: Cached listing
+                      const HgfsAttrInfo *attr)      // IN: Current dir attrs
+{
+   return listing->writeTime == attr->writeTime &&
+          listing->attrChangeTime == attr->attrChangeTime &&
+          listing->hostFileId == attr->hostFileId;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingLookup --
+ *
+ *    Copy the cached listing of a directory, so that it can be replayed
+ *    without holding hgfsDirListingLock.
+ *
+ * Results:
+ *    TRUE if a listing was found and copied, FALSE otherwise.
+ *
+ * Side effects:
+ *    The copy must be released with HgfsDirListingFree.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsDirListingLookup(const char *path,          // IN: Path of the directory
+                     HgfsDirListing *copy)      // OUT: Copy of the listing
+{
+   Bool found = FALSE;
+   uint32 i;
+
+   memset(copy, 0, sizeof *copy);
+   pthread_mutex_lock(&hgfsDirListingLock);
+   for (i = 0; i < HGFS_DIR_LISTING_SLOTS; i++) {
+      HgfsDirListing *listing = &hgfsDirListings[i];
+
+      if (listing->path == NULL || strcmp(listing->path, path) != 0) {
+         continue;
+      }
+
+      *copy = *listing;
+      copy->path = NULL;
+      copy->names = malloc(MAX(listing->namesSize, 1));
+      copy->modes = malloc(MAX(listing->count, 1) * sizeof *copy->modes);
+      if (copy->names == NULL || copy->modes == NULL) {
+         HgfsDirListingFree(copy);
+         break;
+      }
+      memcpy(copy->names, listing->names, listing->namesSize);
+      memcpy(copy->modes, listing->modes,
+             listing->count * sizeof *copy->modes);
+      copy->namesAlloc = listing->namesSize;
+      copy->modesAlloc = listing->count;
+      listing->lastUse = ++hgfsDirListingClock;
+      found = TRUE;
+      break;
+   }
+   pthread_mutex_unlock(&hgfsDirListingLock);
+   return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingReplay --
+ *
+ *    Pass a listing to filldir.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsDirListingReplay(const HgfsDirListing *listing, // IN: Listing to replay
+                     void *dirent,                  // OUT: Buffer to fill
+                     fuse_fill_dir_t filldir)       // IN: Filler function
+{
+   const char *name = listing->names;
+   struct stat st;
+   uint32 n;
+
+   memset(&st, 0, sizeof st);
+   for (n = 0; n < listing->count; n++) {
+      st.st_mode = listing->modes[n];
+      if (filldir(dirent, name, &st, 0)) {
+         break;
+      }
+      name += strlen(name) + 1;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingStore --
+ *
+ *    Keep a freshly read listing in the cache, replacing any older
+ *    listing of the same directory or else the least recently used one.
+ *    A listing taken while the directory times were too recent to tell
+ *    later changes apart is dropped instead, as is any older listing of
+ *    the directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The contents of newListing are moved into the cache or freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsDirListingStore(const char *path,          // IN: Path of the directory
+                    const HgfsAttrInfo *attr,  // IN: Dir attrs
+                    HgfsDirListing *newListing) // IN/OUT: Listing to keep
+{
+   HgfsDirListing *slot = NULL;
+   Bool racy;
+   uint32 i;
+
+   racy = attr->writeTime + HGFS_DIR_LISTING_RACY_TIME >=
+             newListing->listedTime ||
+          attr->attrChangeTime + HGFS_DIR_LISTING_RACY_TIME >=
+             newListing->listedTime;
+   if (racy) {
+      LOG(4, ("Not caching listing of %s, changed too recently\n", path));
+      HgfsDirListingFree(newListing);
+   } else {
+      newListing->path = strdup(path);
+      if (newListing->path == NULL) {
+         HgfsDirListingFree(newListing);
+      }
+   }
+   newListing->writeTime = attr->writeTime;
+   newListing->attrChangeTime = attr->attrChangeTime;
+   newListing->hostFileId = attr->hostFileId;
+
+   pthread_mutex_lock(&hgfsDirListingLock);
+   for (i = 0; i < HGFS_DIR_LISTING_SLOTS; i++) {
+      HgfsDirListing *listing = &hgfsDirListings[i];
+
+      if (listing->path != NULL && strcmp(listing->path, path) == 0) {
+         slot = listing;
+         break;
+      }
+      if (newListing->path == NULL) {
+         continue;
+      }
+      if (slot == NULL ||
+          (slot->path != NULL &&
+           (listing->path == NULL || listing->lastUse < slot->lastUse))) {
+         slot = listing;
+      }
+   }
+   if (slot != NULL) {
+      HgfsDirListingFree(slot);
+      if (newListing->path != NULL) {
+         *slot = *newListing;
+         slot->lastUse = ++hgfsDirListingClock;
+      }
+   }
+   pthread_mutex_unlock(&hgfsDirListingLock);
+   memset(newListing, 0, sizeof *newListing);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirListingFiller --
+ *
+ *    fuse_fill_dir_t used while reading a directory from the server.
+ *    Records each entry in the listing being built and forwards it to
+ *    the real filler.
+ *
+ * Results:
+ *    The result of the real filler.
+ *
+ * Side effects:
+ *    If the listing cannot be grown it is dropped, the directory is
+ *    still listed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsDirListingFiller(void *buf,                // IN: HgfsDirListingFill
+                     const char *name,         // IN: Entry name
+                     const struct stat *stbuf, // IN: Entry attributes
+                     off_t off)                // IN: Entry offset
+{
+   HgfsDirListingFill *fill = buf;
+   HgfsDirListing *listing = fill->listing;
+   size_t nameSize = strlen(name) + 1;
+
+   if (listing != NULL) {
+      if (listing->namesSize + nameSize > HGFS_DIR_LISTING_MAX_SIZE) {
+         goto drop;
+      }
+      if (listing->namesSize + nameSize > listing->namesAlloc) {
+         size_t newAlloc = MAX(listing->namesAlloc * 2, 4096);
+         char *names;
+
+         while (newAlloc < listing->namesSize + nameSize) {
+            newAlloc *= 2;
+         }
+         names = realloc(listing->names, newAlloc);
+         if (names == NULL) {
+            goto drop;
+         }
+         listing->names = names;
+         listing->namesAlloc = newAlloc;
+      }
+      if (listing->count == listing->modesAlloc) {
+         uint32 newAlloc = MAX(listing->modesAlloc * 2, 64);
+         mode_t *modes = realloc(listing->modes, newAlloc * sizeof *modes);
+
+         if (modes == NULL) {
+            goto drop;
+         }
+         listing->modes = modes;
+         listing->modesAlloc = newAlloc;
+      }
+      memcpy(listing->names + listing->namesSize, name, nameSize);
+      listing->namesSize += nameSize;
+      /* Only the file type is reported by readdir. */
+      listing->modes[listing->count++] = stbuf != NULL ?
+                                         stbuf->st_mode & S_IFMT : 0;
+   }
+   return fill->filldir(fill->dirent, name, stbuf, off);
+
+drop:
+   LOG(4, ("Not caching listing, %u entries so far\n", listing->count));
+   HgfsDirListingFree(listing);
+   fill->listing = NULL;
+   return fill->filldir(fill->dirent, name, stbuf, off);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInvalidateDirListing --
+ *
+ *    Drop the cached listing of the directory containing path, and of
+ *    path itself should it be a directory. Called after the guest
+ *    creates, removes or renames an entry, since the host directory
+ *    times may not have changed visibly in that short a time.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateDirListing(const char *path)    // IN: Path of changed entry
+{
+   const char *sep = strrchr(path, '/');
+   size_t parentLength = sep == NULL ? 0 : MAX(sep - path, 1);
+   uint32 i;
+
+   pthread_mutex_lock(&hgfsDirListingLock);
+   for (i = 0; i < HGFS_DIR_LISTING_SLOTS; i++) {
+      HgfsDirListing *listing = &hgfsDirListings[i];
+
+      if (listing->path == NULL) {
+         continue;
+      }
+      if (strcmp(listing->path, path) == 0 ||
+          (strlen(listing->path) == parentLength &&
+           strncmp(listing->path, path, parentLength) == 0)) {
+         LOG(4, ("Dropping listing of %s\n", listing->path));
+         HgfsDirListingFree(listing);
+      }
+   }
+   pthread_mutex_unlock(&hgfsDirListingLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReaddir --
+ *
+ *    Handle a readdir request.
+ *
+ *    If a listing of the directory is cached, the directory attributes
+ *    are taken from the attribute cache, or else fetched from the
+ *    server. If they match those of the listing, it is replayed and that
+ *    getattr is the only round trip. Otherwise the directory is searched
+ *    as usual and the result is cached for the next time, with the
+ *    directory attributes from the attribute cache if it has them.
+ *
+ *    Whatever the age of those attributes, a change made after the
+ *    search started gives the directory times later than the start of
+ *    the search, less the timestamp granularity, and listings with such
+ *    times are not kept. So a stored listing never hides a change.
+ *
+ * Results:
+ *    Returns zero if on success, negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsReaddir(const char *path,         // IN:  Path of the directory
+            void *dirent,             // OUT: Buffer to copy dentries into
+            fuse_fill_dir_t filldir)  // IN:  Filler function
+{
+   HgfsAttrInfo attr;
+   HgfsDirListing listing;
+   HgfsDirListingFill fill;
+   HgfsHandle handle = HGFS_INVALID_HANDLE;
+   Bool complete = FALSE;
+   uint64 cacheSeq;
+   int result;
+
+   ASSERT(dirent);
+
+   if (HgfsDirListingLookup(path, &listing)) {
+      memset(&attr, 0, sizeof attr);
+      result = HgfsGetAttrCache(path, &attr);
+      if (result != 0) {
+         result = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path, &attr);
+         if (result == 0) {
+            HgfsSetAttrCache(path, &attr);
+         }
+      }
+      if (result == 0 && HgfsDirListingMatches(&listing, &attr)) {
+         HgfsDirListingReplay(&listing, dirent, filldir);
+         LOG(4, ("Replayed %u entries of %s\n", listing.count, path));
+         HgfsDirListingFree(&listing);
+         return 0;
+      }
+      LOG(4, ("Listing of %s is out of date\n", path));
+      HgfsDirListingFree(&listing);
+   }
+
+   cacheSeq = HgfsAttrCacheSeq();
+   result = HgfsDirOpen(path, &handle);
+   if (result < 0) {
+      return result;
+   }
+
+   memset(&listing, 0, sizeof listing);
+   listing.listedTime = HGFS_GET_TIME(time(NULL));
+   fill.dirent = dirent;
+   fill.filldir = filldir;
+   fill.listing = &listing;
+
+   result = HgfsReadDirEntries(path, handle, &fill, HgfsDirListingFiller,
+                               cacheSeq, &complete);
+   HgfsDirClose(handle);
+
+   if (fill.listing != NULL) {
+      memset(&attr, 0, sizeof attr);
+      if (complete &&
+          HgfsGetAttrCache(path, &attr) == 0 &&
+          (attr.mask & HGFS_ATTR_VALID_WRITE_TIME) &&
+          (attr.mask & HGFS_ATTR_VALID_CHANGE_TIME)) {
+         HgfsDirListingStore(path, &attr, &listing);
+      } else {
+         HgfsDirListingFree(&listing);
+      }
+   }
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPrimeFiller --
+ *
+ *    Filler used by HgfsPrimeAttrCache, which only wants the side effect
+ *    of searching the directory on the attribute cache.
+ *
+ * Results:
+ *    Always 0.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsPrimeFiller(void *buf,                // IN: Unused
+                const char *name,         // IN: Unused
+                const struct stat *stbuf, // IN: Unused
+                off_t off)                // IN: Unused
+{
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPrimeAttrCache --
+ *
+ *    Searches a directory only to refresh the cached attributes of its
+ *    entries from the V3 search replies, one round trip per reply
+ *    instead of one per entry. Attributes of entries modified locally
+ *    since cacheSeq are not stored.
+ *
+ * Results:
+ *    Returns zero on success, -EPROTO if the server does not return
+ *    attributes with the search, other negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsPrimeAttrCache(const char *path,    // IN: Path of the directory
+                   uint64 cacheSeq)     // IN: Cache sequence when requested
+{
+   HgfsHandle handle = HGFS_INVALID_HANDLE;
+   Bool complete = FALSE;
+   int result;
+
+   if (hgfsVersionSearchRead != HGFS_OP_SEARCH_READ_V3) {
+      return -EPROTO;
+   }
+
+   result = HgfsDirOpen(path, &handle);
+   if (result < 0) {
+      return result;
+   }
+
+   /* The filler ignores its buffer. */
+   result = HgfsReadDirEntries(path, handle, (void *)path, HgfsPrimeFiller,
+                               cacheSeq, &complete);
+   HgfsDirClose(handle);
+   return result;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
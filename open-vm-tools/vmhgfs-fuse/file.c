@@ -29,6 +29,7 @@
 #include "hgfsUtil.h"
 #include "fsutil.h"
 #include "file.h"
+#include "stats.h"
 #include "vm_assert.h"
 #include "vm_basic_types.h"
 
@@ -629,6 +630,7 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
          /* Return result. */
          memcpy(buf, payload, actualSize);
          LOG(8, ("Copied %u\n", actualSize));
+         HgfsStatsAddBytesRead(actualSize);
          result = actualSize;
          break;
 
@@ -727,6 +729,9 @@ HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
  *    request.
  *
  *    We send a "Write" request to the server with the given handle.
+ *    The data is copied from src straight into the request packet, so
+ *    when fuse spliced the write from the kernel it is read from the
+ *    pipe into the packet without a staging buffer in between.
  *
  * Results:
  *    Returns the number of bytes written on success, or an error on failure.
@@ -739,7 +744,7 @@ HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
 
 static int
 HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
-            const char *buf,         // IN: Buffer containing data
+            struct fuse_bufvec *src, // IN/OUT: Data, consumed as copied
             size_t count,            // IN: Number of bytes to write
             loff_t offset)           // IN: Offset to begin writing at
 {
@@ -749,10 +754,11 @@ HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
    uint32 requiredSize = 0;
    uint32 actualSize = 0;
    char *payload = NULL;
+   char *copiedPayload = NULL;
    uint32 reqSize;
    HgfsStatus replyStatus;
 
-   ASSERT(buf);
+   ASSERT(src);
 
    req = HgfsGetNewRequest();
    if (!req) {
@@ -772,7 +778,6 @@ HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
       requestV3->requiredSize = count;
       requestV3->reserved = 0;
       payload = requestV3->payload;
-      requiredSize = requestV3->requiredSize;
       reqSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
 
    } else {
@@ -784,11 +789,33 @@ HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
       request->offset = offset;
       request->requiredSize = count;
       payload = request->payload;
-      requiredSize = request->requiredSize;
       reqSize = sizeof *request;
    }
 
-   memcpy(payload, buf, requiredSize);
+   if (copiedPayload == NULL) {
+      struct fuse_bufvec dst = FUSE_BUFVEC_INIT(count);
+      ssize_t copied;
+
+      dst.buf[0].mem = payload;
+      copied = fuse_buf_copy(&dst, src, 0);
+      if (copied < 0) {
+         LOG(4, ("Failed to copy write data: %"FMTSZ"d\n", copied));
+         result = copied;
+         goto out;
+      }
+      requiredSize = copied;
+   } else if (copiedPayload != payload) {
+      /* The data was already taken from src for the newer request format. */
+      memmove(payload, copiedPayload, requiredSize);
+   }
+   copiedPayload = payload;
+
+   if (opUsed == HGFS_OP_WRITE_V3) {
+      ((HgfsRequestWriteV3 *)HgfsGetRequestPayload(req))->requiredSize =
+         requiredSize;
+   } else {
+      ((HgfsRequestWrite *)HGFS_REQ_PAYLOAD(req))->requiredSize = requiredSize;
+   }
    req->payloadSize = reqSize + requiredSize - 1;
 
    /* Fill in header here as payloadSize needs to be there. */
@@ -814,6 +841,7 @@ HgfsDoWrite(HgfsHandle handle,       // IN: Handle for the file
 
          /* Return result. */
          LOG(6, ("wrote %u bytes\n", actualSize));
+         HgfsStatsAddBytesWritten(actualSize);
          result = actualSize;
          break;
 
@@ -847,33 +875,37 @@ out:
 /*
  *----------------------------------------------------------------------
  *
- * HgfsWrite --
+ * HgfsWriteBuf --
  *
- *    Called whenever a process writes to a file in our filesystem.
+ *    Called whenever a process writes to a file in our filesystem and
+ *    fuse hands us the data as a buffer vector, which may refer to the
+ *    pipe the write was spliced into rather than to memory.
+ *
+ *    Data taken from the vector cannot be put back, so a short write
+ *    by the server ends the request with the count written so far.
  *
  * Results:
  *    Returns the number of bytes written on success, or an error on
  *    failure.
  *
  * Side effects:
- *    None
+ *    src is consumed.
  *
  *----------------------------------------------------------------------
  */
 
 ssize_t
-HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
-         const char  *buf,            // OUT: User buffer to copy data into
-         size_t count,                // IN:  Number of bytes to read
-         loff_t offset)               // IN:  Offset at which to read
+HgfsWriteBuf(struct fuse_file_info *fi,  // IN: File info structure
+             struct fuse_bufvec *src,     // IN/OUT: Data to write
+             loff_t offset)               // IN: Offset at which to write
 {
    int result;
-   const char *buffer = buf;
    loff_t curOffset = offset;
+   size_t count = fuse_buf_size(src);
    size_t nextCount, remainingCount = count;
    ssize_t bytesWritten = 0;
 
-   ASSERT(NULL != buf);
+   ASSERT(NULL != src);
    ASSERT(NULL != fi);
 
    LOG(6, ("Entry(0x%"FMT64"x off bytes 0x%"FMTSZ"x @ 0x%"FMT64"x)\n",
@@ -886,7 +918,7 @@ HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
       LOG(4, ("Issue DoWrite(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
               fi->fh, nextCount, curOffset));
 
-      result = HgfsDoWrite(fi->fh, buffer, nextCount, curOffset);
+      result = HgfsDoWrite(fi->fh, src, nextCount, curOffset);
       if (result < 0) {
          bytesWritten = result;
          LOG(4, ("Error: written 0x%"FMTSZ"x bytes DoWrite -> %d\n",
@@ -895,9 +927,8 @@ HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
       }
       remainingCount -= result;
       curOffset += result;
-      buffer += result;
 
-   } while ((result > 0) && (remainingCount > 0));
+   } while ((result == nextCount) && (remainingCount > 0));
 
    bytesWritten = count - remainingCount;
 
@@ -907,6 +938,38 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWrite --
+ *
+ *    Called whenever a process writes to a file in our filesystem.
+ *
+ * Results:
+ *    Returns the number of bytes written on success, or an error on
+ *    failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
+         const char  *buf,            // IN: User buffer to copy data from
+         size_t count,                // IN: Number of bytes to write
+         loff_t offset)               // IN: Offset at which to write
+{
+   struct fuse_bufvec src = FUSE_BUFVEC_INIT(count);
+
+   ASSERT(NULL != buf);
+
+   src.buf[0].mem = (void *)buf;
+   return HgfsWriteBuf(fi, &src, offset);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -47,6 +47,15 @@ typedef struct HgfsFuseState {
 
    GKeyFile *conf;
 
+   /* Serve requests with an in process server instead of the host. */
+   Bool loopback;
+
+   /* Refresh hot attribute cache entries before they expire. */
+   Bool refreshAhead;
+
+   /* File the counters are written to, outside the mount, or NULL. */
+   char *statsFile;
+
 } HgfsFuseState;
 
 /* Public functions (with respect to the entire module). */
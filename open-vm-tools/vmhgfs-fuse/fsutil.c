@@ -699,6 +699,86 @@ HgfsCalcBlockSize(uint64 tsize)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrConvertToStat --
+ *
+ *    Fill a struct stat from the attributes returned by the server.
+ *    Used for getattr replies as well as for directory entries, whose
+ *    search read replies carry the same attributes.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsAttrConvertToStat(const HgfsAttrInfo *attr,  // IN: HGFS attributes
+                      struct stat *stbuf)        // OUT: Stat to fill
+{
+   uint32 d_type;
+
+   memset(stbuf, 0, sizeof *stbuf);
+
+   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
+      stbuf->st_mode |= (attr->specialPerms << 9);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
+      stbuf->st_mode |= (attr->ownerPerms << 6);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
+      stbuf->st_mode |= (attr->groupPerms << 3);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
+      stbuf->st_mode |= (attr->otherPerms);
+   }
+
+   /* Mask the access mode. */
+   switch (attr->type) {
+   case HGFS_FILE_TYPE_SYMLINK:
+      d_type = DT_LNK;
+      break;
+
+   case HGFS_FILE_TYPE_REGULAR:
+      d_type = DT_REG;
+      break;
+
+   case HGFS_FILE_TYPE_DIRECTORY:
+      d_type = DT_DIR;
+      break;
+
+   default:
+      d_type = DT_UNKNOWN;
+      break;
+   }
+
+   stbuf->st_mode |= d_type << 12;
+   stbuf->st_blksize = HGFS_BLOCKSIZE;
+   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
+   stbuf->st_size = attr->size;
+   stbuf->st_ino = attr->hostFileId;
+   stbuf->st_nlink = 1;
+   stbuf->st_uid = attr->userId;
+   stbuf->st_gid = attr->groupId;
+   stbuf->st_rdev = 0;
+
+   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
+      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
+      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
+      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -75,6 +75,11 @@ HgfsWrite(struct fuse_file_info *fi,
           size_t count,
           loff_t offset);
 
+ssize_t
+HgfsWriteBuf(struct fuse_file_info *fi,
+             struct fuse_bufvec *src,
+             loff_t offset);
+
 int
 HgfsRename(const char* from, const char* to);
 
@@ -120,10 +125,17 @@ int
 HgfsDirOpen(const char* path, HgfsHandle* handle);
 
 int
-HgfsReaddir(HgfsHandle handle,
+HgfsReaddir(const char *path,
             void *dirent,
             fuse_fill_dir_t filldir);
 
+int
+HgfsPrimeAttrCache(const char *path,
+                   uint64 cacheSeq);
+
+void
+HgfsInvalidateDirListing(const char *path);
+
 int
 HgfsMkdir(const char *path,
           int mode);
@@ -142,4 +154,8 @@ HgfsResetOps(void);
 unsigned long
 HgfsCalcBlockSize(uint64 tsize);
 
+void
+HgfsAttrConvertToStat(const HgfsAttrInfo *attr,
+                      struct stat *stbuf);
+
 #endif // _HGFS_DRIVER_FSUTIL_H_
@@ -0,0 +1,215 @@
+#!/bin/sh
+##########################################################
+# Copyright (C) 2019 VMware, Inc. All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published
+# by the Free Software Foundation version 2.1 and no later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+#
+##########################################################
+
+
+#
+# hgfs-bench.sh
+#
+# Runs a set of file system workloads against a vmhgfs-fuse mount and
+# prints the elapsed time of each. Without a mount point argument, a
+# scratch directory is served by vmhgfs-loopback, the test build of the
+# client with the loopback channel, so the client can be measured on any
+# Linux machine with FUSE:
+#
+#    hgfs-bench.sh [-b vmhgfs-loopback] [-n files] [-s MB] [-S stats file]
+#                  [mountpoint]
+#
+# Results are printed as "<workload> <seconds> [<cpu seconds>]" lines,
+# followed by the client statistics, so runs can be compared with diff
+# or awk. For a given mount point, the statistics are those of the file
+# it was mounted with "-o stats_file=", if given with -S. The CPU time
+# of the client is only known when this script started it; for the
+# sequential workloads it is also given per GB.
+#
+
+bin=vmhgfs-loopback
+files=2000
+sizeMB=64
+mnt=
+src=
+mounted=0
+pid=
+stats=
+
+while getopts b:n:s:S: opt; do
+    case $opt in
+    b) bin=$OPTARG ;;
+    n) files=$OPTARG ;;
+    s) sizeMB=$OPTARG ;;
+    S) stats=$OPTARG ;;
+    *) echo "usage: $0 [-b vmhgfs-loopback] [-n files] [-s MB] [-S stats file]" \
+            "[mountpoint]" >&2
+       exit 2 ;;
+    esac
+done
+shift `expr $OPTIND - 1`
+
+cleanup() {
+    if [ -n "$mnt" ]; then
+        rm -rf "$mnt/bench"
+    fi
+    if [ $mounted -eq 1 ]; then
+        fusermount -u "$mnt"
+        rmdir "$mnt"
+        rm -rf "$src"
+        mounted=0
+    fi
+}
+trap cleanup EXIT
+
+if [ $# -ge 1 ]; then
+    mnt=$1
+else
+    src=`mktemp -d` || exit 1
+    mnt=`mktemp -d` || exit 1
+    stats="$src.stats"
+    "$bin" ".host:/root$src" "$mnt" -o "loopback,stats_file=$stats" || exit 1
+    mounted=1
+    binName=`basename "$bin"`
+    pid=`pgrep -n -x "$binName"`
+fi
+
+now() {
+    date +%s.%N
+}
+
+# CPU time of the client in seconds, empty if unknown.
+cputime() {
+    if [ -n "$pid" ] && [ -r /proc/$pid/stat ]; then
+        awk -v hz=`getconf CLK_TCK` '{ print ($14 + $15) / hz }' \
+            /proc/$pid/stat
+    fi
+}
+
+# run <name> <MB moved or 0> <command...>: time one workload.
+run() {
+    name=$1
+    mb=$2
+    shift 2
+    sync
+    start=`now`
+    cpuStart=`cputime`
+    "$@" || echo "$name failed" >&2
+    end=`now`
+    cpuEnd=`cputime`
+    line="$name `echo "$end - $start" | bc`"
+    if [ -n "$cpuStart" ]; then
+        cpu=`echo "$cpuEnd - $cpuStart" | bc`
+        line="$line cpu=$cpu"
+        if [ $mb -gt 0 ]; then
+            line="$line cpu_per_gb=`echo "scale=3; $cpu * 1024 / $mb" | bc`"
+        fi
+    fi
+    echo "$line"
+}
+
+metadata_storm() {
+    mkdir "$mnt/bench/meta"
+    i=0
+    while [ $i -lt $files ]; do
+        : > "$mnt/bench/meta/f$i"
+        i=`expr $i + 1`
+    done
+    ls -l "$mnt/bench/meta" > /dev/null
+    i=0
+    while [ $i -lt $files ]; do
+        stat "$mnt/bench/meta/f$i" "$mnt/bench/meta/missing$i" \
+             > /dev/null 2>&1
+        i=`expr $i + 1`
+    done
+    rm -rf "$mnt/bench/meta"
+}
+
+seq_write() {
+    dd if=/dev/zero of="$mnt/bench/seq" bs=1M count=$sizeMB 2> /dev/null
+}
+
+seq_read() {
+    dd if="$mnt/bench/seq" of=/dev/null bs=1M 2> /dev/null
+}
+
+rand_write() {
+    i=0
+    while [ $i -lt 256 ]; do
+        dd if=/dev/zero of="$mnt/bench/seq" bs=4k count=1 conv=notrunc \
+           seek=`awk -v s=$i -v m=$sizeMB 'BEGIN { srand(s); print int(rand() * m * 256) }'` \
+           2> /dev/null
+        i=`expr $i + 1`
+    done
+}
+
+rand_read() {
+    i=0
+    while [ $i -lt 256 ]; do
+        dd if="$mnt/bench/seq" of=/dev/null bs=4k count=1 \
+           skip=`awk -v s=$i -v m=$sizeMB 'BEGIN { srand(s); print int(rand() * m * 256) }'` \
+           2> /dev/null
+        i=`expr $i + 1`
+    done
+}
+
+untar() {
+    mkdir "$mnt/bench/tree"
+    tar -C "$mnt/bench/tree" -xf "$tarball"
+}
+
+parallel_find() {
+    ls "$mnt/bench/tree" | \
+       xargs -P 4 -I{} find "$mnt/bench/tree/{}" -type f -size +0 > /dev/null
+}
+
+# A source tree of many small files for the untar and find workloads.
+tarball=`mktemp` || exit 1
+tardir=`mktemp -d` || exit 1
+for d in a b c d e f g h; do
+    mkdir -p "$tardir/$d/sub"
+    i=0
+    while [ $i -lt 100 ]; do
+        echo "$d $i" > "$tardir/$d/file$i"
+        echo "$d $i" > "$tardir/$d/sub/file$i"
+        i=`expr $i + 1`
+    done
+done
+tar -C "$tardir" -cf "$tarball" . && rm -rf "$tardir"
+
+mkdir -p "$mnt/bench" || exit 1
+
+run metadata_storm 0 metadata_storm
+run seq_write $sizeMB seq_write
+run seq_read $sizeMB seq_read
+run rand_write 0 rand_write
+run rand_read 0 rand_read
+run untar 0 untar
+run parallel_find 0 parallel_find
+
+rm -f "$tarball"
+
+if [ -n "$pid" ]; then
+    # The client writes its final counters when it is unmounted.
+    cleanup
+    while kill -0 $pid 2>/dev/null; do
+        sleep 0.1
+    done
+fi
+if [ -n "$stats" ] && [ -r "$stats" ]; then
+    cat "$stats"
+fi
+if [ -n "$src" ]; then
+    rm -f "$stats"
+fi
@@ -0,0 +1,270 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * loopback.c --
+ *
+ * Channel that hands requests to an HGFS server running in this
+ * process instead of sending them to the host. The server exports the
+ * guest's own file system as the "root" share, so mounting
+ * ".host:/root/some/dir" with the loopback option serves a local
+ * directory. This is for measuring and testing the client on machines
+ * that are not VMs.
+ */
+
+#include "hgfsProto.h"
+#include "hgfsServerManager.h"
+#include "loopback.h"
+#include "module.h"
+#include "request.h"
+#include "transport.h"
+#include "vm_assert.h"
+
+typedef struct HgfsLoopbackData {
+   HgfsServerMgrData mgrData;                /* Server registration */
+   char replyPacket[HGFS_LARGE_PACKET_MAX];  /* Server reply */
+} HgfsLoopbackData;
+
+static HgfsTransportChannel loopbackChannel;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelOpen --
+ *
+ *      Register with the in process server in an idempotent way.
+ *
+ * Results:
+ *      Existing or updated channel status, HGFS_CHANNEL_CONNECTED on success.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsChannelStatus
+HgfsLoopbackChannelOpen(HgfsTransportChannel *channel) // IN: Channel
+{
+   HgfsLoopbackData *data;
+
+   pthread_mutex_lock(&channel->connLock);
+   switch (channel->status) {
+   case HGFS_CHANNEL_UNINITIALIZED:
+      LOG(8, ("Loopback uninitialized.\n"));
+      break;
+   case HGFS_CHANNEL_CONNECTED:
+      LOG(8, ("Loopback already connected.\n"));
+      break;
+   case HGFS_CHANNEL_NOTCONNECTED:
+      data = malloc(sizeof *data);
+      if (data == NULL) {
+         LOG(8, ("ERROR: Out of memory.\n"));
+         break;
+      }
+      HgfsServerManager_DataInit(&data->mgrData, "vmhgfs-fuse", NULL, NULL);
+      if (HgfsServerManager_Register(&data->mgrData)) {
+         LOG(8, ("Loopback server registered.\n"));
+         channel->priv = data;
+         channel->status = HGFS_CHANNEL_CONNECTED;
+      } else {
+         LOG(8, ("ERROR: Loopback server cannot register.\n"));
+         free(data);
+      }
+      break;
+   default:
+      ASSERT(0); /* Not reached. */
+      LOG(2, ("ERROR: Loopback status %d is unknown resetting.\n",
+              channel->status));
+      channel->status = HGFS_CHANNEL_UNINITIALIZED;
+   }
+
+   pthread_mutex_unlock(&channel->connLock);
+   return channel->status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelCloseInt --
+ *
+ *      Unregister from the server in an idempotent way.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackChannelCloseInt(HgfsTransportChannel *channel) // IN: Channel
+{
+   if (channel->status == HGFS_CHANNEL_CONNECTED) {
+      HgfsLoopbackData *data = channel->priv;
+
+      ASSERT(data != NULL);
+      HgfsServerManager_Unregister(&data->mgrData);
+      free(data);
+      channel->priv = NULL;
+      channel->status = HGFS_CHANNEL_NOTCONNECTED;
+   }
+   LOG(8, ("Loopback closed.\n"));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelClose --
+ *
+ *      Unregister from the server in an idempotent way.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackChannelClose(HgfsTransportChannel *channel) // IN: Channel
+{
+   pthread_mutex_lock(&channel->connLock);
+   HgfsLoopbackChannelCloseInt(channel);
+   pthread_mutex_unlock(&channel->connLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelSend --
+ *
+ *     Process a request with the in process server. Like the backdoor,
+ *     the channel handles one request at a time.
+ *
+ * Results:
+ *     0 on success, negative error on failure.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLoopbackChannelSend(HgfsTransportChannel *channel, // IN: Channel
+                        HgfsReq *req)                  // IN: request to send
+{
+   HgfsLoopbackData *data;
+   size_t replySize;
+   int ret = 0;
+
+   ASSERT(req);
+   ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
+   ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
+
+   pthread_mutex_lock(&channel->connLock);
+
+   if (channel->status != HGFS_CHANNEL_CONNECTED) {
+      LOG(6, ("Loopback not opened.\n"));
+      pthread_mutex_unlock(&channel->connLock);
+      return -ENOTCONN;
+   }
+
+   data = channel->priv;
+   replySize = sizeof data->replyPacket;
+   if (HgfsServerManager_ProcessPacket(&data->mgrData,
+                                       HGFS_REQ_PAYLOAD(req),
+                                       req->payloadSize,
+                                       data->replyPacket,
+                                       &replySize)) {
+      HgfsCompleteReq(req, data->replyPacket, replySize);
+   } else {
+      ret = -EIO;
+   }
+
+   pthread_mutex_unlock(&channel->connLock);
+
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelExit --
+ *
+ *     Tear down the channel.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLoopbackChannelExit(HgfsTransportChannel *channel)  // IN
+{
+   pthread_mutex_lock(&channel->connLock);
+   HgfsLoopbackChannelCloseInt(channel);
+   channel->status = HGFS_CHANNEL_UNINITIALIZED;
+   pthread_mutex_unlock(&channel->connLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelInit --
+ *
+ *     Initialize loopback channel.
+ *
+ * Results:
+ *     Always return pointer to the loopback channel.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsTransportChannel*
+HgfsLoopbackChannelInit(void)
+{
+   loopbackChannel.name = "loopback";
+   loopbackChannel.ops.open = HgfsLoopbackChannelOpen;
+   loopbackChannel.ops.close = HgfsLoopbackChannelClose;
+   loopbackChannel.ops.send = HgfsLoopbackChannelSend;
+   loopbackChannel.ops.recv = NULL;
+   loopbackChannel.ops.exit = HgfsLoopbackChannelExit;
+   loopbackChannel.priv = NULL;
+   pthread_mutex_init(&loopbackChannel.connLock, NULL);
+   loopbackChannel.status = HGFS_CHANNEL_NOTCONNECTED;
+   return &loopbackChannel;
+}
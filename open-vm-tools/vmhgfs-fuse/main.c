@@ -30,6 +30,7 @@
 #include "cache.h"
 #include "filesystem.h"
 #include "file.h"
+#include "stats.h"
 
 /*
  *----------------------------------------------------------------------
@@ -126,7 +127,6 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
-   uint32 d_type;
    char *abspath = NULL;
    int res;
 
@@ -138,12 +138,14 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
 
    res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeAttrCache(abspath);
       }
    }
 
@@ -152,60 +154,7 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    }
 
    LOG(4, ("fill stat for %s\n", abspath));
-
-   memset(stbuf, 0, sizeof *stbuf);
-
-   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
-      stbuf->st_mode |= (attr->specialPerms << 9);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
-      stbuf->st_mode |= (attr->ownerPerms << 6);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
-      stbuf->st_mode |= (attr->groupPerms << 3);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
-      stbuf->st_mode |= (attr->otherPerms);
-   }
-
-   /* Mask the access mode. */
-   switch (attr->type) {
-   case HGFS_FILE_TYPE_SYMLINK:
-      d_type = DT_LNK;
-      break;
-
-   case HGFS_FILE_TYPE_REGULAR:
-      d_type = DT_REG;
-      break;
-
-   case HGFS_FILE_TYPE_DIRECTORY:
-      d_type = DT_DIR;
-      break;
-
-   default:
-      d_type = DT_UNKNOWN;
-      break;
-   }
-
-   stbuf->st_mode |= d_type << 12;
-   stbuf->st_blksize = HGFS_BLOCKSIZE;
-   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
-   stbuf->st_size = attr->size;
-   stbuf->st_ino = attr->hostFileId;
-   stbuf->st_nlink = 1;
-   stbuf->st_uid = attr->userId;
-   stbuf->st_gid = attr->groupId;
-   stbuf->st_rdev = 0;
-
-   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
-      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
-      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
-      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
-   }
+   HgfsAttrConvertToStat(attr, stbuf);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -247,14 +196,16 @@ hgfs_access(const char *path,  //IN: Path to a file.
       goto exit;
    }
 
-   res = HgfsGetAttrCache(path, attr);
+   res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeAttrCache(abspath);
       }
    }
 
@@ -374,7 +325,6 @@ hgfs_readdir(const char *path,          //IN: path to a directory
 {
    char *abspath = NULL;
    int res = 0;
-   HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
 
    LOG(4, ("Entry(path = %s, @ %#"FMT64"x)\n", path, offset));
    res = getAbsPath(path, &abspath);
@@ -382,13 +332,7 @@ hgfs_readdir(const char *path,          //IN: path to a directory
       goto exit;
    }
 
-   res = HgfsDirOpen(abspath, &fileHandle);
-   if (res < 0) {
-      goto exit;
-   }
-
-   fi->fh = fileHandle;
-   res = HgfsReaddir(fileHandle, buf, filler);
+   res = HgfsReaddir(abspath, buf, filler);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -459,6 +403,10 @@ hgfs_mkdir(const char *path,  //IN: path to a new dir
    }
 
    res = HgfsMkdir(abspath, mode);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(abspath);
+      HgfsInvalidateDirListing(abspath);
+   }
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -498,6 +446,7 @@ hgfs_unlink(const char *path) //IN: path to a file
    res = HgfsDelete(abspath, HGFS_OP_DELETE_FILE);
    if (res == 0) {
       HgfsInvalidateAttrCache(abspath);
+      HgfsInvalidateDirListing(abspath);
    }
 
 exit:
@@ -538,6 +487,7 @@ hgfs_rmdir(const char *path) //IN: path to a dir
    res = HgfsDelete(abspath, HGFS_OP_DELETE_DIR);
    if (res == 0) {
       HgfsInvalidateAttrCache(abspath);
+      HgfsInvalidateDirListing(abspath);
    }
 
 exit:
@@ -578,6 +528,10 @@ hgfs_symlink(const char *symname,   //IN: symname target
 
    LOG(4, ("symname = %s, abs source = %s)\n", symname, absSource));
    res = HgfsSymlink(absSource, symname);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(absSource);
+      HgfsInvalidateDirListing(absSource);
+   }
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -623,7 +577,9 @@ hgfs_rename(const char *from,  //IN: from path name
    res = HgfsRename(absfrom, absto);
    if (res == 0) {
       HgfsInvalidateAttrCache(absfrom);
+      HgfsInvalidateDirListing(absfrom);
       HgfsInvalidateAttrCache(absto);
+      HgfsInvalidateDirListing(absto);
    }
 
 exit:
@@ -1040,6 +996,10 @@ hgfs_create(const char *path,          //IN: path to a file
    }
 
    res = HgfsCreate(abspath, mode, fi);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(abspath);
+      HgfsInvalidateDirListing(abspath);
+   }
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -1097,6 +1057,60 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_write_buf
+ *
+ *    Write to the file using the handle, like hgfs_write. The data is
+ *    copied from the fuse buffer vector directly into the request, so
+ *    spliced writes skip the intermediate buffer fuse would otherwise
+ *    fill for hgfs_write.
+ *
+ * Results:
+ *    Returns the number of bytes written to the file.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_write_buf(const char *path,          //IN: path to a file
+               struct fuse_bufvec *buf,   //IN: data to write
+               off_t offset,              //IN: starting point to write
+               struct fuse_file_info *fi) //IN: file info structure
+{
+   char *abspath = NULL;
+   int res;
+
+   LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x, write %#"FMTSZ"x bytes @ %#"FMT64"x)\n",
+           path, fi->fh, fuse_buf_size(buf), offset));
+   res = getAbsPath(path, &abspath);
+   if (res < 0) {
+      goto exit;
+   }
+
+   if (fi->fh == HGFS_INVALID_HANDLE) {
+      res = HgfsOpen(abspath, fi);
+      if (res) {
+         goto exit;
+      }
+   }
+
+   res = HgfsWriteBuf(fi, buf, offset);
+   if (res >= 0) {
+      HgfsInvalidateAttrCache(abspath);
+   }
+
+exit:
+   LOG(4, ("Exit(%d)\n", res));
+   freeAbsPath(abspath);
+   return res;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1238,7 +1252,8 @@ exit:
  *
  * hgfs_init
  *
- *    Initialization routine. We spawn the cache purge thread here.
+ *    Initialization routine. We spawn the cache purge thread, and the
+ *    statistics file writer if asked for, here.
  *
  * Results:
  *    Returns NULL.
@@ -1268,6 +1283,15 @@ hgfs_init(struct fuse_conn_info *conn) // IN: unused
       LOG(4, ("Pthread create fail. error = %d\n", res));
    }
 
+   if (gState->statsFile != NULL) {
+      pthread_t statsThread;
+
+      res = pthread_create(&statsThread, NULL, HgfsStatsWriter, &dummy);
+      if (res < 0) {
+         LOG(4, ("Pthread create fail. error = %d\n", res));
+      }
+   }
+
    res = HgfsCreateSession();
    if (res < 0) {
       LOG(4, ("Create session failed. error = %d\n", res));
@@ -1308,6 +1332,11 @@ hgfs_destroy(void *data) // IN: unused
 
    HgfsTransportExit();
 
+   /* Leave the final counters behind. */
+   HgfsStatsWriteFile();
+   free(gState->statsFile);
+   gState->statsFile = NULL;
+
    free(gState->basePath);
 
    if (gState->conf != NULL) {
@@ -1343,6 +1372,7 @@ static struct fuse_operations vmhgfs_operations = {
    .open        = hgfs_open,
    .read        = hgfs_read,
    .write       = hgfs_write,
+   .write_buf   = hgfs_write_buf,
    .statfs      = hgfs_statfs,
    .release     = hgfs_release,
    .create      = hgfs_create,
@@ -29,10 +29,209 @@
 #include "transport.h"
 #include "fsutil.h"
 #include "vm_assert.h"
+#include "vm_atomic.h"
+#include "stats.h"
+
+/*
+ * Finished requests are kept for reuse instead of being freed. Each
+ * thread keeps a couple on its own list, which it can use without
+ * locking, and spills the rest onto a shared list. Only when both are
+ * empty is a new request allocated.
+ *
+ * All requests have the same size: every packing routine bounds its
+ * names against HGFS_LARGE_PACKET_MAX, and the session advertises that
+ * size to the server, so any reply may need the full packet.
+ */
+#define HGFS_REQ_THREAD_POOL_MAX 2
+#define HGFS_REQ_SHARED_POOL_MAX 16
+
+typedef struct HgfsReqPool {
+   struct list_head free;  /* Free requests, linked by HgfsReq.list */
+   uint32 count;           /* Number of requests on the list */
+} HgfsReqPool;
 
 static HgfsHandle hgfsIdCounter;
 pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
 
+static HgfsReqPool hgfsReqSharedPool = {
+   LIST_HEAD_INIT(hgfsReqSharedPool.free), 0
+};
+static pthread_mutex_t hgfsReqPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t hgfsReqPoolKey;
+static Bool hgfsReqPoolKeyValid;
+static pthread_once_t hgfsReqPoolOnce = PTHREAD_ONCE_INIT;
+static Atomic_uint64 hgfsReqAllocated;
+static Atomic_uint64 hgfsReqReused;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolThreadExit --
+ *
+ *    Thread specific data destructor. Hands the free requests of an
+ *    exiting thread to the shared pool, or frees them if it is full.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqPoolThreadExit(void *data)  // IN: Pool of the exiting thread
+{
+   HgfsReqPool *pool = data;
+   struct list_head *cur;
+   struct list_head *next;
+
+   pthread_mutex_lock(&hgfsReqPoolLock);
+   list_for_each_safe(cur, next, &pool->free) {
+      HgfsReq *req = list_entry(cur, HgfsReq, list);
+
+      list_del_init(&req->list);
+      if (hgfsReqSharedPool.count < HGFS_REQ_SHARED_POOL_MAX) {
+         list_add(&req->list, &hgfsReqSharedPool.free);
+         hgfsReqSharedPool.count++;
+      } else {
+         free(req);
+      }
+   }
+   pthread_mutex_unlock(&hgfsReqPoolLock);
+   free(pool);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolInit --
+ *
+ *    Creates the key for the per thread request pools. Run once.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqPoolInit(void)
+{
+   if (pthread_key_create(&hgfsReqPoolKey, HgfsReqPoolThreadExit) == 0) {
+      hgfsReqPoolKeyValid = TRUE;
+   } else {
+      LOG(4, ("Can't create thread key, using the shared pool only.\n"));
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolGetThreadPool --
+ *
+ *    Look up the request pool of the calling thread, creating it on
+ *    first use.
+ *
+ * Results:
+ *    The pool, or NULL if it cannot be created.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReqPool *
+HgfsReqPoolGetThreadPool(void)
+{
+   HgfsReqPool *pool;
+
+   pthread_once(&hgfsReqPoolOnce, HgfsReqPoolInit);
+   if (!hgfsReqPoolKeyValid) {
+      return NULL;
+   }
+
+   pool = pthread_getspecific(hgfsReqPoolKey);
+   if (pool == NULL) {
+      pool = malloc(sizeof *pool);
+      if (pool == NULL) {
+         return NULL;
+      }
+      INIT_LIST_HEAD(&pool->free);
+      pool->count = 0;
+      if (pthread_setspecific(hgfsReqPoolKey, pool) != 0) {
+         free(pool);
+         return NULL;
+      }
+   }
+   return pool;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolTake --
+ *
+ *    Take a request off a free list.
+ *
+ * Results:
+ *    The request, or NULL if the list is empty.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReq *
+HgfsReqPoolTake(HgfsReqPool *pool)  // IN/OUT: Pool to take from
+{
+   HgfsReq *req;
+
+   if (list_empty(&pool->free)) {
+      return NULL;
+   }
+   req = list_entry(pool->free.next, HgfsReq, list);
+   list_del_init(&req->list);
+   pool->count--;
+   return req;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetRequestPoolStats --
+ *
+ *    Report how many requests were allocated and how many times a
+ *    cached request was reused instead.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsGetRequestPoolStats(uint64 *allocated,  // OUT: Requests allocated
+                        uint64 *reused)     // OUT: Requests reused
+{
+   *allocated = Atomic_Read64(&hgfsReqAllocated);
+   *reused = Atomic_Read64(&hgfsReqReused);
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -40,6 +239,7 @@ pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
  * HgfsGetNewRequest --
  *
  *    Get a new request structure off the free list and initialize it.
+ *    A new one is allocated only when no finished request is cached.
  *
  * Results:
  *    On success the new struct is returned with all fields
@@ -54,12 +254,27 @@ pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
 HgfsReq *
 HgfsGetNewRequest(void)
 {
+   HgfsReqPool *pool = HgfsReqPoolGetThreadPool();
    HgfsReq *req = NULL;
 
-   req = (HgfsReq*)malloc(sizeof(HgfsReq));
+   if (pool != NULL) {
+      req = HgfsReqPoolTake(pool);
+   }
    if (req == NULL) {
-      LOG(4, ("Can't allocate memory.\n"));
-      return NULL;
+      pthread_mutex_lock(&hgfsReqPoolLock);
+      req = HgfsReqPoolTake(&hgfsReqSharedPool);
+      pthread_mutex_unlock(&hgfsReqPoolLock);
+   }
+
+   if (req != NULL) {
+      Atomic_Inc64(&hgfsReqReused);
+   } else {
+      req = (HgfsReq*)malloc(sizeof(HgfsReq));
+      if (req == NULL) {
+         LOG(4, ("Can't allocate memory.\n"));
+         return NULL;
+      }
+      Atomic_Inc64(&hgfsReqAllocated);
    }
    INIT_LIST_HEAD(&req->list);
    req->payloadSize = 0;
@@ -98,6 +313,7 @@ HgfsStatus
 HgfsPackHeader(HgfsReq *req,  // IN/OUT:
                HgfsOp opUsed) // IN
 {
+   req->op = opUsed;
    if (gState->sessionEnabled) { /* use new header */
       HgfsHeader *header = (HgfsHeader*)HGFS_REQ_PAYLOAD(req);
 
@@ -308,6 +524,8 @@ HgfsGetReplyHeaderSize(void)
 int
 HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 {
+   struct timespec start;
+   struct timespec end;
    int ret;
 
    ASSERT(req);
@@ -318,9 +536,16 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
    LOG(8, ("Sending request id %d\n", req->id));
    LOG(4, ("Before sending \n"));
 
+   clock_gettime(CLOCK_MONOTONIC, &start);
    ret = HgfsTransportSendRequest(req);
+   clock_gettime(CLOCK_MONOTONIC, &end);
    LOG(4, ("After sending \n"));
 
+   HgfsStatsRecordRequest(req->op,
+                          (end.tv_sec - start.tv_sec) * CONST64U(1000000) +
+                          (end.tv_nsec - start.tv_nsec) / 1000,
+                          ret);
+
    LOG(8, ("Request finished, return %d\n", ret));
    return ret;
 }
@@ -331,7 +556,8 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
  *
  * HgfsFreeRequest --
  *
- *    Free an HGFS request.
+ *    Free an HGFS request. The request is kept on the free list of
+ *    the calling thread, or on the shared one, if there is room.
  *
  * Results:
  *    None
@@ -345,6 +571,31 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 void
 HgfsFreeRequest(HgfsReq *req) // IN: Request to free
 {
+   HgfsReqPool *pool;
+
+   if (req == NULL) {
+      return;
+   }
+
+   /* The receiver thread may still see it on the pending queue. */
+   HgfsTransportDequeueRequest(req);
+   req->state = HGFS_REQ_STATE_ALLOCATED;
+
+   pool = HgfsReqPoolGetThreadPool();
+   if (pool != NULL && pool->count < HGFS_REQ_THREAD_POOL_MAX) {
+      list_add(&req->list, &pool->free);
+      pool->count++;
+      return;
+   }
+
+   pthread_mutex_lock(&hgfsReqPoolLock);
+   if (hgfsReqSharedPool.count < HGFS_REQ_SHARED_POOL_MAX) {
+      list_add(&req->list, &hgfsReqSharedPool.free);
+      hgfsReqSharedPool.count++;
+      req = NULL;
+   }
+   pthread_mutex_unlock(&hgfsReqPoolLock);
+
    free(req);
 }
 
@@ -418,8 +669,8 @@ out:
  *
  * HgfsCompleteReq --
  *
- *    Copies the reply packet into the request structure and wakes up
- *    the associated client.
+ *    Copies the reply packet into the request structure, unless it was
+ *    received there, and wakes up the associated client.
  *
  * Results:
  *    None
@@ -439,7 +690,9 @@ HgfsCompleteReq(HgfsReq *req,       // IN: Request
    ASSERT(reply);
    ASSERT(replySize <= HGFS_LARGE_PACKET_MAX);
 
-   memcpy(HGFS_REQ_PAYLOAD(req), reply, replySize);
+   if (reply != HGFS_REQ_PAYLOAD(req)) {
+      memcpy(HGFS_REQ_PAYLOAD(req), reply, replySize);
+   }
    req->payloadSize = replySize;
    req->state = HGFS_REQ_STATE_COMPLETED;
    if (!list_empty(&req->list)) {
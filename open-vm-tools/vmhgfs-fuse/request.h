@@ -100,14 +100,18 @@ typedef struct HgfsReq {
    /* ID of this request */
    HgfsHandle id;
 
+   /* Op of this request, set when the header is packed. */
+   HgfsOp op;
+
    /* Total size of the payload.*/
    size_t payloadSize;
 
    /*
     * Packet of data, for both incoming and outgoing messages.
-    * Include room for the command.
+    * Include room for the command, and for the NUL the backdoor channel
+    * writes after a reply it receives in place.
     */
-   char packet[HGFS_LARGE_PACKET_MAX + HGFS_CLIENT_CMD_LEN];
+   char packet[HGFS_LARGE_PACKET_MAX + HGFS_CLIENT_CMD_LEN + 1];
 } HgfsReq;
 
 /* Public functions (with respect to the entire module). */
@@ -130,6 +134,7 @@ size_t HgfsGetReplyHeaderSize(void);
 size_t HgfsGetRequestHeaderSize(void);
 int HgfsSendRequest(HgfsReq *req);
 void HgfsFreeRequest(HgfsReq *req);
+void HgfsGetRequestPoolStats(uint64 *allocated, uint64 *reused);
 HgfsStatus HgfsGetReplyStatus(HgfsReq *req);
 void HgfsCompleteReq(HgfsReq *req,
                      char const *reply,
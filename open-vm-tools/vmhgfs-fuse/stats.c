@@ -0,0 +1,455 @@
+/*********************************************************
+ * Copyright (C) 2019 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * stats.c --
+ *
+ * Runtime statistics of the vmhgfs FUSE client, written to a file
+ * outside the mount (see the stats_file mount option) so that a running
+ * mount can be diagnosed without debug logging.
+ */
+
+#include "module.h"
+#include "cache.h"
+#include "stats.h"
+#include "vm_atomic.h"
+
+/*
+ * Request latencies are kept in power of two buckets: bucket i counts
+ * requests that took less than 2^i microseconds, the last bucket
+ * counts everything slower.
+ */
+#define HGFS_STATS_LATENCY_BUCKETS 24
+
+/* Seconds between two writes of the statistics file. */
+#define HGFS_STATS_WRITE_INTERVAL 5
+
+/*
+ * Requests are accounted by what they do rather than by protocol
+ * version, e.g. GETATTR, GETATTR_V2 and GETATTR_V3 are all "getattr".
+ */
+#define HGFS_STATS_OPS \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_OPEN,         "open") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_READ,         "read") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_WRITE,        "write") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_CLOSE,        "close") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_SEARCH_OPEN,  "search_open") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_SEARCH_READ,  "search_read") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_SEARCH_CLOSE, "search_close") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_GETATTR,      "getattr") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_SETATTR,      "setattr") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_CREATE_DIR,   "create_dir") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_DELETE,       "delete") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_RENAME,       "rename") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_SYMLINK,      "symlink") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_VOLUME_INFO,  "volume_info") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_SESSION,      "session") \
+   DEFINE_HGFS_STATS_OP(HGFS_STATS_OP_OTHER,        "other")
+
+#define DEFINE_HGFS_STATS_OP(a, b) a,
+
+typedef enum {
+   HGFS_STATS_OPS
+   HGFS_STATS_OP_MAX
+} HgfsStatsOp;
+
+#undef DEFINE_HGFS_STATS_OP
+
+#define DEFINE_HGFS_STATS_OP(a, b) b,
+
+static const char *HgfsStatsOpName[] = {
+   HGFS_STATS_OPS
+};
+
+#undef DEFINE_HGFS_STATS_OP
+
+typedef struct HgfsStatsOpCounters {
+   uint64 count;                   /* Requests sent */
+   uint64 errors;                  /* Requests the transport failed */
+   uint64 totalUs;                 /* Sum of latencies */
+   uint64 latency[HGFS_STATS_LATENCY_BUCKETS];
+} HgfsStatsOpCounters;
+
+static HgfsStatsOpCounters hgfsStatsOps[HGFS_STATS_OP_MAX];
+static pthread_mutex_t hgfsStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static Atomic_uint64 hgfsStatsBytesRead;
+static Atomic_uint64 hgfsStatsBytesWritten;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsOpFromHgfsOp
+ *
+ *    Maps a protocol op of any version to the op it is accounted as.
+ *
+ * Results:
+ *    The statistics op.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsStatsOp
+HgfsStatsOpFromHgfsOp(HgfsOp op)  //IN: Protocol op
+{
+   switch (op) {
+   case HGFS_OP_OPEN:
+   case HGFS_OP_OPEN_V2:
+   case HGFS_OP_OPEN_V3:
+      return HGFS_STATS_OP_OPEN;
+   case HGFS_OP_READ:
+   case HGFS_OP_READ_V3:
+      return HGFS_STATS_OP_READ;
+   case HGFS_OP_WRITE:
+   case HGFS_OP_WRITE_V3:
+      return HGFS_STATS_OP_WRITE;
+   case HGFS_OP_CLOSE:
+   case HGFS_OP_CLOSE_V3:
+      return HGFS_STATS_OP_CLOSE;
+   case HGFS_OP_SEARCH_OPEN:
+   case HGFS_OP_SEARCH_OPEN_V3:
+      return HGFS_STATS_OP_SEARCH_OPEN;
+   case HGFS_OP_SEARCH_READ:
+   case HGFS_OP_SEARCH_READ_V2:
+   case HGFS_OP_SEARCH_READ_V3:
+      return HGFS_STATS_OP_SEARCH_READ;
+   case HGFS_OP_SEARCH_CLOSE:
+   case HGFS_OP_SEARCH_CLOSE_V3:
+      return HGFS_STATS_OP_SEARCH_CLOSE;
+   case HGFS_OP_GETATTR:
+   case HGFS_OP_GETATTR_V2:
+   case HGFS_OP_GETATTR_V3:
+      return HGFS_STATS_OP_GETATTR;
+   case HGFS_OP_SETATTR:
+   case HGFS_OP_SETATTR_V2:
+   case HGFS_OP_SETATTR_V3:
+      return HGFS_STATS_OP_SETATTR;
+   case HGFS_OP_CREATE_DIR:
+   case HGFS_OP_CREATE_DIR_V2:
+   case HGFS_OP_CREATE_DIR_V3:
+      return HGFS_STATS_OP_CREATE_DIR;
+   case HGFS_OP_DELETE_FILE:
+   case HGFS_OP_DELETE_FILE_V2:
+   case HGFS_OP_DELETE_FILE_V3:
+   case HGFS_OP_DELETE_DIR:
+   case HGFS_OP_DELETE_DIR_V2:
+   case HGFS_OP_DELETE_DIR_V3:
+      return HGFS_STATS_OP_DELETE;
+   case HGFS_OP_RENAME:
+   case HGFS_OP_RENAME_V2:
+   case HGFS_OP_RENAME_V3:
+      return HGFS_STATS_OP_RENAME;
+   case HGFS_OP_CREATE_SYMLINK:
+   case HGFS_OP_CREATE_SYMLINK_V3:
+      return HGFS_STATS_OP_SYMLINK;
+   case HGFS_OP_QUERY_VOLUME_INFO:
+   case HGFS_OP_QUERY_VOLUME_INFO_V3:
+      return HGFS_STATS_OP_VOLUME_INFO;
+   case HGFS_OP_CREATE_SESSION_V4:
+   case HGFS_OP_DESTROY_SESSION_V4:
+      return HGFS_STATS_OP_SESSION;
+   default:
+      return HGFS_STATS_OP_OTHER;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsRecordRequest
+ *
+ *    Accounts one request sent to the server.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsRecordRequest(HgfsOp op,          //IN: Protocol op sent
+                       uint64 latencyUs,   //IN: Round trip time
+                       int result)         //IN: Transport result
+{
+   HgfsStatsOpCounters *counters = &hgfsStatsOps[HgfsStatsOpFromHgfsOp(op)];
+   uint32 bucket = 0;
+
+   while (bucket < HGFS_STATS_LATENCY_BUCKETS - 1 &&
+          latencyUs >= (CONST64U(1) << bucket)) {
+      bucket++;
+   }
+
+   pthread_mutex_lock(&hgfsStatsLock);
+   counters->count++;
+   if (result != 0) {
+      counters->errors++;
+   }
+   counters->totalUs += latencyUs;
+   counters->latency[bucket]++;
+   pthread_mutex_unlock(&hgfsStatsLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsAddBytesRead
+ *
+ *    Accounts file data returned by the server.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsAddBytesRead(uint64 bytes)   //IN: Bytes read
+{
+   Atomic_Add64(&hgfsStatsBytesRead, bytes);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsAddBytesWritten
+ *
+ *    Accounts file data written by the server.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsAddBytesWritten(uint64 bytes)   //IN: Bytes written
+{
+   Atomic_Add64(&hgfsStatsBytesWritten, bytes);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsFormatOps
+ *
+ *    Formats the per op counters. Ops never sent are left out, and so
+ *    are empty latency buckets; "lt_N" is the number of requests that
+ *    took less than N microseconds but at least half of that.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsStatsFormatOps(GString *text)   //IN/OUT: Text to append to
+{
+   HgfsStatsOpCounters ops[HGFS_STATS_OP_MAX];
+   uint32 i;
+   uint32 j;
+
+   pthread_mutex_lock(&hgfsStatsLock);
+   memcpy(ops, hgfsStatsOps, sizeof ops);
+   pthread_mutex_unlock(&hgfsStatsLock);
+
+   for (i = 0; i < HGFS_STATS_OP_MAX; i++) {
+      const char *name = HgfsStatsOpName[i];
+
+      if (ops[i].count == 0) {
+         continue;
+      }
+      g_string_append_printf(text, "op_%s_count: %"FMT64"u\n",
+                             name, ops[i].count);
+      g_string_append_printf(text, "op_%s_errors: %"FMT64"u\n",
+                             name, ops[i].errors);
+      g_string_append_printf(text, "op_%s_avg_us: %"FMT64"u\n",
+                             name, ops[i].totalUs / ops[i].count);
+      g_string_append_printf(text, "op_%s_latency_us:", name);
+      for (j = 0; j < HGFS_STATS_LATENCY_BUCKETS; j++) {
+         if (ops[i].latency[j] == 0) {
+            continue;
+         }
+         if (j < HGFS_STATS_LATENCY_BUCKETS - 1) {
+            g_string_append_printf(text, " lt_%"FMT64"u=%"FMT64"u",
+                                   CONST64U(1) << j, ops[i].latency[j]);
+         } else {
+            g_string_append_printf(text, " ge_%"FMT64"u=%"FMT64"u",
+                                   CONST64U(1) << (j - 1), ops[i].latency[j]);
+         }
+      }
+      g_string_append(text, "\n");
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsFormat
+ *
+ *    Formats the current counters as "name: value" lines.
+ *
+ * Results:
+ *    Newly allocated string, the caller frees it with g_string_free.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static GString *
+HgfsStatsFormat(void)
+{
+   GString *text = g_string_new(NULL);
+   HgfsCacheStats cacheStats;
+   uint64 lookups;
+   uint64 requestsAllocated;
+   uint64 requestsReused;
+   uint32 inFlight;
+   uint32 maxInFlight;
+
+   HgfsGetCacheStats(&cacheStats);
+   lookups = cacheStats.hits + cacheStats.negativeHits + cacheStats.misses;
+
+   g_string_append_printf(text, "attr_cache_hits: %"FMT64"u\n",
+                          cacheStats.hits);
+   g_string_append_printf(text, "attr_cache_negative_hits: %"FMT64"u\n",
+                          cacheStats.negativeHits);
+   g_string_append_printf(text, "attr_cache_misses: %"FMT64"u\n",
+                          cacheStats.misses);
+   g_string_append_printf(text, "attr_cache_hit_rate: %.1f%%\n",
+                          lookups == 0 ? 0.0 :
+                          100.0 * (lookups - cacheStats.misses) / lookups);
+   g_string_append_printf(text, "attr_cache_negative_hit_rate: %.1f%%\n",
+                          lookups == 0 ? 0.0 :
+                          100.0 * cacheStats.negativeHits / lookups);
+   g_string_append_printf(text, "attr_cache_negative_entries: %u\n",
+                          cacheStats.negativeEntries);
+   g_string_append_printf(text, "attr_cache_evictions: %"FMT64"u\n",
+                          cacheStats.evictions);
+   g_string_append_printf(text, "attr_cache_refreshes: %"FMT64"u\n",
+                          cacheStats.refreshes);
+   g_string_append_printf(text, "attr_cache_refresh_searches: %"FMT64"u\n",
+                          cacheStats.refreshSearches);
+
+   HgfsGetRequestPoolStats(&requestsAllocated, &requestsReused);
+   g_string_append_printf(text, "requests_allocated: %"FMT64"u\n",
+                          requestsAllocated);
+   g_string_append_printf(text, "requests_reused: %"FMT64"u\n",
+                          requestsReused);
+
+   HgfsTransportGetStats(&inFlight, &maxInFlight);
+   g_string_append_printf(text, "transport_in_flight: %u\n", inFlight);
+   g_string_append_printf(text, "transport_max_in_flight: %u\n",
+                          maxInFlight);
+
+   g_string_append_printf(text, "bytes_read: %"FMT64"u\n",
+                          Atomic_Read64(&hgfsStatsBytesRead));
+   g_string_append_printf(text, "bytes_written: %"FMT64"u\n",
+                          Atomic_Read64(&hgfsStatsBytesWritten));
+
+   HgfsStatsFormatOps(text);
+
+   return text;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsWriteFile
+ *
+ *    Writes a snapshot of the counters to the file given with the
+ *    stats_file mount option. The file is replaced atomically, so a
+ *    reader never sees a partial snapshot.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsWriteFile(void)
+{
+   GString *text;
+   GError *err = NULL;
+
+   if (gState->statsFile == NULL) {
+      return;
+   }
+
+   text = HgfsStatsFormat();
+   if (!g_file_set_contents(gState->statsFile, text->str, text->len, &err)) {
+      LOG(4, ("Writing %s failed: %s\n", gState->statsFile, err->message));
+      g_clear_error(&err);
+   }
+   g_string_free(text, TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsWriter
+ *
+ *    This routine is called by an independent thread to write the
+ *    statistics file every HGFS_STATS_WRITE_INTERVAL seconds.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void*
+HgfsStatsWriter(void* unused)      //IN: Thread argument
+{
+   while (1) {
+      HgfsStatsWriteFile();
+      sleep(HGFS_STATS_WRITE_INTERVAL);
+   }
+   return 0;
+}
@@ -33,10 +33,14 @@
 
 #include "bdhandler.h"
 #include "hgfsProto.h"
+#ifdef VMHGFS_LOOPBACK
+#include "loopback.h"
+#endif
 #include "module.h"
 #include "request.h"
 #include "transport.h"
 #include "vm_assert.h"
+#include "vm_atomic.h"
 
 static HgfsTransportChannel *gHgfsActiveChannel;     /* Current active channel. */
 static pthread_mutex_t gHgfsActiveChannelLock;       /* Current active channel lock. */
@@ -46,6 +50,9 @@ static struct list_head gHgfsPendingRequests;        /* Pending requests queue.
 static pthread_mutex_t gHgfsPendingRequestsLock;     /* Pending requests queue lock. */
 static Bool gHgfsPendingRequestsLockInited;
 
+static Atomic_uint32 gHgfsRequestsInFlight;          /* Requests being sent. */
+static Atomic_uint32 gHgfsRequestsMaxInFlight;       /* Most ever being sent. */
+
 
 #define HgfsRequestId(req) ((HgfsRequest *)req)->id
 
@@ -60,7 +67,9 @@ static void HgfsTransportChannelClose(HgfsTransportChannel **channel);
  *
  * HgfsTransportChannelOpen --
  *
- *     Open a new workable channel.
+ *     Open a new workable channel. This is the backdoor, or the in
+ *     process server when the loopback option is given to a client
+ *     built with VMHGFS_LOOPBACK.
  *
  * Results:
  *     0 on success and the new channel, otherwise -ENOTCONN and NULL.
@@ -76,7 +85,14 @@ HgfsTransportChannelOpen(HgfsTransportChannel **channel) // IN: active channel
 {
    int result = 0;
 
-   *channel = HgfsBdChannelInit();
+#ifdef VMHGFS_LOOPBACK
+   if (gState->loopback) {
+      *channel = HgfsLoopbackChannelInit();
+   } else
+#endif
+   {
+      *channel = HgfsBdChannelInit();
+   }
    if (NULL != *channel) {
       HgfsChannelStatus status = (*channel)->ops.open(*channel);
       if (status != HGFS_CHANNEL_CONNECTED) {
@@ -194,11 +210,19 @@ HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
  *----------------------------------------------------------------------
  */
 
-static void
+void
 HgfsTransportDequeueRequest(HgfsReq *req)   // IN: Request to dequeue
 {
    ASSERT(req);
 
+   if (!gHgfsPendingRequestsLockInited) {
+      /* No transport, hence no receiver thread walking the queue. */
+      if (!list_empty(&req->list)) {
+         list_del_init(&req->list);
+      }
+      return;
+   }
+
    pthread_mutex_lock(&gHgfsPendingRequestsLock);
    if (!list_empty(&req->list)) {
       list_del_init(&req->list);
@@ -322,10 +346,24 @@ int
 HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
 {
    int ret;
+   uint32 inFlight;
+   uint32 maxInFlight;
+
    ASSERT(req);
    ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
    ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
 
+   inFlight = Atomic_ReadInc32(&gHgfsRequestsInFlight) + 1;
+   maxInFlight = Atomic_Read32(&gHgfsRequestsMaxInFlight);
+   while (inFlight > maxInFlight) {
+      uint32 seen = Atomic_ReadIfEqualWrite32(&gHgfsRequestsMaxInFlight,
+                                              maxInFlight, inFlight);
+      if (seen == maxInFlight) {
+         break;
+      }
+      maxInFlight = seen;
+   }
+
    pthread_mutex_lock(&gHgfsActiveChannelLock);
 
    /* Try opening the channel. */
@@ -341,7 +379,8 @@ HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
    HgfsTransportEnqueueRequest(req);
 
    ret = gHgfsActiveChannel->ops.send(gHgfsActiveChannel, req);
-   if (ret < 0) {
+   /* On -EPROTO the request reached the server, do not send it twice. */
+   if (ret < 0 && ret != -EPROTO) {
       LOG(4, ("Send failed, status = %d. Try reopening the channel ...\n",
               ret));
       if (HgfsTransportChannelReset(&gHgfsActiveChannel)) {
@@ -360,10 +399,37 @@ exit:
       HgfsTransportDequeueRequest(req);
    }
 
+   Atomic_Dec32(&gHgfsRequestsInFlight);
    return ret;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportGetStats --
+ *
+ *     Report the number of requests currently being sent, including
+ *     those waiting for the channel, and the highest such number seen.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsTransportGetStats(uint32 *inFlight,     // OUT: Requests being sent
+                      uint32 *maxInFlight)  // OUT: Most ever being sent
+{
+   *inFlight = Atomic_Read32(&gHgfsRequestsInFlight);
+   *maxInFlight = Atomic_Read32(&gHgfsRequestsMaxInFlight);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
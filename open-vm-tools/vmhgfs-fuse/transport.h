@@ -56,8 +56,10 @@ typedef struct HgfsTransportChannel {
 int HgfsTransportInit(void);
 void HgfsTransportExit(void);
 int HgfsTransportSendRequest(HgfsReq *req);
+void HgfsTransportDequeueRequest(HgfsReq *req);
 void HgfsTransportProcessPacket(char *receivedPacket,
                                 size_t receivedSize);
 void HgfsTransportBeforeExitingRecvThread(void);
+void HgfsTransportGetStats(uint32 *inFlight, uint32 *maxInFlight);
 
 #endif // _HGFS_DRIVER_TRANSPORT_H_